@@ -23,6 +23,7 @@ static constexpr uint8_t MQTT_PORT_STR_MAX_SIZE = 16;
 static constexpr uint16_t MQTT_TOPIC_MAX_SIZE = 64;
 static constexpr uint8_t MQTT_USERNAME_MAX_SIZE = 32;
 static constexpr uint8_t MQTT_PASSWORD_MAX_SIZE = 32;
+static constexpr uint16_t MQTT_BUFFER_SIZE = 1024;
 
 static constexpr uint8_t UPDATE_MIN_USERNAME_LEN = 1;
 static constexpr uint8_t UPDATE_MAX_USERNAME_LEN = 32;
@@ -31,9 +32,25 @@ static constexpr uint8_t UPDATE_MAX_PW_LEN = 64;
 
 static constexpr uint8_t HOST_NAME_MAX_LEN = 32;
 
+// access points the device roams between, including the one of the config
+static constexpr uint8_t ACCESS_POINTS_MAX = 4;
+
 static constexpr int8_t DEFAULT_MOTOR_GROUND = D6;
 static constexpr int8_t DEFAULT_MOTOR_VIN = D5;
 
+// The motor duty cycle ramps up linearly over MOTOR_RAMP_MILLIS to limit the inrush
+// current on a weak battery, 0 disables the ramp. The run time is extended by the
+// rotation lost in the ramp, see heating::MotorDriver::rampedMillis.
+// A ceiling below 100 percent slows down the motor, which makes the valve position
+// estimated from the rotate time less accurate.
+static constexpr uint16_t MOTOR_RAMP_MILLIS = 250;
+static constexpr uint8_t MOTOR_DUTY_CEILING_PERCENT = 100;
+static constexpr uint16_t MOTOR_PWM_RANGE = 1023;
+
+static constexpr uint8_t SCHEDULE_MAX_TRANSITIONS = 42;
+static constexpr uint8_t TIMEZONE_MAX_LEN = 48;
+static constexpr const char* DEFAULT_TIMEZONE = "UTC0";
+
 static constexpr int8_t DEFAULT_TEMP_VIN = D7;
 // On devboard defaults are D8 and D7
 // PIN_D7 13
@@ -51,14 +68,34 @@ typedef struct {
   char password[PASS_MAX_LEN];
 } WiFiCredentials;
 
+// encoding of the state topic, see network::StateMessage
+enum StateFormat { STATE_JSON, STATE_CBOR };
+
 typedef struct MQTTSettings {
   char Server[MQTT_SERVER_NAME_MAX_SIZE]{};
   unsigned short Port = MQTT_DEFAULT_PORT;
   char Topic[MQTT_TOPIC_MAX_SIZE]{};
   char Username[MQTT_USERNAME_MAX_SIZE]{};
   char Password[MQTT_PASSWORD_MAX_SIZE]{};
+  StateFormat Format{STATE_JSON};
+  // publish every value in its own topic in addition to the state topic,
+  // enabled by default so existing subscribers keep working
+  bool LegacyTopics{true};
 } MQTTSettings;
 
+// A value is published if it changed by at least its deadband since it was last
+// published, or if the heartbeat is due, see network::TelemetryFilter
+typedef struct TelemetrySettings {
+  // 1/100 degree celsius
+  uint16_t TempDeadband{10};
+  // 1/100 percent
+  uint16_t HumidityDeadband{100};
+  // mV
+  uint16_t VoltageDeadband{50};
+  // all values are published at least this often, 0 publishes them on every wake
+  uint16_t HeartbeatMinutes{60};
+} TelemetrySettings;
+
 typedef struct UpdateSettings {
   char Username[UPDATE_MAX_USERNAME_LEN]{};
   char Password[UPDATE_MAX_PW_LEN]{};
@@ -73,9 +110,15 @@ typedef struct PinSettings {
 enum OperationMode { HEAT, OFF, FULL_OPEN, UNKNOWN };
 enum TemperatureSensor { BME, BMP };
 
+// Layout version of the config file, increase it with every change of Config and
+// migrate the files of the previous version in Filesystem::initConfig.
+// Version 1 files were written without a version, they are told apart by their size.
+static constexpr uint32_t CONFIG_VERSION = 2;
+
 typedef struct Config {
   WiFiCredentials WifiCredentials{"", ""};
   MQTTSettings MQTT{};
+  TelemetrySettings Telemetry{};
   UpdateSettings Update{};
   char Hostname[HOST_NAME_MAX_LEN]{};
   float SetTemperature{18};
@@ -87,4 +130,13 @@ typedef struct Config {
 
 } Config;
 
+// The part of the config wakes which only check the valve need.
+// It is cached in rtc memory, so these wakes do not mount the filesystem.
+typedef struct HardwareConfig {
+  PinSettings MotorPins{DEFAULT_MOTOR_GROUND, DEFAULT_MOTOR_VIN};
+  PinSettings WindowPins{};
+  int8_t TempVin{DEFAULT_TEMP_VIN};
+  TemperatureSensor TempSensor{TemperatureSensor::BME};
+} HardwareConfig;
+
 #endif // WIFIMANAGERCONFIG_HPP_
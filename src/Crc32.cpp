@@ -0,0 +1,42 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "Crc32.hpp"
+
+namespace open_heat {
+
+uint32_t crc32(const void* data, size_t length, uint32_t crc)
+{
+  // nibble table keeps flash usage small and is still fast enough
+  // for the few hundred bytes of rtc memory
+  static constexpr uint32_t table[16] = {
+    0x00000000,
+    0x1DB71064,
+    0x3B6E20C8,
+    0x26D930AC,
+    0x76DC4190,
+    0x6B6B51F4,
+    0x4DB26158,
+    0x5005713C,
+    0xEDB88320,
+    0xF00F9344,
+    0xD6D6A3E8,
+    0xCB61B38C,
+    0x9B64C2B0,
+    0x86D3D2D4,
+    0xA00AE278,
+    0xBDBDF21C};
+
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < length; ++i) {
+    crc = table[(crc ^ bytes[i]) & 0x0F] ^ (crc >> 4);
+    crc = table[(crc ^ (bytes[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+
+  return ~crc;
+}
+
+} // namespace open_heat
@@ -0,0 +1,22 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_CRC32_HPP
+#define OPEN_HEAT_CRC32_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace open_heat {
+
+/**
+ * CRC-32 (IEEE 802.3) of the given data.
+ * Pass the result of a previous call as crc to checksum data in chunks.
+ */
+uint32_t crc32(const void* data, size_t length, uint32_t crc = 0);
+
+} // namespace open_heat
+
+#endif // OPEN_HEAT_CRC32_HPP
@@ -5,9 +5,40 @@
 
 #include "Filesystem.hpp"
 #include "RTCMemory.hpp"
+#include <Crc32.hpp>
 #include <yal/yal.hpp>
+#include <cstddef>
 #include <cstring>
 
+namespace {
+// Config files of version 1, written before the config was versioned.
+// Frozen, only used to migrate these files.
+struct ConfigV1 {
+  char WifiSsid[32];
+  char WifiPassword[64];
+  char MqttServer[32];
+  unsigned short MqttPort;
+  char MqttTopic[64];
+  char MqttUsername[32];
+  char MqttPassword[32];
+  char UpdateUsername[32];
+  char UpdatePassword[64];
+  char Hostname[32];
+  float SetTemperature;
+  OperationMode Mode;
+  int8_t MotorGround;
+  int8_t MotorVin;
+  int8_t WindowGround;
+  int8_t WindowVin;
+  int8_t TempVin;
+  TemperatureSensor TempSensor;
+};
+
+constexpr size_t CONFIG_FILE_SIZE = sizeof(CONFIG_VERSION) + sizeof(Config);
+static_assert(
+  sizeof(ConfigV1) != CONFIG_FILE_SIZE, "Version 1 files are told apart by their size");
+} // namespace
+
 namespace open_heat {
 
 bool Filesystem::setup()
@@ -32,16 +63,31 @@ bool Filesystem::setup()
   }
 
   m_logger.log(yal::Level::DEBUG, "FS setup done");
+  m_setup = true;
 
-  auto configValid = isConfigValid();
-  if (configValid) {
-    initConfig();
-  } else {
-    clearConfig();
+  m_configValid = initConfig();
+  updateHardwareConfig();
+  cacheConfig();
+  return m_configValid;
+}
+
+bool Filesystem::warmSetup()
+{
+  const auto cache = rtc::get<&rtc::Memory::configCache>();
+  if (cache.crc != crc32(&cache, offsetof(rtc::ConfigCache, crc))) {
+    m_logger.log(yal::Level::WARNING, "Config cache invalid, mounting filesystem");
+    return setup();
   }
 
-  m_setup = true;
-  return configValid;
+  m_hardwareConfig = {
+    {cache.motorGround, cache.motorVin},
+    {cache.windowGround, cache.windowVin},
+    cache.tempVin,
+    static_cast<TemperatureSensor>(cache.tempSensor)};
+  m_configValid = cache.configValid;
+  m_hardwareConfigCached = true;
+  m_logger.log(yal::Level::DEBUG, "Hardware config taken from rtc memory");
+  return m_configValid;
 }
 
 void Filesystem::listFiles()
@@ -68,6 +114,37 @@ Config& Filesystem::getConfig()
   return m_config;
 }
 
+const HardwareConfig& Filesystem::getHardwareConfig()
+{
+  if (!m_setup && !m_hardwareConfigCached) {
+    setup();
+  }
+  return m_hardwareConfig;
+}
+
+void Filesystem::cacheConfig()
+{
+  const auto& config = getHardwareConfig();
+  rtc::ConfigCache cache{
+    config.MotorPins.Ground,
+    config.MotorPins.Vin,
+    config.WindowPins.Ground,
+    config.WindowPins.Vin,
+    config.TempVin,
+    static_cast<uint8_t>(config.TempSensor),
+    m_configValid,
+    0,
+    0};
+  cache.crc = crc32(&cache, offsetof(rtc::ConfigCache, crc));
+  rtc::setConfigCache(cache);
+}
+
+void Filesystem::updateHardwareConfig()
+{
+  m_hardwareConfig
+    = {m_config.MotorPins, m_config.WindowPins, m_config.TempVin, m_config.TempSensor};
+}
+
 void Filesystem::clearConfig()
 {
   m_config = {};
@@ -82,35 +159,96 @@ void Filesystem::persistConfig()
     setup();
   }
 
-  File file = FileFS.open(configFile_, "w");
   m_logger.log(yal::Level::DEBUG, "Saving config");
+  if (!writeConfig()) {
+    return;
+  }
+
+  m_configValid = true;
+  updateHardwareConfig();
+  cacheConfig();
+  m_logger.log(yal::Level::DEBUG, "Configuration saved");
+}
 
+bool Filesystem::readFile(const char* path, void* data, size_t size)
+{
+  if (!m_setup) {
+    setup();
+  }
+
+  File file = FileFS.open(path, "r");
   if (!file) {
-    m_logger.log(yal::Level::ERROR, "Failed to create config file on FS");
-    return;
+    m_logger.log(yal::Level::DEBUG, "File % does not exist", path);
+    return false;
   }
 
-  file.write((uint8_t*)&m_config, sizeof(Config));
+  if (file.size() != size) {
+    m_logger.log(yal::Level::WARNING, "Layout of % changed, ignoring it", path);
+    file.close();
+    return false;
+  }
 
+  const auto read = file.readBytes(static_cast<char*>(data), size);
   file.close();
+  return read == size;
+}
 
-  m_logger.log(yal::Level::DEBUG, "Configuration saved");
+bool Filesystem::writeFile(const char* path, const void* data, size_t size)
+{
+  if (!m_setup) {
+    setup();
+  }
+
+  File file = FileFS.open(path, "w");
+  if (!file) {
+    m_logger.log(yal::Level::ERROR, "Failed to create % on FS", path);
+    return false;
+  }
+
+  const auto written = file.write(static_cast<const uint8_t*>(data), size);
+  file.close();
+  return written == size;
 }
 
-void Filesystem::initConfig()
+File Filesystem::openFile(const char* path, const char* mode)
+{
+  if (!m_setup) {
+    setup();
+  }
+
+  return FileFS.open(path, mode);
+}
+
+bool Filesystem::removeFile(const char* path)
+{
+  if (!m_setup) {
+    setup();
+  }
+
+  return !FileFS.exists(path) || FileFS.remove(path);
+}
+
+bool Filesystem::renameFile(const char* from, const char* to)
+{
+  if (!m_setup) {
+    setup();
+  }
+
+  return FileFS.rename(from, to);
+}
+
+bool Filesystem::initConfig()
 {
-  File file = FileFS.open(configFile_, "r");
   m_logger.log(yal::Level::DEBUG, "Loading config");
   clearConfig();
 
-  if (!file) {
-    m_logger.log(yal::Level::ERROR, "Failed to create read config from FS");
-    return;
+  if (!readConfig()) {
+    m_logger.log(
+      yal::Level::ERROR, "Config layout unknown, invalidating and new config necessary");
+    clearConfig();
+    return false;
   }
 
-  file.readBytes((char*)&m_config, sizeof(Config));
-
-  file.close();
   if (0 == std::strlen(m_config.Hostname)) {
     std::strcpy(m_config.Hostname, DEFAULT_HOST_NAME);
   }
@@ -129,19 +267,86 @@ void Filesystem::initConfig()
   }
 
   m_logger.log(yal::Level::DEBUG, "Successfully loaded config");
+  return true;
 }
 
-bool Filesystem::isConfigValid()
+bool Filesystem::readConfig()
 {
-  const File file = FileFS.open(configFile_, "r");
-  if (file.size() != sizeof(Config)) {
-    m_logger.log(
-      yal::Level::ERROR, "Config layout changed, invalidating and new config necessary");
+  File file = FileFS.open(configFile_, "r");
+  if (!file) {
+    m_logger.log(yal::Level::DEBUG, "File % does not exist", configFile_);
+    return false;
+  }
+
+  if (file.size() == sizeof(ConfigV1)) {
+    return migrateConfig(file);
+  }
+
+  uint32_t version = 0;
+  const auto read = file.size() == CONFIG_FILE_SIZE
+    && file.readBytes(reinterpret_cast<char*>(&version), sizeof(version))
+      == sizeof(version)
+    && version == CONFIG_VERSION
+    && file.readBytes(reinterpret_cast<char*>(&m_config), sizeof(Config))
+      == sizeof(Config);
+  file.close();
+  return read;
+}
+
+bool Filesystem::migrateConfig(File& file)
+{
+  ConfigV1 legacy{};
+  const auto read
+    = file.readBytes(reinterpret_cast<char*>(&legacy), sizeof(legacy)) == sizeof(legacy);
+  file.close();
+  if (!read) {
     return false;
   }
 
+  m_logger.log(yal::Level::INFO, "Migrating config from version 1");
+  // settings added since version 1 keep their defaults
+  const auto copy = [](char* destination, const char* source, size_t size) {
+    std::memcpy(destination, source, size - 1);
+    destination[size - 1] = '\0';
+  };
+  copy(m_config.WifiCredentials.ssid, legacy.WifiSsid, SSID_MAX_LEN);
+  copy(m_config.WifiCredentials.password, legacy.WifiPassword, PASS_MAX_LEN);
+  copy(m_config.MQTT.Server, legacy.MqttServer, MQTT_SERVER_NAME_MAX_SIZE);
+  m_config.MQTT.Port = legacy.MqttPort;
+  copy(m_config.MQTT.Topic, legacy.MqttTopic, MQTT_TOPIC_MAX_SIZE);
+  copy(m_config.MQTT.Username, legacy.MqttUsername, MQTT_USERNAME_MAX_SIZE);
+  copy(m_config.MQTT.Password, legacy.MqttPassword, MQTT_PASSWORD_MAX_SIZE);
+  copy(m_config.Update.Username, legacy.UpdateUsername, UPDATE_MAX_USERNAME_LEN);
+  copy(m_config.Update.Password, legacy.UpdatePassword, UPDATE_MAX_PW_LEN);
+  copy(m_config.Hostname, legacy.Hostname, HOST_NAME_MAX_LEN);
+  m_config.SetTemperature = legacy.SetTemperature;
+  m_config.Mode = legacy.Mode;
+  m_config.MotorPins = {legacy.MotorGround, legacy.MotorVin};
+  m_config.WindowPins = {legacy.WindowGround, legacy.WindowVin};
+  m_config.TempVin = legacy.TempVin;
+  m_config.TempSensor = legacy.TempSensor;
+
+  // if this fails the next setup migrates the file again
+  writeConfig();
   return true;
 }
+
+bool Filesystem::writeConfig()
+{
+  File file = FileFS.open(configFile_, "w");
+  if (!file) {
+    m_logger.log(yal::Level::ERROR, "Failed to create config file on FS");
+    return false;
+  }
+
+  const auto version = CONFIG_VERSION;
+  const auto written
+    = file.write(reinterpret_cast<const uint8_t*>(&version), sizeof(version))
+    + file.write(reinterpret_cast<const uint8_t*>(&m_config), sizeof(Config));
+  file.close();
+  return written == CONFIG_FILE_SIZE;
+}
+
 void Filesystem::format()
 {
   m_filesystem->format();
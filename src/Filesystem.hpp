@@ -17,24 +17,53 @@ class Filesystem {
   Filesystem(const Filesystem&) = delete;
 
   bool setup();
+
+  /**
+   * Takes the hardware config from rtc memory instead of mounting the filesystem,
+   * which happens lazily once the full config or a file is needed.
+   * Falls back to setup() if the cache is not valid.
+   * Returns if the stored config is valid.
+   */
+  bool warmSetup();
+
   Config& getConfig();
+  // Does not mount the filesystem after warmSetup()
+  const HardwareConfig& getHardwareConfig();
+
+  // Stores the hardware config in rtc memory for warmSetup()
+  void cacheConfig();
   void clearConfig();
 
   void persistConfig();
 
+  // Raw binary files, reading fails if the size of the file does not match.
+  bool readFile(const char* path, void* data, size_t size);
+  bool writeFile(const char* path, const void* data, size_t size);
+
+  // Files which are read or appended in parts, see network::Journal
+  File openFile(const char* path, const char* mode);
+  bool removeFile(const char* path);
+  bool renameFile(const char* from, const char* to);
+
   void format();
 
   private:
   void listFiles();
-  void initConfig();
-  bool isConfigValid();
+  bool initConfig();
+  bool readConfig();
+  bool migrateConfig(File& file);
+  bool writeConfig();
+  void updateHardwareConfig();
 
   [[nodiscard]] String formatBytes(size_t bytes);
 
   static constexpr const char* configFile_ = "/config.dat";
 
   Config m_config{};
+  HardwareConfig m_hardwareConfig{};
   bool m_setup = false;
+  bool m_configValid = false;
+  bool m_hardwareConfigCached = false;
   FS* m_filesystem = &FileFS;
   yal::Logger m_logger;
 };
@@ -0,0 +1,64 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "Profiler.hpp"
+#include <Arduino.h>
+#include <algorithm>
+#include <limits>
+
+namespace open_heat {
+
+namespace {
+uint16_t saturatedMillis(const uint64_t millis)
+{
+  return static_cast<uint16_t>(
+    std::min<uint64_t>(millis, std::numeric_limits<uint16_t>::max()));
+}
+} // namespace
+
+Profiler::Scope::Scope(const Phase phase) :
+    m_phase(phase), m_startMicros(micros())
+{
+}
+
+Profiler::Scope::~Scope()
+{
+  add(m_phase, micros() - m_startMicros);
+}
+
+void Profiler::add(const Phase phase, const unsigned long micros)
+{
+  s_phaseMicros[static_cast<size_t>(phase)] += micros;
+}
+
+void Profiler::commit()
+{
+  auto profiles = rtc::get<&rtc::Memory::wakeProfiles>();
+  auto& wake = profiles.wakes[profiles.head];
+  for (size_t phase = 0; phase < rtc::PROFILE_PHASES; ++phase) {
+    wake.phaseMillis[phase] = saturatedMillis((s_phaseMicros[phase] + 500) / 1000);
+  }
+  wake.awakeMillis = saturatedMillis(millis() - s_startMillis);
+
+  profiles.head = static_cast<uint8_t>((profiles.head + 1) % rtc::PROFILE_WAKES);
+  profiles.count = static_cast<uint8_t>(
+    std::min<size_t>(profiles.count + 1, rtc::PROFILE_WAKES));
+  rtc::setWakeProfiles(profiles);
+}
+
+void Profiler::restart()
+{
+  std::fill(std::begin(s_phaseMicros), std::end(s_phaseMicros), 0);
+  s_startMillis = millis();
+}
+
+void Profiler::clear()
+{
+  auto profiles = rtc::get<&rtc::Memory::wakeProfiles>();
+  profiles.count = 0;
+  rtc::setWakeProfiles(profiles);
+}
+
+} // namespace open_heat
@@ -0,0 +1,68 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_PROFILER_HPP
+#define OPEN_HEAT_PROFILER_HPP
+
+#include <RTCMemory.hpp>
+
+namespace open_heat {
+
+/**
+ * Measures where the awake time of a wake goes.
+ * Phases are timed with micros() and summed up in RAM, commit() stores the wake
+ * in a ring buffer of the last rtc::PROFILE_WAKES wakes in rtc memory.
+ */
+class Profiler {
+  public:
+  enum class Phase : uint8_t {
+    FILESYSTEM,
+    SENSOR,
+    DOUBLE_RESET,
+    WIFI,
+    MQTT,
+    BATTERY,
+    COUNT
+  };
+
+  // Times the phase from construction until it goes out of scope.
+  class Scope {
+    public:
+    explicit Scope(Phase phase);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    private:
+    Phase m_phase;
+    unsigned long m_startMicros;
+  };
+
+  static void add(Phase phase, unsigned long micros);
+
+  /**
+   * Stores the current wake, must be called right before sleeping.
+   */
+  static void commit();
+
+  /**
+   * Starts a new wake after a light sleep.
+   */
+  static void restart();
+
+  static void clear();
+
+  private:
+  static inline uint32_t s_phaseMicros[static_cast<size_t>(Phase::COUNT)]{};
+  static inline unsigned long s_startMillis{0};
+};
+
+static_assert(
+  static_cast<size_t>(Profiler::Phase::COUNT) == rtc::PROFILE_PHASES,
+  "Every phase needs a slot in rtc memory");
+
+} // namespace open_heat
+
+#endif // OPEN_HEAT_PROFILER_HPP
@@ -3,22 +3,223 @@
 // Licensed under the terms of the GNU General Public License v3.0
 //
 
+#include <Crc32.hpp>
 #include <RTCMemory.hpp>
+#include <ESP8266WiFi.h>
+#include <gpio.h>
+#include <interrupts.h>
 #include <user_interface.h>
 #include <yal/yal.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
 #include <string>
 
 namespace open_heat {
 namespace rtc {
 
-bool _lock = false;
+struct Header {
+  uint32_t magic;
+  uint32_t layoutVersion;
+  uint32_t size;
+  uint32_t crc;
+};
+
+static constexpr size_t HISTORY_META_SIZE = sizeof(uint64_t) + 2 * sizeof(uint16_t);
+
+// the last block holds the reset flag, it is not part of the image
+static constexpr size_t RESET_FLAG_BLOCK = USER_MEMORY_SIZE / BLOCK_SIZE - 1;
+
+// the history uses all rtc user memory which is not needed otherwise,
+// its size is rounded down to the alignment of newestMillis
+static constexpr size_t HISTORY_SIZE
+  = (RESET_FLAG_BLOCK * BLOCK_SIZE - sizeof(Header) - sizeof(Memory))
+  / alignof(uint64_t) * alignof(uint64_t);
+static constexpr size_t HISTORY_CAPACITY
+  = (HISTORY_SIZE - HISTORY_META_SIZE) / sizeof(HistorySample);
+
+struct History {
+  uint64_t newestMillis;
+  uint16_t head;
+  uint16_t count;
+  HistorySample samples[HISTORY_CAPACITY];
+};
+
+struct Image {
+  Header header;
+  Memory memory;
+  History history;
+};
+
+// Increment if a field changes its meaning or a struct member is added within
+// its padding, layoutVersion() does not notice that.
+static constexpr uint32_t LAYOUT_REVISION = 1;
+
+template<typename... Fields>
+constexpr uint32_t layoutVersion()
+{
+  // FNV-1a over offset and size of every field
+  uint32_t hash = 2166136261U;
+  const auto add = [&hash](size_t value) { hash = (hash ^ value) * 16777619U; };
+  (add(Fields::offset), ...);
+  (add(sizeof(typename Fields::Type)), ...);
+  add(sizeof(Memory));
+  add(sizeof(History));
+  add(LAYOUT_REVISION);
+  return hash;
+}
+
+static constexpr uint32_t MAGIC = 0x4F48524D; // "OHRM"
+
+// Changes whenever a field of Memory is added, removed, moved or resized.
+// New fields must be added here as well.
+static constexpr uint32_t LAYOUT_VERSION = layoutVersion<
+  RTC_FIELD(wakeTasks),
+  RTC_FIELD(wakeRadio),
+  RTC_FIELD(radioFailures),
+  RTC_FIELD(mqttSubscriptionsCrc),
+  RTC_FIELD(millisOffset),
+  RTC_FIELD(lastMeasuredTemp),
+  RTC_FIELD(lastPredictedTemp),
+  RTC_FIELD(setTemp),
+  RTC_FIELD(currentRotateTime),
+  RTC_FIELD(debug),
+  RTC_FIELD(mode),
+  RTC_FIELD(lastMode),
+  RTC_FIELD(isWindowOpen),
+  RTC_FIELD(restoreMode),
+  RTC_FIELD(modemSleepTime),
+  RTC_FIELD(checkIntervalMillis),
+  RTC_FIELD(minCheckIntervalMillis),
+  RTC_FIELD(maxCheckIntervalMillis),
+  RTC_FIELD(adaptiveCheckInterval),
+  RTC_FIELD(lastCheckMillis),
+  RTC_FIELD(lastCheckTemp),
+  RTC_FIELD(thermalModel),
+  RTC_FIELD(controlStats),
+  RTC_FIELD(schedule),
+  RTC_FIELD(sleepStats),
+  RTC_FIELD(wakeProfiles),
+  RTC_FIELD(configCache),
+  RTC_FIELD(wifiCache),
+  RTC_FIELD(wifiStats),
+  RTC_FIELD(radioState),
+  RTC_FIELD(publishedState),
+  RTC_FIELD(accessPointFailures)>();
+
+static constexpr size_t HEADER_BLOCKS = sizeof(Header) / BLOCK_SIZE;
+static constexpr size_t IMAGE_BLOCKS = (sizeof(Image) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+static_assert(sizeof(Header) % BLOCK_SIZE == 0, "Memory must start at a block");
+static_assert(offsetof(Image, memory) == sizeof(Header), "Memory must follow header");
+static_assert(IMAGE_BLOCKS <= RESET_FLAG_BLOCK, "RTC user memory exceeded");
+static_assert(
+  HISTORY_CAPACITY >= HISTORY_MIN_SAMPLES,
+  "Memory exceeds its budget, the history needs HISTORY_MIN_SAMPLES samples");
+
+// the sdk limits a forced light sleep to 0xFFFFFFF us
+static constexpr uint64_t MAX_FORCED_LIGHT_SLEEP_US = 0xFFFFFFF;
+// beacon intervals the sdk sleeps while keeping the association
+static constexpr uint8_t LIGHT_SLEEP_LISTEN_INTERVAL = 3;
+
+static constexpr size_t DIRTY_WORD_BITS = 32;
+static constexpr size_t DIRTY_WORDS
+  = (IMAGE_BLOCKS + DIRTY_WORD_BITS - 1) / DIRTY_WORD_BITS;
+
 yal::Logger m_logger;
 
+// RAM copy of the rtc user memory. It is loaded once per wake and written back
+// in wifiDeepSleep, so setters and read() never touch the rtc bus.
+union Shadow {
+  Shadow() :
+      image()
+  {
+  }
+
+  Image image;
+  uint32_t blocks[IMAGE_BLOCKS];
+};
+
+Shadow m_shadow;
+uint32_t m_dirtyBlocks[DIRTY_WORDS]{};
+bool m_loaded = false;
+bool m_valid = false;
+
+// Odd while the shadow is modified. Readers retry if it changed while they copied.
+volatile uint32_t m_sequence = 0;
+
+/**
+ * Writers mask interrupts for the few instructions it takes to update the
+ * shadow. They never wait, and an ISR can neither interrupt a writer nor see
+ * a half written value.
+ */
+class WriteGuard {
+  public:
+  ICACHE_RAM_ATTR WriteGuard()
+  {
+    m_sequence = m_sequence + 1;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+  }
+
+  ICACHE_RAM_ATTR ~WriteGuard()
+  {
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    m_sequence = m_sequence + 1;
+  }
+
+  WriteGuard(const WriteGuard&) = delete;
+  WriteGuard& operator=(const WriteGuard&) = delete;
+
+  private:
+  esp8266::InterruptLock m_lock;
+};
+
+/**
+ * Sequence lock read. Only the main loop can be interrupted by a writer,
+ * in which case the copy is simply taken again.
+ */
+template<typename Reader>
+auto readConsistent(Reader&& reader)
+{
+  while (true) {
+    const uint32_t sequence = m_sequence;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    auto value = reader();
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    if ((sequence & 1U) == 0 && sequence == m_sequence) {
+      return value;
+    }
+  }
+}
+
+ICACHE_RAM_ATTR void setDirty(const size_t block)
+{
+  m_dirtyBlocks[block / DIRTY_WORD_BITS] |= 1U << (block % DIRTY_WORD_BITS);
+}
+
+bool isDirty(const uint32_t (&dirtyBlocks)[DIRTY_WORDS], const size_t block)
+{
+  return (dirtyBlocks[block / DIRTY_WORD_BITS] & (1U << (block % DIRTY_WORD_BITS))) != 0;
+}
+
+uint32_t memoryCrc(const Shadow& shadow)
+{
+  return crc32(
+    &shadow.blocks[HEADER_BLOCKS], (IMAGE_BLOCKS - HEADER_BLOCKS) * BLOCK_SIZE);
+}
+
 void printRTCMemory(const Memory& rtcMemory)
 {
-  const auto msg = +"valveNextCheckMillis "
-    + std::to_string(rtcMemory.valveNextCheckMillis) + "\nmqttNextCheckMillis "
-    + std::to_string(rtcMemory.mqttNextCheckMillis) + "\nmillisOffset "
+  std::string msg;
+  for (const auto& task : rtcMemory.wakeTasks) {
+    msg += "wakeTask " + std::to_string(task.deadlineMillis) + " slack "
+      + std::to_string(task.slackMillis) + "\n";
+  }
+
+  msg += "millisOffset "
     + std::to_string(rtcMemory.millisOffset) + "\nlastMeasuredTemp "
     + std::to_string(rtcMemory.lastMeasuredTemp) + "\nlastPredictedTemp "
     + std::to_string(rtcMemory.lastPredictedTemp) + "\nsetTemp "
@@ -26,152 +227,439 @@ void printRTCMemory(const Memory& rtcMemory)
     + std::to_string(rtcMemory.currentRotateTime) + "\nturnOff " + "\nlastMode "
     + std::to_string(rtcMemory.lastMode) + "\nisWindowOpen "
     + std::to_string(rtcMemory.isWindowOpen) + "\nrestoreMode "
-    + std::to_string(rtcMemory.restoreMode) + "\ndrdDisabled "
-    + std::to_string(rtcMemory.drdDisabled);
+    + std::to_string(rtcMemory.restoreMode);
 
   m_logger.log(yal::Level::DEBUG, "Rtc memory data: %", msg.c_str());
 }
 
-void writeRTCMemory(const Memory& rtcMemory)
+void writeRTCMemory(Shadow& shadow, size_t firstBlock, size_t blockCount)
 {
-  // printRTCMemory(rtcMemory);
-  if (!ESP.rtcUserMemoryWrite(0, (uint32_t*)&rtcMemory, sizeof(Memory))) {
+  // printRTCMemory(shadow.image.memory);
+  if (!ESP.rtcUserMemoryWrite(
+        firstBlock, &shadow.blocks[firstBlock], blockCount * BLOCK_SIZE)) {
     m_logger.log(yal::Level::ERROR, "Failed to write RTC user memory");
   }
 }
 
-void lockMem()
+void setup()
 {
-  while (_lock) {
-    delay(10);
+  if (m_loaded) {
+    return;
+  }
+
+  if (!ESP.rtcUserMemoryRead(0, m_shadow.blocks, sizeof(m_shadow.blocks))) {
+    m_logger.log(yal::Level::ERROR, "Failed to read RTC user memory");
+  }
+
+  const auto& header = m_shadow.image.header;
+  if (header.magic != MAGIC) {
+    m_logger.log(yal::Level::WARNING, "RTC memory not initialized");
+  } else if (header.layoutVersion != LAYOUT_VERSION || header.size != sizeof(Memory)) {
+    m_logger.log(
+      yal::Level::WARNING,
+      "RTC memory layout changed from % to %",
+      header.layoutVersion,
+      LAYOUT_VERSION);
+  } else if (header.crc != memoryCrc(m_shadow)) {
+    m_logger.log(yal::Level::WARNING, "RTC memory checksum mismatch");
+  } else {
+    m_valid = true;
   }
-  _lock = true;
+
+  m_loaded = true;
+}
+
+bool isValid()
+{
+  setup();
+  return m_valid;
 }
 
-void unlockMem()
+Memory read()
 {
-  _lock = false;
+  setup();
+  return readConsistent([]() { return m_shadow.image.memory; });
 }
 
-Memory readWithoutLock()
+void init(Filesystem& filesystem)
 {
-  Memory rtcMemory{};
+  const auto& config = filesystem.getConfig();
 
-  if (!ESP.rtcUserMemoryRead(
-        0, reinterpret_cast<uint32_t*>(&rtcMemory), sizeof(Memory))) {
-    m_logger.log(yal::Level::ERROR, "Failed to read RTC user memory");
+  {
+    WriteGuard guard;
+    m_shadow.image.memory = {};
+    m_shadow.image.history = {};
+    m_shadow.image.memory.setTemp = config.SetTemperature;
+    m_shadow.image.memory.mode = config.Mode;
+    for (size_t block = 0; block < IMAGE_BLOCKS; ++block) {
+      setDirty(block);
+    }
+    m_loaded = true;
+    m_valid = true;
   }
 
-  return rtcMemory;
+  filesystem.cacheConfig();
 }
 
-Memory read()
+void commit()
 {
-  lockMem();
-  const auto mem = readWithoutLock();
-  unlockMem();
+  if (!m_loaded) {
+    return;
+  }
+
+  // Take a copy so interrupts are only masked for the copy
+  // and not while calculating the checksum and writing.
+  Shadow shadow;
+  uint32_t dirtyBlocks[DIRTY_WORDS];
+  {
+    WriteGuard guard;
+    std::memcpy(shadow.blocks, m_shadow.blocks, sizeof(shadow.blocks));
+    std::memcpy(dirtyBlocks, m_dirtyBlocks, sizeof(dirtyBlocks));
+    std::memset(m_dirtyBlocks, 0, sizeof(m_dirtyBlocks));
+  }
+
+  if (std::all_of(std::begin(dirtyBlocks), std::end(dirtyBlocks), [](uint32_t word) {
+        return word == 0;
+      })) {
+    return;
+  }
+
+  auto& header = shadow.image.header;
+  header.magic = MAGIC;
+  header.layoutVersion = LAYOUT_VERSION;
+  header.size = sizeof(Memory);
+  header.crc = memoryCrc(shadow);
+
+  // write every run of consecutive dirty blocks with a single call,
+  // the header has to be written every time as the checksum changed
+  size_t writtenBlocks = 0;
+  size_t block = 0;
+  while (block < IMAGE_BLOCKS) {
+    if (block >= HEADER_BLOCKS && !isDirty(dirtyBlocks, block)) {
+      ++block;
+      continue;
+    }
+
+    const auto firstBlock = block;
+    while (block < IMAGE_BLOCKS
+           && (block < HEADER_BLOCKS || isDirty(dirtyBlocks, block))) {
+      ++block;
+    }
 
-  return mem;
+    writeRTCMemory(shadow, firstBlock, block - firstBlock);
+    writtenBlocks += block - firstBlock;
+  }
+
+  m_logger.log(
+    yal::Level::DEBUG,
+    "Committed % of % RTC memory blocks",
+    writtenBlocks,
+    IMAGE_BLOCKS);
 }
 
-void init(Filesystem& filesystem)
+ICACHE_RAM_ATTR void markDirty(const void* data, size_t size)
 {
-  Memory rtcMem{};
-  const auto& config = filesystem.getConfig();
-  rtcMem.setTemp = config.SetTemperature;
-  rtcMem.mode = config.Mode;
+  const auto offset = static_cast<size_t>(
+    static_cast<const uint8_t*>(data) - reinterpret_cast<const uint8_t*>(&m_shadow));
+  for (auto block = offset / BLOCK_SIZE; block <= (offset + size - 1) / BLOCK_SIZE;
+       ++block) {
+    setDirty(block);
+  }
+}
+
+// Safe to call from an ISR once setup() ran.
+template<typename F>
+ICACHE_RAM_ATTR void update(const typename F::Type& val)
+{
+  if (!m_loaded) {
+    setup();
+  }
+
+  WriteGuard guard;
+  auto& field = m_shadow.image.memory.*F::member;
+  if (field != val) {
+    field = val;
+    for (size_t block = 0; block < F::blockCount; ++block) {
+      setDirty(HEADER_BLOCKS + F::firstBlock + block);
+    }
+  }
+}
 
-  writeRTCMemory(rtcMem);
+void detail::readConsistent(
+  void (*reader)(const Memory& memory, void* value),
+  void* value)
+{
+  setup();
+  rtc::readConsistent([reader, value]() {
+    reader(m_shadow.image.memory, value);
+    return true;
+  });
 }
 
-void updateMemory(std::function<void(Memory& mem)> setField)
+WakeTask wakeTask(const size_t index)
 {
-  lockMem();
-  auto mem = readWithoutLock();
-  setField(mem);
-  writeRTCMemory(mem);
-  unlockMem();
+  setup();
+  return readConsistent([index]() { return m_shadow.image.memory.wakeTasks[index]; });
 }
 
-void setLastResetTime(uint64_t val)
+uint8_t accessPointFailures(const size_t index)
 {
-  updateMemory([&val](Memory& mem) { mem.lastResetTime = val; });
+  setup();
+  return readConsistent(
+    [index]() { return m_shadow.image.memory.accessPointFailures[index]; });
 }
-void setValveNextCheckMillis(uint64_t val)
+
+ICACHE_RAM_ATTR void setWakeTask(const size_t index, const WakeTask& val)
 {
-  updateMemory([&val](Memory& mem) { mem.valveNextCheckMillis = val; });
+  if (!m_loaded) {
+    setup();
+  }
+
+  WriteGuard guard;
+  auto& task = m_shadow.image.memory.wakeTasks[index];
+  if (task.deadlineMillis != val.deadlineMillis || task.slackMillis != val.slackMillis) {
+    task = val;
+    markDirty(&task, sizeof(task));
+  }
 }
-void setMqttNextCheckMillis(uint64_t val)
+void setWakeRadio(bool val)
 {
-  updateMemory([&val](Memory& mem) { mem.mqttNextCheckMillis = val; });
+  update<RTC_FIELD(wakeRadio)>(val);
+}
+void setRadioFailures(uint8_t val)
+{
+  update<RTC_FIELD(radioFailures)>(val);
+}
+void setMqttSubscriptionsCrc(uint32_t val)
+{
+  update<RTC_FIELD(mqttSubscriptionsCrc)>(val);
 }
 void setMillisOffset(uint64_t val)
 {
-  updateMemory([&val](Memory& mem) { mem.millisOffset = val; });
+  update<RTC_FIELD(millisOffset)>(val);
 }
 void setLastMeasuredTemp(float val)
 {
-  updateMemory([&val](Memory& mem) { mem.lastMeasuredTemp = val; });
+  update<RTC_FIELD(lastMeasuredTemp)>(val);
 }
 void setLastPredictedTemp(float val)
 {
-  updateMemory([&val](Memory& mem) { mem.lastPredictedTemp = val; });
+  update<RTC_FIELD(lastPredictedTemp)>(val);
 }
 void setSetTemp(float val)
 {
-  updateMemory([&val](Memory& mem) { mem.setTemp = val; });
+  update<RTC_FIELD(setTemp)>(val);
 }
 void setCurrentRotateTime(int val, const int absoluteLimit)
 {
-  updateMemory([&val, absoluteLimit](Memory& mem) {
-    if (val < -absoluteLimit) {
-      val = -absoluteLimit;
-    } else if (val > absoluteLimit) {
-      val = absoluteLimit;
-    }
+  if (val < -absoluteLimit) {
+    val = -absoluteLimit;
+  } else if (val > absoluteLimit) {
+    val = absoluteLimit;
+  }
 
-    mem.currentRotateTime = val;
-  });
+  update<RTC_FIELD(currentRotateTime)>(val);
 }
 void setMode(OperationMode val)
 {
-  updateMemory([&val](Memory& mem) { mem.mode = val; });
+  update<RTC_FIELD(mode)>(val);
 }
 void setLastMode(OperationMode val)
 {
-  updateMemory([&val](Memory& mem) { mem.lastMode = val; });
+  update<RTC_FIELD(lastMode)>(val);
 }
-void setIsWindowOpen(bool val)
+ICACHE_RAM_ATTR void setIsWindowOpen(bool val)
 {
-  updateMemory([&val](Memory& mem) { mem.isWindowOpen = val; });
+  update<RTC_FIELD(isWindowOpen)>(val);
 }
 void setRestoreMode(bool val)
 {
-  updateMemory([&val](Memory& mem) { mem.restoreMode = val; });
+  update<RTC_FIELD(restoreMode)>(val);
 }
-void setDrdDisabled(bool val)
+void setDebug(bool val)
 {
-  updateMemory([&val](Memory& mem) { mem.drdDisabled = val; });
+  update<RTC_FIELD(debug)>(val);
 }
-void setDebug(bool val)
+void setModemSleepTime(uint32_t val)
+{
+  update<RTC_FIELD(modemSleepTime)>(val);
+}
+void setCheckIntervalMillis(uint32_t val)
+{
+  update<RTC_FIELD(checkIntervalMillis)>(val);
+}
+void setMinCheckIntervalMillis(uint32_t val)
+{
+  update<RTC_FIELD(minCheckIntervalMillis)>(val);
+}
+void setMaxCheckIntervalMillis(uint32_t val)
 {
-  updateMemory([&val](Memory& mem) { mem.debug = val; });
+  update<RTC_FIELD(maxCheckIntervalMillis)>(val);
 }
-void setModemSleepTime(unsigned long val)
+void setAdaptiveCheckInterval(bool val)
 {
-  updateMemory([&val](Memory& mem) { mem.modemSleepTime = val; });
+  update<RTC_FIELD(adaptiveCheckInterval)>(val);
+}
+void setLastCheck(uint64_t millis, float temp)
+{
+  update<RTC_FIELD(lastCheckMillis)>(millis);
+  update<RTC_FIELD(lastCheckTemp)>(temp);
+}
+void setThermalModel(const ThermalModelState& val)
+{
+  update<RTC_FIELD(thermalModel)>(val);
+}
+void setControlStats(const ControlStats& val)
+{
+  update<RTC_FIELD(controlStats)>(val);
+}
+void setSchedule(const ScheduleState& val)
+{
+  update<RTC_FIELD(schedule)>(val);
+}
+void setSleepStats(const SleepStats& val)
+{
+  update<RTC_FIELD(sleepStats)>(val);
+}
+void setWakeProfiles(const WakeProfiles& val)
+{
+  update<RTC_FIELD(wakeProfiles)>(val);
+}
+void setConfigCache(const ConfigCache& val)
+{
+  update<RTC_FIELD(configCache)>(val);
+}
+void setWifiCache(const WifiCache& val)
+{
+  update<RTC_FIELD(wifiCache)>(val);
+}
+void setWifiStats(const WifiStats& val)
+{
+  update<RTC_FIELD(wifiStats)>(val);
+}
+void setRadioState(const RadioState& val)
+{
+  update<RTC_FIELD(radioState)>(val);
+}
+void setPublishedState(const PublishedState& val)
+{
+  update<RTC_FIELD(publishedState)>(val);
+}
+void setAccessPointFailures(const size_t index, const uint8_t val)
+{
+  if (!m_loaded) {
+    setup();
+  }
+
+  WriteGuard guard;
+  auto& failures = m_shadow.image.memory.accessPointFailures[index];
+  if (failures != val) {
+    failures = val;
+    markDirty(&failures, sizeof(failures));
+  }
+}
+
+void addHistorySample(const float temperature, const uint8_t valvePosition)
+{
+  static constexpr uint64_t resolutionMillis = HISTORY_TIME_RESOLUTION_SECONDS * 1000;
+  static constexpr uint64_t maxTimeDelta = std::numeric_limits<uint8_t>::max();
+
+  const auto now = offsetMillis();
+  WriteGuard guard;
+  auto& history = m_shadow.image.history;
+
+  // Deltas are rounded to the resolution and the newest time follows the rounded
+  // deltas, so the age of older samples does not drift.
+  uint64_t timeDelta = 0;
+  if (history.count > 0 && now > history.newestMillis) {
+    timeDelta = (now - history.newestMillis + resolutionMillis / 2) / resolutionMillis;
+  }
+
+  if (history.count == 0 || timeDelta > maxTimeDelta) {
+    timeDelta = std::min(timeDelta, maxTimeDelta);
+    history.newestMillis = now;
+  } else {
+    history.newestMillis += timeDelta * resolutionMillis;
+  }
+
+  const auto centiDegrees = std::lround(temperature * 100);
+  auto& sample = history.samples[history.head];
+  sample.timeDelta = static_cast<uint8_t>(timeDelta);
+  sample.valvePosition = valvePosition;
+  sample.temperature = static_cast<int16_t>(std::max<long>(
+    std::numeric_limits<int16_t>::min(),
+    std::min<long>(std::numeric_limits<int16_t>::max(), centiDegrees)));
+
+  history.head = static_cast<uint16_t>((history.head + 1) % HISTORY_CAPACITY);
+  if (history.count < HISTORY_CAPACITY) {
+    ++history.count;
+  }
+
+  markDirty(&sample, sizeof(sample));
+  markDirty(&history, offsetof(History, samples));
+}
+
+size_t historySize()
+{
+  setup();
+  return readConsistent([]() { return m_shadow.image.history.count; });
+}
+
+HistorySample historySample(const size_t index)
+{
+  setup();
+  return readConsistent([index]() {
+    const auto& history = m_shadow.image.history;
+    const auto position
+      = (history.head + HISTORY_CAPACITY - 1 - index) % HISTORY_CAPACITY;
+    return history.samples[position];
+  });
+}
+
+uint64_t historyNewestMillis()
+{
+  setup();
+  return readConsistent([]() { return m_shadow.image.history.newestMillis; });
+}
+
+void clearHistory()
+{
+  setup();
+  WriteGuard guard;
+  auto& history = m_shadow.image.history;
+  if (history.count > 0) {
+    history.count = 0;
+    history.head = 0;
+    markDirty(&history, offsetof(History, samples));
+  }
+}
+
+uint32_t readResetFlag()
+{
+  uint32_t flag = 0;
+  if (!ESP.rtcUserMemoryRead(RESET_FLAG_BLOCK, &flag, sizeof(flag))) {
+    m_logger.log(yal::Level::ERROR, "Failed to read the reset flag");
+  }
+  return flag;
+}
+
+void writeResetFlag(const uint32_t val)
+{
+  auto flag = val;
+  if (!ESP.rtcUserMemoryWrite(RESET_FLAG_BLOCK, &flag, sizeof(flag))) {
+    m_logger.log(yal::Level::ERROR, "Failed to write the reset flag");
+  }
 }
 
 uint64_t offsetMillis()
 {
-  const auto mem = readWithoutLock();
-  const auto ms = millis() + mem.millisOffset;
+  const auto ms = millis() + get<&Memory::millisOffset>();
   return ms;
 }
 
-void wifiDeepSleep(uint64_t timeInMs, bool enableRF, Filesystem& filesystem)
+void wifiDeepSleep(uint64_t timeInMs, RFMode mode, Filesystem& filesystem)
 {
-  const auto& config = filesystem.getConfig();
+  const auto& config = filesystem.getHardwareConfig();
   digitalWrite(static_cast<uint8_t>(config.TempVin), LOW);
   digitalWrite(static_cast<uint8_t>(config.MotorPins.Vin), LOW);
   digitalWrite(static_cast<uint8_t>(config.MotorPins.Ground), LOW);
@@ -183,10 +671,67 @@ void wifiDeepSleep(uint64_t timeInMs, bool enableRF, Filesystem& filesystem)
 
   m_logger.log(yal::Level::INFO, "Sleeping for % ms", timeInMs);
   setMillisOffset(offsetMillis() + timeInMs);
+  setWakeRadio(mode != RF_DISABLED);
+  commit();
 
-  EspClass::deepSleep(timeInMs * 1000, enableRF ? RF_CAL : RF_DISABLED);
+  EspClass::deepSleep(timeInMs * 1000, mode);
   delay(1);
 }
 
+uint64_t lightSleep(uint64_t timeInMs, bool keepWifi, Filesystem& filesystem)
+{
+  m_logger.log(
+    yal::Level::INFO, "Light sleeping for % ms, keep wifi: %", timeInMs, keepWifi);
+
+  // the system timer behind millis() stops in forced light sleep, the rtc does not
+  const auto rtcStart = system_get_rtc_time();
+  const auto millisStart = millis();
+
+  if (keepWifi) {
+    // the sdk sleeps between the beacons of the access point while the cpu idles
+    WiFi.setSleepMode(WIFI_LIGHT_SLEEP, LIGHT_SLEEP_LISTEN_INTERVAL);
+    delay(timeInMs);
+    WiFi.setSleepMode(WIFI_NONE_SLEEP);
+  } else {
+    const auto timeInUs = static_cast<uint32_t>(
+      std::min<uint64_t>(timeInMs * 1000, MAX_FORCED_LIGHT_SLEEP_US));
+
+    // stays off until the next deep sleep with the radio enabled
+    WiFi.mode(WIFI_OFF);
+    setWakeRadio(false);
+    wifi_fpm_set_sleep_type(LIGHT_SLEEP_T);
+    wifi_fpm_open();
+
+    // wake up if the window is opened or closed meanwhile
+    const auto& config = filesystem.getHardwareConfig();
+    const auto windowPin = config.WindowPins.Vin;
+    if (windowPin > 0) {
+      const auto isHigh = digitalRead(static_cast<uint8_t>(windowPin)) == HIGH;
+      gpio_pin_wakeup_enable(
+        GPIO_ID_PIN(windowPin), isHigh ? GPIO_PIN_INTR_LOLEVEL : GPIO_PIN_INTR_HILEVEL);
+    }
+
+    wifi_fpm_set_wakeup_cb([]() {});
+    wifi_fpm_do_sleep(timeInUs);
+    // the sleep starts once the cpu idles
+    delay(timeInUs / 1000 + 1);
+
+    if (windowPin > 0) {
+      gpio_pin_wakeup_disable();
+    }
+    wifi_fpm_close();
+  }
+
+  // rtc ticks are calibrated in 1/4096 us
+  const auto rtcTicks = static_cast<uint64_t>(system_get_rtc_time() - rtcStart);
+  const auto sleptMillis = rtcTicks * system_rtc_clock_cali_proc() / 4096 / 1000;
+  const auto countedMillis = static_cast<uint64_t>(millis() - millisStart);
+  if (sleptMillis > countedMillis) {
+    setMillisOffset(get<&Memory::millisOffset>() + sleptMillis - countedMillis);
+  }
+
+  return std::max(sleptMillis, countedMillis);
+}
+
 } // namespace rtc
 } // namespace open_heat
@@ -6,38 +6,314 @@
 #include "Config.hpp"
 #include "Filesystem.hpp"
 
+#include <Esp.h>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
 
 #ifndef OPEN_HEAT_RTCMEMORY_H
 #define OPEN_HEAT_RTCMEMORY_H
 namespace open_heat {
 namespace rtc {
 
+struct ThermalModelState {
+  // heating gain, heat loss rate and loss offset, see heating::ThermalModel
+  float coefficients[3];
+  // upper triangle of the covariance matrix of the estimator
+  float covariance[6];
+  // valve opening delayed by the valve lag
+  float effectiveOpening;
+  uint64_t lastUpdateMillis;
+  uint16_t updates;
+  bool initialized;
+  // measured temperature of the last update
+  float lastUpdateTemp;
+};
+
+inline bool operator!=(const ThermalModelState& lhs, const ThermalModelState& rhs)
+{
+  return std::memcmp(&lhs, &rhs, sizeof(ThermalModelState)) != 0;
+}
+
+struct ControlStats {
+  // wakes and motor run time since the rtc memory was initialized
+  uint32_t wakes;
+  uint32_t motorOnMillis;
+  // offsetMillis() of the last set temperature change
+  uint64_t setTempChangedMillis;
+  // time until the set temperature was reached the first time, 0 until then
+  uint32_t settlingSeconds;
+  // largest measured temperature above the set temperature since the change
+  float overshoot;
+};
+
+inline bool operator!=(const ControlStats& lhs, const ControlStats& rhs)
+{
+  return std::memcmp(&lhs, &rhs, sizeof(ControlStats)) != 0;
+}
+
+struct ScheduleState {
+  // added to offsetMillis() gives the local time since monday 00:00 modulo a week
+  uint32_t weekOffsetMillis;
+  uint8_t nextIndex;
+  bool clockSynced;
+};
+
+inline bool operator!=(const ScheduleState& lhs, const ScheduleState& rhs)
+{
+  return std::memcmp(&lhs, &rhs, sizeof(ScheduleState)) != 0;
+}
+
+struct WakeTask {
+  // offsetMillis() the task has to run at the latest, max if it is not scheduled
+  uint64_t deadlineMillis;
+  // the task may run this much earlier to share a wake with another task
+  uint32_t slackMillis;
+};
+
+struct SleepStats {
+  uint32_t deepSleeps;
+  uint32_t lightSleeps;
+  // average time from waking up until the tasks can run,
+  // after a deep sleep without and with radio and after a light sleep
+  uint16_t deepReadyMillis[2];
+  uint16_t lightReadyMillis;
+};
+
+inline bool operator!=(const SleepStats& lhs, const SleepStats& rhs)
+{
+  return std::memcmp(&lhs, &rhs, sizeof(SleepStats)) != 0;
+}
+
+// see Profiler::Phase
+static constexpr size_t PROFILE_PHASES = 6;
+static constexpr size_t PROFILE_WAKES = 4;
+
+struct WakeProfile {
+  // time spent in each phase and awake in total
+  uint16_t phaseMillis[PROFILE_PHASES];
+  uint16_t awakeMillis;
+};
+
+struct WakeProfiles {
+  WakeProfile wakes[PROFILE_WAKES];
+  uint8_t head;
+  uint8_t count;
+};
+
+inline bool operator!=(const WakeProfiles& lhs, const WakeProfiles& rhs)
+{
+  return std::memcmp(&lhs, &rhs, sizeof(WakeProfiles)) != 0;
+}
+
+// HardwareConfig of the stored config, see Filesystem::warmSetup
+struct ConfigCache {
+  int8_t motorGround;
+  int8_t motorVin;
+  int8_t windowGround;
+  int8_t windowVin;
+  int8_t tempVin;
+  uint8_t tempSensor;
+  bool configValid;
+  uint8_t reserved;
+  // crc32 of the fields above, zero initialized memory is not a valid cache
+  uint32_t crc;
+};
+
+inline bool operator!=(const ConfigCache& lhs, const ConfigCache& rhs)
+{
+  return std::memcmp(&lhs, &rhs, sizeof(ConfigCache)) != 0;
+}
+
+struct WifiCache {
+  // dhcp lease of the last association, 0 if there is none
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  // offsetMillis() in seconds when the lease was obtained
+  uint32_t leaseSeconds;
+  uint8_t bssid[6];
+  // channel of the access point, 0 if there is no cached association
+  uint8_t channel;
+  // index in network::AccessPoints
+  uint8_t accessPoint;
+};
+
+inline bool operator!=(const WifiCache& lhs, const WifiCache& rhs)
+{
+  return std::memcmp(&lhs, &rhs, sizeof(WifiCache)) != 0;
+}
+
+struct WifiStats {
+  // connects with the cached association and connects after a scan
+  uint16_t fastConnects;
+  uint16_t scanConnects;
+  // total time until connected of these connects
+  uint32_t fastConnectMillis;
+  uint32_t scanConnectMillis;
+};
+
+inline bool operator!=(const WifiStats& lhs, const WifiStats& rhs)
+{
+  return std::memcmp(&lhs, &rhs, sizeof(WifiStats)) != 0;
+}
+
+// see network::RadioPolicy
+struct RadioState {
+  // moving average of the rssi after connecting in dBm, 0 if unknown
+  int8_t averageRssi;
+  // transmit power below the maximum in 1/4 dB
+  uint8_t txPowerReduction;
+  // temperature in degree celsius at the last rf calibration
+  int8_t calibrationTemp;
+  // false until the first calibration and after a failed link
+  bool calibrated;
+  // supply voltage at the last calibration and the last measured one, 0 if unknown
+  uint16_t calibrationMillivolts;
+  uint16_t millivolts;
+  // offsetMillis() in seconds of the last calibration
+  uint32_t calibrationSeconds;
+};
+
+inline bool operator!=(const RadioState& lhs, const RadioState& rhs)
+{
+  return std::memcmp(&lhs, &rhs, sizeof(RadioState)) != 0;
+}
+
+// values of the last publish in the units of the state message,
+// see network::TelemetryFilter
+struct PublishedState {
+  int16_t temp;
+  uint16_t humidity;
+  int16_t target;
+  uint16_t millivolts;
+  uint8_t mode;
+  uint8_t valve;
+  uint8_t battery;
+  // false until the first publish
+  bool valid;
+  uint32_t modemSleepMillis;
+  uint32_t checkIntervalMillis;
+  // offsetMillis() in seconds when all values were published
+  uint32_t heartbeatSeconds;
+};
+
+inline bool operator!=(const PublishedState& lhs, const PublishedState& rhs)
+{
+  return std::memcmp(&lhs, &rhs, sizeof(PublishedState)) != 0;
+}
+
+// see WakeScheduler::Task
+static constexpr size_t WAKE_TASK_COUNT = 3;
+
 struct Memory {
-  uint64_t valveNextCheckMillis = 0;
-  uint64_t mqttNextCheckMillis = 0;
+  WakeTask wakeTasks[WAKE_TASK_COUNT]
+    = {{0, 0}, {0, 0}, {std::numeric_limits<uint64_t>::max(), 0}};
   uint64_t millisOffset = 0;
-  uint64_t lastResetTime = 0;
 
   float lastMeasuredTemp = 0;
   float lastPredictedTemp = 0;
   float setTemp = 0;
   int currentRotateTime = 0;
-  bool debug = false;
 
   OperationMode mode = UNKNOWN;
   OperationMode lastMode = mode;
 
+  // single bytes are kept together, padding takes space from the history
+  bool debug = false;
   bool isWindowOpen = false;
   bool restoreMode = false;
+  // if the radio was enabled for the current wake
+  bool wakeRadio = true;
+  // consecutive wakes the access point or the broker was unreachable
+  uint8_t radioFailures = 0;
+  bool adaptiveCheckInterval = true;
+  // see network::MqttSession, 0 if the subscriptions are unknown
+  uint32_t mqttSubscriptionsCrc = 0;
+  uint32_t modemSleepTime = 15 * 60 * 1000;
+
+  // valve check interval, adapted to the temperature slope within the bounds
+  uint32_t checkIntervalMillis = 5 * 60 * 1000;
+  uint32_t minCheckIntervalMillis = 5 * 60 * 1000;
+  uint32_t maxCheckIntervalMillis = 30 * 60 * 1000;
+  // time and temperature of the last valve check, used for the slope
+  float lastCheckTemp = 0;
+  uint64_t lastCheckMillis = 0;
+
+  ThermalModelState thermalModel{};
+  ControlStats controlStats{};
+  ScheduleState schedule{};
+  SleepStats sleepStats{};
+  WakeProfiles wakeProfiles{};
+  ConfigCache configCache{};
+  WifiCache wifiCache{};
+  WifiStats wifiStats{};
+  RadioState radioState{};
+  PublishedState publishedState{};
+  // failed connects per access point not yet added to network::AccessPoints,
+  // so a failing wake does not write the list
+  uint8_t accessPointFailures[ACCESS_POINTS_MAX]{};
+};
+
+static_assert(
+  std::is_standard_layout<Memory>::value,
+  "offsetof is required to calculate the rtc blocks of a field");
+
+// rtc user memory is addressed in blocks of 4 bytes
+static constexpr size_t USER_MEMORY_SIZE = 512;
+static constexpr size_t BLOCK_SIZE = sizeof(uint32_t);
+static constexpr size_t MEMORY_BLOCKS = (sizeof(Memory) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+/**
+ * Compile time description of a field in Memory.
+ * Contains the rtc blocks the field covers, so updating a field only
+ * writes back these blocks instead of the whole struct.
+ */
+template<typename T, size_t Offset, T Memory::*Member>
+struct Field {
+  using Type = T;
+  static constexpr T Memory::*member = Member;
+  static constexpr size_t offset = Offset;
+  static constexpr size_t firstBlock = Offset / BLOCK_SIZE;
+  static constexpr size_t blockCount
+    = (Offset + sizeof(T) - 1) / BLOCK_SIZE - firstBlock + 1;
+
+  static_assert(firstBlock + blockCount <= MEMORY_BLOCKS, "Field outside of Memory");
+};
+
+#define RTC_FIELD(name)                                                                  \
+  ::open_heat::rtc::Field<                                                               \
+    decltype(::open_heat::rtc::Memory::name),                                            \
+    offsetof(::open_heat::rtc::Memory, name),                                            \
+    &::open_heat::rtc::Memory::name>
+
+static constexpr uint8_t HISTORY_TIME_RESOLUTION_SECONDS = 10;
+
+// The history has to hold all valve checks between two radio wakes, checks every
+// 5 minutes during the longest radio backoff of 2 hours, see network::RadioBackoff.
+// Memory may only grow as long as this many samples remain.
+static constexpr size_t HISTORY_MIN_SAMPLES = 24;
 
-  bool drdDisabled = false;
-  unsigned long modemSleepTime = 15 * 60 * 1000;
-  ;
+struct HistorySample {
+  // time since the previous sample in HISTORY_TIME_RESOLUTION_SECONDS,
+  // saturates at 255
+  uint8_t timeDelta;
+  // valve opening in percent
+  uint8_t valvePosition;
+  // measured temperature in 1/100 degree celsius
+  int16_t temperature;
 };
 
-void setValveNextCheckMillis(uint64_t val);
-void setMqttNextCheckMillis(uint64_t val);
+// Setters never block. setWakeTask and setIsWindowOpen are placed
+// in IRAM and may be called from an ISR.
+void setWakeTask(size_t index, const WakeTask& val);
+void setWakeRadio(bool val);
+void setRadioFailures(uint8_t val);
+void setMqttSubscriptionsCrc(uint32_t val);
 void setMillisOffset(uint64_t val);
 void setLastMeasuredTemp(float val);
 void setLastPredictedTemp(float val);
@@ -47,15 +323,110 @@ void setMode(OperationMode val);
 void setLastMode(OperationMode val);
 void setIsWindowOpen(bool val);
 void setRestoreMode(bool val);
-void setDrdDisabled(bool val);
 void setDebug(bool val);
-void setLastResetTime(uint64_t val);
-void setModemSleepTime(unsigned long val);
+void setModemSleepTime(uint32_t val);
+void setCheckIntervalMillis(uint32_t val);
+void setMinCheckIntervalMillis(uint32_t val);
+void setMaxCheckIntervalMillis(uint32_t val);
+void setAdaptiveCheckInterval(bool val);
+void setLastCheck(uint64_t millis, float temp);
+void setThermalModel(const ThermalModelState& val);
+void setControlStats(const ControlStats& val);
+void setSchedule(const ScheduleState& val);
+void setSleepStats(const SleepStats& val);
+void setWakeProfiles(const WakeProfiles& val);
+void setConfigCache(const ConfigCache& val);
+void setWifiCache(const WifiCache& val);
+void setWifiStats(const WifiStats& val);
+void setRadioState(const RadioState& val);
+void setPublishedState(const PublishedState& val);
+void setAccessPointFailures(size_t index, uint8_t val);
+/**
+ * Consistent copy of the memory, even if an ISR updates it meanwhile.
+ * Copies the whole struct, use get() or wakeTask() for single fields.
+ */
 Memory read();
+
+namespace detail {
+// Calls reader with the memory until no ISR modified it meanwhile
+void readConsistent(void (*reader)(const Memory& memory, void* value), void* value);
+} // namespace detail
+
+/**
+ * Consistent copy of a single field, e.g. get<&Memory::debug>().
+ */
+template<auto Member>
+auto get()
+{
+  using Type = std::remove_reference_t<decltype(std::declval<const Memory&>().*Member)>;
+  static_assert(!std::is_array<Type>::value, "Arrays have their own getter");
+
+  std::remove_const_t<Type> value;
+  detail::readConsistent(
+    [](const Memory& memory, void* value) {
+      *static_cast<std::remove_const_t<Type>*>(value) = memory.*Member;
+    },
+    &value);
+  return value;
+}
+
+WakeTask wakeTask(size_t index);
+uint8_t accessPointFailures(size_t index);
 void init(Filesystem& filesystem);
 
+/**
+ * Loads the rtc user memory into RAM. Must be called once per wake before
+ * any other function, read() calls it lazily if necessary.
+ */
+void setup();
+
+/**
+ * True if the rtc memory was written by this firmware and passed the
+ * checksum, or was initialized during this wake.
+ * If false, the content of read() must not be trusted and init() is required.
+ */
+bool isValid();
+
+/**
+ * Writes all modified words back into rtc user memory.
+ * Called automatically before going into deep sleep.
+ */
+void commit();
+
+/**
+ * Appends a sample to the temperature history ring buffer, which uses the
+ * remaining rtc user memory. The oldest sample is dropped if the buffer is full.
+ */
+void addHistorySample(float temperature, uint8_t valvePosition);
+size_t historySize();
+// index 0 is the newest sample
+HistorySample historySample(size_t index);
+// offsetMillis() of the newest sample
+uint64_t historyNewestMillis();
+void clearHistory();
+
+/**
+ * Word of rtc user memory behind the checksummed memory, used by the
+ * hardware::DoubleResetDetector. It is not reset by init() and written to the
+ * rtc memory immediately, so it survives a reset during this wake.
+ */
+uint32_t readResetFlag();
+void writeResetFlag(uint32_t val);
+
 uint64_t offsetMillis();
-void wifiDeepSleep(uint64_t timeInMs, bool enableRF, Filesystem& filesystem);
+
+// Deep sleep, mode is RF_DISABLED if the radio stays off after waking up
+void wifiDeepSleep(uint64_t timeInMs, RFMode mode, Filesystem& filesystem);
+
+/**
+ * Sleeps without a reboot, RAM and the state of all peripherals are kept.
+ * If keepWifi is set the sdk keeps the access point association and wakes up
+ * for its beacons, otherwise the radio is switched off for the rest of the wake,
+ * like after a deep sleep with RF_DISABLED, and a timer or a change of the window
+ * sensor wakes up the device.
+ * Returns the time actually slept, offsetMillis() continues across the sleep.
+ */
+uint64_t lightSleep(uint64_t timeInMs, bool keepWifi, Filesystem& filesystem);
 
 } // namespace rtc
 } // namespace open_heat
@@ -0,0 +1,149 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "WakeScheduler.hpp"
+#include <Profiler.hpp>
+#include <network/RadioPolicy.hpp>
+#include <algorithm>
+#include <limits>
+
+namespace open_heat {
+
+ICACHE_RAM_ATTR void WakeScheduler::schedule(
+  const Task task,
+  const uint64_t deadlineMillis,
+  const uint32_t slackMillis)
+{
+  rtc::setWakeTask(static_cast<size_t>(task), {deadlineMillis, slackMillis});
+}
+
+void WakeScheduler::cancel(const Task task)
+{
+  schedule(task, std::numeric_limits<uint64_t>::max());
+}
+
+uint64_t WakeScheduler::deadline(const Task task)
+{
+  return rtc::wakeTask(static_cast<size_t>(task)).deadlineMillis;
+}
+
+bool WakeScheduler::isDue(const Task task)
+{
+  const auto rtcData = rtc::read();
+  if (needsRadio(task) && !rtcData.wakeRadio) {
+    return false;
+  }
+
+  const auto& wakeTask = rtcData.wakeTasks[static_cast<size_t>(task)];
+  const auto earliest = wakeTask.deadlineMillis
+    - std::min<uint64_t>(wakeTask.slackMillis, wakeTask.deadlineMillis);
+  return rtc::offsetMillis() >= earliest;
+}
+
+WakeScheduler::Wake WakeScheduler::nextWake(const bool wifiConnected)
+{
+  const auto rtcData = rtc::read();
+  const auto now = rtc::offsetMillis();
+
+  auto wakeMillis = std::numeric_limits<uint64_t>::max();
+  for (const auto& task : rtcData.wakeTasks) {
+    wakeMillis = std::min(wakeMillis, task.deadlineMillis);
+  }
+
+  if (wakeMillis < now + MIN_SLEEP_MILLIS) {
+    m_logger.log(
+      yal::Level::DEBUG,
+      "Minimal sleep or underflow prevented, sleep set to % ms",
+      MIN_SLEEP_MILLIS);
+    wakeMillis = now + MIN_SLEEP_MILLIS;
+  }
+
+  // every task which may run at the planned wake joins it
+  Wake wake{wakeMillis, false, false, false};
+  size_t tasks = 0;
+  for (size_t i = 0; i < rtc::WAKE_TASK_COUNT; ++i) {
+    const auto& task = rtcData.wakeTasks[i];
+    if (task.deadlineMillis - std::min<uint64_t>(task.slackMillis, task.deadlineMillis)
+        <= wakeMillis) {
+      ++tasks;
+      wake.enableRadio |= needsRadio(static_cast<Task>(i));
+    }
+  }
+
+  // wakeRadio is cleared by a deep sleep with the radio disabled and by a light
+  // sleep without wifi, only a reboot switches the radio on again. If it is on,
+  // a light sleep may keep the association for the next radio wake.
+  const auto bootMillis = rtcData.sleepStats.deepReadyMillis[wake.enableRadio];
+  if (!wake.enableRadio || rtcData.wakeRadio) {
+    wake.keepWifi = wake.enableRadio && wifiConnected;
+    wake.lightSleep = isLightSleepCheaper(
+      wakeMillis - now,
+      bootMillis > 0 ? bootMillis : DEFAULT_BOOT_MILLIS[wake.enableRadio],
+      wake.enableRadio,
+      wake.keepWifi);
+  }
+
+  m_logger.log(
+    yal::Level::DEBUG,
+    "Next wake in % ms for % tasks, radio: %, light sleep: %",
+    wakeMillis - now,
+    tasks,
+    wake.enableRadio,
+    wake.lightSleep);
+
+  return wake;
+}
+
+void WakeScheduler::sleep(const Wake& wake, Filesystem& filesystem)
+{
+  const auto now = rtc::offsetMillis();
+  const auto sleepMillis = wake.millis > now ? wake.millis - now : 0;
+  auto stats = rtc::get<&rtc::Memory::sleepStats>();
+  Profiler::commit();
+
+  if (!wake.lightSleep) {
+    ++stats.deepSleeps;
+    rtc::setSleepStats(stats);
+    rtc::wifiDeepSleep(
+      sleepMillis, network::RadioPolicy::sleepMode(wake.enableRadio), filesystem);
+    return;
+  }
+
+  rtc::lightSleep(sleepMillis, wake.keepWifi, filesystem);
+  Profiler::restart();
+
+  // nothing has to be set up again, only the time until the wake is noticed counts
+  const auto end = rtc::offsetMillis();
+  const auto readyMillis = end - std::min(end, wake.millis);
+  ++stats.lightSleeps;
+  stats.lightReadyMillis = average(stats.lightReadyMillis, readyMillis);
+  rtc::setSleepStats(stats);
+}
+
+void WakeScheduler::ready(const bool deepSleepWake)
+{
+  if (!deepSleepWake) {
+    return;
+  }
+
+  auto stats = rtc::get<&rtc::Memory::sleepStats>();
+  const auto radio = rtc::get<&rtc::Memory::wakeRadio>();
+  stats.deepReadyMillis[radio] = average(stats.deepReadyMillis[radio], millis());
+  rtc::setSleepStats(stats);
+}
+
+uint16_t WakeScheduler::average(const uint16_t average, const uint64_t sample)
+{
+  const auto clamped
+    = std::min<uint64_t>(sample, std::numeric_limits<uint16_t>::max());
+  if (average == 0) {
+    return static_cast<uint16_t>(std::max<uint64_t>(1, clamped));
+  }
+
+  // exponential moving average, new samples weigh a quarter
+  return static_cast<uint16_t>((average * 3 + clamped) / 4);
+}
+
+} // namespace open_heat
@@ -0,0 +1,137 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_WAKESCHEDULER_HPP
+#define OPEN_HEAT_WAKESCHEDULER_HPP
+
+#include <Filesystem.hpp>
+#include <RTCMemory.hpp>
+#include <yal/yal.hpp>
+
+namespace open_heat {
+
+/**
+ * Plans the deep sleep for all periodic tasks.
+ *
+ * Every task registers the time it has to run at the latest and a slack it may
+ * run earlier. The next wake is the earliest deadline, every task whose slack
+ * reaches back to that wake runs in it as well, so close deadlines share one
+ * boot instead of two. The radio is only enabled if a task of the wake needs it.
+ * Tasks and the radio decision live in rtc memory.
+ *
+ * Short gaps are spent in light sleep, which keeps RAM, the wifi association and
+ * the mqtt session. Deep sleep draws less current but every wake pays a full boot,
+ * so the cheaper mode is picked per gap from the measured boot time.
+ */
+class WakeScheduler {
+  public:
+  enum class Task : uint8_t { VALVE, MQTT, SCHEDULE, COUNT };
+
+  struct Wake {
+    uint64_t millis;
+    bool enableRadio;
+    bool lightSleep;
+    // light sleep keeps the access point association
+    bool keepWifi;
+  };
+
+  // Safe to call from an ISR.
+  static void schedule(Task task, uint64_t deadlineMillis, uint32_t slackMillis = 0);
+  static void cancel(Task task);
+  [[nodiscard]] static uint64_t deadline(Task task);
+
+  /**
+   * True if the task has to run now or may run now as part of this wake.
+   * Tasks which need the radio are never due in a wake without radio.
+   */
+  [[nodiscard]] static bool isDue(Task task);
+
+  /**
+   * Plans the next wake, rtc::wifiDeepSleep remembers if it enabled the radio.
+   */
+  static Wake nextWake(bool wifiConnected);
+
+  /**
+   * Sleeps until the wake. Returns after a light sleep, the main loop continues.
+   */
+  static void sleep(const Wake& wake, Filesystem& filesystem);
+
+  /**
+   * Must be called once the device is ready for its tasks after a boot,
+   * measures the boot time for the sleep decision.
+   */
+  static void ready(bool deepSleepWake);
+
+  /**
+   * Energy model of the sleep decision, charges in uA * ms.
+   * A deep sleep pays the rom boot and the measured boot time at the active current.
+   */
+  [[nodiscard]] static constexpr bool isLightSleepCheaper(
+    uint64_t gapMillis,
+    uint32_t bootMillis,
+    bool radioBoot,
+    bool keepWifi)
+  {
+    const auto bootCharge = (ROM_BOOT_MILLIS + bootMillis)
+      * (radioBoot ? RADIO_ACTIVE_MICRO_AMPS : ACTIVE_MICRO_AMPS);
+    const auto deepCharge = bootCharge + gapMillis * DEEP_SLEEP_MICRO_AMPS;
+    const auto lightCharge = gapMillis
+      * (keepWifi ? ASSOCIATED_LIGHT_SLEEP_MICRO_AMPS : LIGHT_SLEEP_MICRO_AMPS);
+    return gapMillis <= MAX_LIGHT_SLEEP_MILLIS && lightCharge < deepCharge;
+  }
+
+  private:
+  [[nodiscard]] static constexpr bool needsRadio(Task task)
+  {
+    return task == Task::MQTT;
+  }
+
+  /**
+    Sleeping shorter than this costs more than the work that could be delayed.
+    Unit: ms
+  */
+  static constexpr uint64_t MIN_SLEEP_MILLIS = 10'000;
+
+  /**
+    Longest light sleep, the sdk limits a forced light sleep to about 268 s.
+    Unit: ms
+  */
+  static constexpr uint64_t MAX_LIGHT_SLEEP_MILLIS = 268'000;
+
+  /**
+    Time from reset until millis() starts counting.
+    Unit: ms
+  */
+  static constexpr uint64_t ROM_BOOT_MILLIS = 100;
+
+  /**
+    Boot times assumed until the first one was measured, without and with radio.
+    Unit: ms
+  */
+  static constexpr uint16_t DEFAULT_BOOT_MILLIS[2] = {400, 2500};
+
+  /**
+    Supply currents of the module.
+    Unit: uA
+  */
+  static constexpr uint64_t ACTIVE_MICRO_AMPS = 20'000;
+  static constexpr uint64_t RADIO_ACTIVE_MICRO_AMPS = 75'000;
+  static constexpr uint64_t LIGHT_SLEEP_MICRO_AMPS = 1'000;
+  static constexpr uint64_t ASSOCIATED_LIGHT_SLEEP_MICRO_AMPS = 3'000;
+  static constexpr uint64_t DEEP_SLEEP_MICRO_AMPS = 20;
+
+  // average of the measured wake-to-ready times
+  [[nodiscard]] static uint16_t average(uint16_t average, uint64_t sample);
+
+  static inline yal::Logger m_logger{"WAKE"};
+};
+
+static_assert(
+  static_cast<size_t>(WakeScheduler::Task::COUNT) == rtc::WAKE_TASK_COUNT,
+  "Every task needs a slot in rtc memory");
+
+} // namespace open_heat
+
+#endif // OPEN_HEAT_WAKESCHEDULER_HPP
@@ -0,0 +1,56 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "DoubleResetDetector.hpp"
+#include <Arduino.h>
+#include <RTCMemory.hpp>
+#include <user_interface.h>
+
+open_heat::hardware::DoubleResetDetector::DoubleResetDetector() :
+    m_logger("DRD")
+{
+}
+
+bool open_heat::hardware::DoubleResetDetector::detect()
+{
+  const auto reason = EspClass::getResetInfoPtr()->reason;
+  auto reset = Reset::OTHER;
+  if (reason == REASON_DEFAULT_RST) {
+    reset = Reset::POWER_ON;
+  } else if (reason == REASON_EXT_SYS_RST) {
+    reset = Reset::EXTERNAL;
+  }
+
+  const auto flag = rtc::readResetFlag();
+  const auto result = evaluate(reset, flag);
+  if (result.flag != flag) {
+    rtc::writeResetFlag(result.flag);
+  }
+  m_armed = result.flag == FLAG_ARMED;
+
+  m_logger.log(
+    yal::Level::DEBUG,
+    "Double reset: %, resetInfo: %",
+    result.doubleReset,
+    EspClass::getResetInfo().c_str());
+  return result.doubleReset;
+}
+
+void open_heat::hardware::DoubleResetDetector::loop()
+{
+  if (m_armed && millis() > TIMEOUT_MILLIS) {
+    stop();
+  }
+}
+
+void open_heat::hardware::DoubleResetDetector::stop()
+{
+  if (!m_armed) {
+    return;
+  }
+
+  rtc::writeResetFlag(FLAG_CLEAR);
+  m_armed = false;
+}
@@ -5,21 +5,70 @@
 #ifndef DOUBLERESETDETECTOR_HPP_
 #define DOUBLERESETDETECTOR_HPP_
 
-#define DOUBLERESETDETECTOR_DEBUG false
+#include <yal/yal.hpp>
+#include <cstdint>
 
-// Number of seconds after reset during which a
-// subsequent reset will be considered a double reset.
-#define DRD_TIMEOUT 10
+namespace open_heat::hardware {
 
-// RTC Memory Address for the DoubleResetDetector to use
-#define DRD_ADDRESS 0
+/**
+ * Detects a second reset within TIMEOUT_MILLIS after power on or a reset.
+ *
+ * The state is a single flag in rtc memory which survives a reset but not a power
+ * loss. It is armed by a reset and cleared once the timeout passed or before the
+ * device sleeps, so detection never touches the filesystem.
+ */
+class DoubleResetDetector {
+  public:
+  enum class Reset { POWER_ON, EXTERNAL, OTHER };
 
-// Double reset detector
-#define ESP_DRD_USE_LITTLEFS true
-#define ESP_DRD_USE_SPIFFS false
-#define ESP8266_DRD_USE_RTC false
+  // Arbitrary values, a power loss leaves a random value in rtc memory
+  static constexpr uint32_t FLAG_CLEAR = 0xD0D04321;
+  static constexpr uint32_t FLAG_ARMED = 0xD0D01234;
 
-// must be at the bottom of this file
-#include <ESP_DoubleResetDetector.h>
+  struct Result {
+    uint32_t flag;
+    bool doubleReset;
+  };
+
+  /**
+   * Flag to store and if the reset was a double reset,
+   * given the kind of the reset and the flag found in rtc memory.
+   */
+  static constexpr Result evaluate(const Reset reset, const uint32_t flag)
+  {
+    switch (reset) {
+    case Reset::POWER_ON:
+      return {FLAG_ARMED, false};
+    case Reset::EXTERNAL:
+      // a third reset is a new first one
+      return flag == FLAG_ARMED ? Result{FLAG_CLEAR, true} : Result{FLAG_ARMED, false};
+    default:
+      return {FLAG_CLEAR, false};
+    }
+  }
+
+  DoubleResetDetector();
+  DoubleResetDetector(const DoubleResetDetector&) = delete;
+
+  // Must be called once during setup
+  bool detect();
+
+  // Clears the flag once the timeout passed
+  void loop();
+
+  // Clears the flag, must be called before sleeping
+  void stop();
+
+  private:
+  /**
+    Time after a reset in which another reset is a double reset
+    Unit: ms
+  */
+  static constexpr unsigned long TIMEOUT_MILLIS = 10 * 1000;
+
+  bool m_armed{false};
+  yal::Logger m_logger;
+};
+} // namespace open_heat::hardware
 
 #endif // DOUBLERESETDETECTOR_HPP_
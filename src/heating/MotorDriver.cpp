@@ -0,0 +1,222 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "MotorDriver.hpp"
+#include <algorithm>
+
+open_heat::heating::MotorDriver::MotorDriver(Filesystem& filesystem) :
+    m_filesystem(filesystem), m_logger("MOTOR")
+{
+}
+
+void open_heat::heating::MotorDriver::setup()
+{
+  analogWriteRange(MOTOR_PWM_RANGE);
+  disablePins();
+}
+
+void open_heat::heating::MotorDriver::loop()
+{
+  if (m_running && !m_finished) {
+    sampleSupply();
+  }
+
+  if (m_finished) {
+    m_finished = false;
+    m_running = false;
+
+    const auto runMillis = millis() - m_startMillis;
+    m_logger.log(
+      yal::Level::DEBUG,
+      "Rotating valve done after % ms, stalled: %",
+      runMillis,
+      m_stalled);
+    if (m_current.done) {
+      m_current.done(runMillis, m_stalled);
+    }
+    m_current = {};
+  }
+
+  if (!m_running && !m_commands.empty()) {
+    start(std::move(m_commands.front()));
+    m_commands.pop();
+  }
+
+  if (!m_running) {
+    restoreSleepType();
+  }
+}
+
+void open_heat::heating::MotorDriver::rotate(
+  const Direction direction,
+  const unsigned int durationMillis,
+  Callback done)
+{
+  m_commands.push({direction, durationMillis, std::move(done)});
+  loop();
+}
+
+void open_heat::heating::MotorDriver::stop()
+{
+  m_ticker.detach();
+  disablePins();
+  m_commands = {};
+  m_current = {};
+  m_running = false;
+  m_finished = false;
+  restoreSleepType();
+}
+
+bool open_heat::heating::MotorDriver::isRunning() const
+{
+  return m_running || m_finished || !m_commands.empty();
+}
+
+void open_heat::heating::MotorDriver::idle()
+{
+  if (!m_running) {
+    loop();
+    return;
+  }
+
+  const auto elapsed = millis() - m_startMillis;
+  const auto remaining = m_runMillis > elapsed ? m_runMillis - elapsed : 0;
+
+  if (!m_lightSleep) {
+    m_previousSleepType = wifi_get_sleep_type();
+    m_lightSleep = true;
+    wifi_set_sleep_type(LIGHT_SLEEP_T);
+  }
+  delay(std::min({remaining + 1, SAMPLE_INTERVAL_MILLIS, MAX_IDLE_MILLIS}));
+  loop();
+}
+
+void open_heat::heating::MotorDriver::start(Command command)
+{
+  m_current = std::move(command);
+  const auto& config = m_filesystem.getHardwareConfig().MotorPins;
+  const auto open = m_current.direction == Direction::OPEN;
+
+  m_logger.log(
+    yal::Level::DEBUG,
+    "% valve for % ms, vin: %, ground: %",
+    open ? "Opening" : "Closing",
+    m_current.durationMillis,
+    config.Vin,
+    config.Ground);
+
+  m_runMillis = rampedMillis(m_current.durationMillis, MOTOR_RAMP_MILLIS);
+  m_running = true;
+  m_stalled = false;
+  m_baselineSamples = 0;
+  m_stallSamples = 0;
+  m_startMillis = millis();
+  m_lastSampleMillis = m_startMillis;
+  // one pin is driven low, the other one is driven by the ramp
+  const auto lowPin = static_cast<uint8_t>(open ? config.Vin : config.Ground);
+  m_pwmPin = static_cast<uint8_t>(open ? config.Ground : config.Vin);
+  enablePins();
+  digitalWrite(lowPin, LOW);
+  updateRamp();
+  if (rampDuty(0, MOTOR_RAMP_MILLIS, MOTOR_DUTY_CEILING_PERCENT) != MOTOR_PWM_RANGE) {
+    m_rampTicker.attach_ms(RAMP_STEP_MILLIS, [this]() { updateRamp(); });
+  }
+
+  m_ticker.once_ms(m_runMillis, [this]() { onTimer(); });
+}
+
+void open_heat::heating::MotorDriver::onTimer()
+{
+  // runs in the timer task, only switch off the motor here
+  disablePins();
+  m_finished = true;
+}
+
+void open_heat::heating::MotorDriver::updateRamp()
+{
+  const auto elapsed = millis() - m_startMillis;
+  const auto duty = rampDuty(elapsed, MOTOR_RAMP_MILLIS, MOTOR_DUTY_CEILING_PERCENT);
+  if (duty == MOTOR_PWM_RANGE) {
+    digitalWrite(m_pwmPin, HIGH);
+  } else {
+    analogWrite(m_pwmPin, duty);
+  }
+
+  if (elapsed >= MOTOR_RAMP_MILLIS) {
+    m_rampTicker.detach();
+  }
+}
+
+void open_heat::heating::MotorDriver::sampleSupply()
+{
+  const auto now = millis();
+  if (
+    now - m_startMillis < MOTOR_RAMP_MILLIS + INRUSH_MILLIS
+    || now - m_lastSampleMillis < SAMPLE_INTERVAL_MILLIS) {
+    return;
+  }
+
+  m_lastSampleMillis = now;
+  const auto sample = static_cast<float>(analogRead(A0));
+  if (m_baselineSamples < BASELINE_SAMPLES) {
+    ++m_baselineSamples;
+    m_supplyBaseline += (sample - m_supplyBaseline) / m_baselineSamples;
+    return;
+  }
+
+  if (sample > m_supplyBaseline - STALL_ADC_DROP) {
+    m_stallSamples = 0;
+    m_supplyBaseline += (sample - m_supplyBaseline) / BASELINE_SAMPLES;
+    return;
+  }
+
+  if (++m_stallSamples < STALL_SAMPLES) {
+    return;
+  }
+
+  m_logger.log(
+    yal::Level::INFO,
+    "Motor stalled after % ms, supply % below average %",
+    now - m_startMillis,
+    sample,
+    m_supplyBaseline);
+
+  // timer callbacks do not interrupt the loop, so the timer cannot fire meanwhile
+  m_ticker.detach();
+  disablePins();
+  m_stalled = true;
+  m_finished = true;
+}
+
+void open_heat::heating::MotorDriver::disablePins()
+{
+  // digitalWrite also stops the pwm
+  m_rampTicker.detach();
+  const auto& config = m_filesystem.getHardwareConfig().MotorPins;
+
+  digitalWrite(static_cast<uint8_t>(config.Vin), LOW);
+  digitalWrite(static_cast<uint8_t>(config.Ground), LOW);
+
+  pinMode(static_cast<uint8_t>(config.Vin), INPUT);
+  pinMode(static_cast<uint8_t>(config.Ground), INPUT);
+}
+
+void open_heat::heating::MotorDriver::enablePins()
+{
+  const auto& config = m_filesystem.getHardwareConfig().MotorPins;
+
+  pinMode(static_cast<uint8_t>(config.Vin), OUTPUT);
+  pinMode(static_cast<uint8_t>(config.Ground), OUTPUT);
+}
+
+void open_heat::heating::MotorDriver::restoreSleepType()
+{
+  if (!m_lightSleep) {
+    return;
+  }
+
+  m_lightSleep = false;
+  wifi_set_sleep_type(m_previousSleepType);
+}
@@ -0,0 +1,182 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_MOTORDRIVER_HPP
+#define OPEN_HEAT_MOTORDRIVER_HPP
+
+#include <Filesystem.hpp>
+#include <Ticker.h>
+#include <user_interface.h>
+#include <yal/yal.hpp>
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+namespace open_heat::heating {
+
+/**
+ * Drives the valve motor without blocking.
+ * Commands are queued and executed one after another, a timer switches the
+ * motor off when a command is done. The completion callback of a command is
+ * called from loop(), so it may do anything the main loop may do.
+ *
+ * When the valve hits an end stop the motor stalls and draws more current,
+ * which pulls down the battery voltage measured on A0. The motor is stopped
+ * early then and the command reports the stall.
+ */
+class MotorDriver {
+  public:
+  enum class Direction { OPEN, CLOSE };
+  // called with the time the motor actually ran and if it stopped at an end stop
+  using Callback = std::function<void(unsigned long runMillis, bool stalled)>;
+
+  explicit MotorDriver(Filesystem& filesystem);
+  MotorDriver(const MotorDriver&) = delete;
+
+  void setup();
+  void loop();
+
+  void rotate(Direction direction, unsigned int durationMillis, Callback done = nullptr);
+
+  // stops the motor at once and drops all queued commands without callbacks
+  void stop();
+
+  // true while the motor runs or commands are queued
+  [[nodiscard]] bool isRunning() const;
+
+  /**
+   * Duty cycle of the soft start ramp, between 0 and MOTOR_PWM_RANGE.
+   * Rises linearly to the ceiling within rampMillis and stays there.
+   */
+  [[nodiscard]] static constexpr uint16_t
+  rampDuty(unsigned long elapsedMillis, unsigned long rampMillis, uint8_t ceilingPercent)
+  {
+    const auto ceiling = static_cast<unsigned long>(MOTOR_PWM_RANGE)
+      * std::min<unsigned long>(ceilingPercent, 100) / 100;
+    if (elapsedMillis >= rampMillis) {
+      return static_cast<uint16_t>(ceiling);
+    }
+
+    return static_cast<uint16_t>(ceiling * elapsedMillis / rampMillis);
+  }
+
+  /**
+   * Run time which turns the valve as far as durationMillis without a ramp.
+   * The linear ramp only turns the valve half its duration, so longer runs are
+   * extended by half the ramp. Shorter runs end within the ramp, where the
+   * rotation grows with the square of the run time.
+   */
+  [[nodiscard]] static constexpr unsigned long
+  rampedMillis(unsigned long durationMillis, unsigned long rampMillis)
+  {
+    if (2 * durationMillis >= rampMillis) {
+      return durationMillis + rampMillis / 2;
+    }
+
+    // shortest run with run^2 / (2 * rampMillis) >= durationMillis
+    unsigned long run = 0;
+    while (run * run < 2 * rampMillis * durationMillis) {
+      ++run;
+    }
+    return run;
+  }
+
+  /**
+   * Waits for the next motor event. The cpu idles in the sdk meanwhile,
+   * which allows automatic light sleep. The previous wifi sleep type is
+   * restored once the motor stopped.
+   */
+  void idle();
+
+  private:
+  struct Command {
+    Direction direction;
+    unsigned int durationMillis;
+    Callback done;
+  };
+
+  void start(Command command);
+  void onTimer();
+  void updateRamp();
+  void sampleSupply();
+  void disablePins();
+  void enablePins();
+  void restoreSleepType();
+
+  /**
+    Maximum time idle() waits, so other work in the main loop is not delayed
+    much longer than without a running motor.
+    Unit: ms
+  */
+  static constexpr unsigned long MAX_IDLE_MILLIS = 100;
+
+  /**
+    Interval of the duty cycle updates during the soft start ramp.
+    Unit: ms
+  */
+  static constexpr uint32_t RAMP_STEP_MILLIS = 10;
+
+  /**
+    Interval of the supply voltage samples while the motor is running.
+    Unit: ms
+  */
+  static constexpr unsigned long SAMPLE_INTERVAL_MILLIS = 20;
+
+  /**
+    The inrush current when starting the motor looks like a stall,
+    so sampling starts this long after the soft start ramp.
+    Unit: ms
+  */
+  static constexpr unsigned long INRUSH_MILLIS = 300;
+
+  /**
+    Samples averaged into the running supply voltage before a stall can be detected.
+    Unit: 1
+  */
+  static constexpr uint8_t BASELINE_SAMPLES = 8;
+
+  /**
+    Drop of the supply voltage below the running average which indicates a stall,
+    about 80mV of battery voltage with the 10M / 3.3M divider.
+    Unit: adc counts
+  */
+  static constexpr float STALL_ADC_DROP = 20;
+
+  /**
+    Consecutive samples below the threshold until the motor counts as stalled.
+    Unit: 1
+  */
+  static constexpr uint8_t STALL_SAMPLES = 3;
+
+  Filesystem& m_filesystem;
+  Ticker m_ticker;
+  Ticker m_rampTicker;
+  uint8_t m_pwmPin{0};
+
+  std::queue<Command> m_commands;
+  Command m_current{};
+  unsigned long m_startMillis{0};
+  // duration of the current command extended by the ramp
+  unsigned long m_runMillis{0};
+
+  unsigned long m_lastSampleMillis{0};
+  float m_supplyBaseline{0};
+  uint8_t m_baselineSamples{0};
+  uint8_t m_stallSamples{0};
+  bool m_stalled{false};
+
+  // wifi sleep type before idle() switched to light sleep
+  sleep_type_t m_previousSleepType{NONE_SLEEP_T};
+  bool m_lightSleep{false};
+
+  // written from the timer
+  volatile bool m_running{false};
+  volatile bool m_finished{false};
+
+  yal::Logger m_logger;
+};
+} // namespace open_heat::heating
+
+#endif // OPEN_HEAT_MOTORDRIVER_HPP
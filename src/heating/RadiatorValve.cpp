@@ -5,40 +5,61 @@
 
 #include "RadiatorValve.hpp"
 #include <RTCMemory.hpp>
+#include <WakeScheduler.hpp>
+
+#include <algorithm>
 
 open_heat::heating::RadiatorValve::RadiatorValve(
   open_heat::sensors::Temperature*& tempSensor,
   open_heat::Filesystem& filesystem) :
-    m_filesystem(filesystem), m_temperatureSensor(tempSensor), m_logger("VALVE")
+    m_filesystem(filesystem),
+    m_thermalModel(filesystem),
+    m_motor(filesystem),
+    m_schedule(filesystem),
+    m_temperatureSensor(tempSensor),
+    m_logger("VALVE")
 {
 }
 
 void open_heat::heating::RadiatorValve::setup()
 {
-  disablePins();
+  m_motor.setup();
+  m_thermalModel.setup();
 }
 
-uint64_t open_heat::heating::RadiatorValve::loop()
+void open_heat::heating::RadiatorValve::loop()
 {
-  // no check necessary yet
-  if (rtc::offsetMillis() < rtc::read().valveNextCheckMillis) {
-    return rtc::read().valveNextCheckMillis;
+  m_motor.loop();
+
+  // not persisted, the schedule sets the temperature again with its next
+  // transition after a power loss
+  const auto scheduledTemp = m_schedule.advance();
+  if (scheduledTemp > 0) {
+    applySetTemp(scheduledTemp);
+  }
+
+  if (WakeScheduler::isDue(WakeScheduler::Task::VALVE)) {
+    checkValve();
   }
+}
 
+void open_heat::heating::RadiatorValve::checkValve()
+{
+  const auto mode = rtc::get<&rtc::Memory::mode>();
   // heating disabled
-  if (rtc::read().mode == OFF || rtc::read().mode == FULL_OPEN) {
-    const auto nextCheck = std::numeric_limits<uint64_t>::max();
-    rtc::setValveNextCheckMillis(nextCheck);
-    rtc::read().mode == OFF ? closeValve(VALVE_FULL_ROTATE_TIME * 2)
-                            : openValve(VALVE_FULL_ROTATE_TIME * 2);
+  if (mode == OFF || mode == FULL_OPEN) {
+    WakeScheduler::cancel(WakeScheduler::Task::VALVE);
+    mode == OFF ? closeValve(VALVE_FULL_ROTATE_TIME * 2)
+                : openValve(VALVE_FULL_ROTATE_TIME * 2);
 
     m_logger.log(yal::Level::DEBUG, "Heating is turned off, disabled heating");
-    return nextCheck;
+    return;
   }
 
-  if (rtc::read().mode == UNKNOWN) {
+  if (mode == UNKNOWN) {
     m_logger.log(yal::Level::ERROR, "Unknown heating mode!");
-    return nextCheckTime();
+    scheduleCheck(rtc::get<&rtc::Memory::minCheckIntervalMillis>());
+    return;
   } // else mode is heat
 
   // store data once to work with consistent values
@@ -47,8 +68,21 @@ uint64_t open_heat::heating::RadiatorValve::loop()
 
   // also updates last measured temp
   const auto measuredTemp = m_temperatureSensor->temperature();
-  const float predictPart
-    = PREDICTION_STEEPNESS * (measuredTemp - rtcData.lastMeasuredTemp);
+  rtc::addHistorySample(measuredTemp, position());
+  updateControlStats(measuredTemp, rtcData.setTemp);
+
+  const auto valveOpening = static_cast<float>(position()) / 100;
+  m_thermalModel.update(measuredTemp, valveOpening);
+
+  float predictPart;
+  if (ThermalModel::isTrained()) {
+    const auto horizon = static_cast<unsigned long>(
+      PREDICTION_STEEPNESS * static_cast<float>(rtcData.checkIntervalMillis));
+    predictPart
+      = ThermalModel::predict(measuredTemp, valveOpening, horizon) - measuredTemp;
+  } else {
+    predictPart = PREDICTION_STEEPNESS * (measuredTemp - rtcData.lastMeasuredTemp);
+  }
   const float predictTemp = measuredTemp + predictPart;
   const auto predictionError = measuredTemp - rtcData.lastPredictedTemp;
   const auto temperatureChange = measuredTemp - rtcData.lastMeasuredTemp;
@@ -69,7 +103,7 @@ uint64_t open_heat::heating::RadiatorValve::loop()
     "\tmeasuredTemp: %, lastMeasuredTemp %, setTemp % \n"
     "\ttemperatureChange %, absTempDiff: %",
     predictTemp,
-    m_checkIntervalMillis,
+    rtcData.checkIntervalMillis,
     predictPart,
     predictionError,
     measuredTemp,
@@ -79,9 +113,9 @@ uint64_t open_heat::heating::RadiatorValve::loop()
     absTempDiff);
 
   if (0 == predictTemp) {
-    const auto nextCheck = nextCheckTime();
+    scheduleCheck(rtcData.minCheckIntervalMillis);
     m_logger.log(yal::Level::DEBUG, "Skipping temperature setting, predictTemp = 0");
-    return nextCheck;
+    return;
   }
 
   // Act according to the prediction.
@@ -99,12 +133,12 @@ uint64_t open_heat::heating::RadiatorValve::loop()
 
   } else if (predictTemp > (rtcData.setTemp + closeHysteresis)) {
     if (temperatureChange >= -minTemperatureChange) {
-      handleTempTooHigh(rtcData, predictTemp, closeHysteresis);
+      handleTempTooHigh(rtcData, measuredTemp, predictTemp, closeHysteresis);
     } else {
       m_logger.log(
         yal::Level::INFO,
         "SINK, NO ADJUST: Temp old %, temp now %, temp change %",
-        rtc::read().lastMeasuredTemp,
+        rtc::get<&rtc::Memory::lastMeasuredTemp>(),
         measuredTemp,
         temperatureChange);
     }
@@ -112,14 +146,39 @@ uint64_t open_heat::heating::RadiatorValve::loop()
     m_logger.log(yal::Level::INFO, "Temperature is in tolerance, not changing");
   }
 
-  return nextCheckTime();
+  unsigned long interval = rtcData.minCheckIntervalMillis;
+  if (rtc::get<&rtc::Memory::currentRotateTime>() == rtcData.currentRotateTime) {
+    interval = checkInterval(
+      rtcData,
+      measuredTemp,
+      rtcData.setTemp - openHysteresis,
+      rtcData.setTemp + closeHysteresis);
+  }
+
+  rtc::setLastCheck(rtc::offsetMillis(), measuredTemp);
+  rtc::setCheckIntervalMillis(interval);
+  m_logger.log(yal::Level::INFO, "Next valve check in % ms", interval);
+  scheduleCheck(interval);
 }
 
 void open_heat::heating::RadiatorValve::handleTempTooHigh(
   const open_heat::rtc::Memory& rtcData,
+  const float measuredTemp,
   const float predictTemp,
   const float closeHysteresis)
 {
+  if (ThermalModel::isTrained()) {
+    const auto rotateTime
+      = modelRotateTime(measuredTemp, rtcData.setTemp, rtcData.checkIntervalMillis);
+    if (-rotateTime < MIN_MODEL_ROTATE_MILLIS) {
+      m_logger.log(yal::Level::INFO, "Model close time % too small", -rotateTime);
+      return;
+    }
+
+    closeValve(static_cast<unsigned int>(-rotateTime));
+    return;
+  }
+
   auto closeTime = 200;
   const auto predictDiff = rtcData.setTemp - predictTemp - closeHysteresis;
   m_logger.log(yal::Level::INFO, "Close predict diff: %", predictDiff);
@@ -147,6 +206,18 @@ void open_heat::heating::RadiatorValve::handleTempTooLow(
   const float predictTemp,
   const float openHysteresis)
 {
+  if (ThermalModel::isTrained()) {
+    const auto rotateTime
+      = modelRotateTime(measuredTemp, rtcData.setTemp, rtcData.checkIntervalMillis);
+    if (rotateTime < MIN_MODEL_ROTATE_MILLIS) {
+      m_logger.log(yal::Level::INFO, "Model open time % too small", rotateTime);
+      return;
+    }
+
+    openValve(static_cast<unsigned int>(rotateTime));
+    return;
+  }
+
   auto openTime = 350;
   const float largeTempDiff = 3;
   const auto predictDiff = rtcData.setTemp - predictTemp - openHysteresis;
@@ -172,29 +243,115 @@ void open_heat::heating::RadiatorValve::handleTempTooLow(
   }
   openValve(openTime);
 }
-uint64_t open_heat::heating::RadiatorValve::nextCheckTime()
+int open_heat::heating::RadiatorValve::modelRotateTime(
+  const float measuredTemp,
+  const float setTemp,
+  const unsigned long checkIntervalMillis)
+{
+  // the opening which reaches the set temperature within the prediction horizon
+  const auto horizon = static_cast<unsigned long>(
+    PREDICTION_STEEPNESS * static_cast<float>(checkIntervalMillis));
+  const auto targetOpening
+    = ThermalModel::requiredOpening(measuredTemp, setTemp, horizon);
+  const auto currentOpening = static_cast<float>(position()) / 100;
+
+  // position covers the full range of currentRotateTime
+  const auto rotateTime = static_cast<int>(
+    (targetOpening - currentOpening) * 2 * static_cast<float>(VALVE_FULL_ROTATE_TIME));
+  return std::max(
+    -MAX_MODEL_ROTATE_MILLIS, std::min(MAX_MODEL_ROTATE_MILLIS, rotateTime));
+}
+
+void open_heat::heating::RadiatorValve::updateControlStats(
+  const float measuredTemp,
+  const float setTemp)
+{
+  auto stats = rtc::get<&rtc::Memory::controlStats>();
+  if (
+    stats.settlingSeconds == 0 && std::abs(measuredTemp - setTemp) <= SETTLED_TOLERANCE) {
+    const auto elapsed = rtc::offsetMillis() - stats.setTempChangedMillis;
+    // 0 is reserved for not settled yet
+    stats.settlingSeconds = std::max<uint32_t>(1, static_cast<uint32_t>(elapsed / 1000));
+  }
+
+  stats.overshoot = std::max(stats.overshoot, measuredTemp - setTemp);
+  rtc::setControlStats(stats);
+}
+
+unsigned long open_heat::heating::RadiatorValve::checkInterval(
+  const rtc::Memory& rtcData,
+  const float measuredTemp,
+  const float lowerLimit,
+  const float upperLimit)
+{
+  const unsigned long minInterval = rtcData.minCheckIntervalMillis;
+  const unsigned long maxInterval = rtcData.maxCheckIntervalMillis;
+  if (!rtcData.adaptiveCheckInterval) {
+    return minInterval;
+  }
+
+  // check often while the temperature is outside of the hysteresis band
+  if (measuredTemp < lowerLimit || measuredTemp > upperLimit) {
+    return minInterval;
+  }
+
+  const auto now = rtc::offsetMillis();
+  if (rtcData.lastCheckMillis == 0 || now < rtcData.lastCheckMillis + MIN_SLOPE_MILLIS) {
+    return minInterval;
+  }
+
+  // Sleep until the temperature would leave the band if the slope continues,
+  // which is the maximum interval for a stable temperature.
+  const auto slope = (measuredTemp - rtcData.lastCheckTemp)
+    / static_cast<float>(now - rtcData.lastCheckMillis);
+  const auto margin = slope > 0 ? upperLimit - measuredTemp : measuredTemp - lowerLimit;
+  auto interval = maxInterval;
+  if (slope != 0 && margin / std::abs(slope) < static_cast<float>(maxInterval)) {
+    interval = static_cast<unsigned long>(margin / std::abs(slope));
+  }
+
+  interval = std::min(interval, rtcData.checkIntervalMillis * MAX_CHECK_INTERVAL_GROWTH);
+  return std::max(minInterval, std::min(maxInterval, interval));
+}
+
+void open_heat::heating::RadiatorValve::scheduleCheck(const unsigned long intervalMillis)
 {
-  const auto nextCheck = rtc::offsetMillis() + m_checkIntervalMillis;
-  rtc::setValveNextCheckMillis(nextCheck);
-  return nextCheck;
+  WakeScheduler::schedule(
+    WakeScheduler::Task::VALVE,
+    rtc::offsetMillis() + intervalMillis,
+    intervalMillis / CHECK_SLACK_DIVISOR);
 }
 
 float open_heat::heating::RadiatorValve::getConfiguredTemp()
 {
-  return rtc::read().setTemp;
+  return rtc::get<&rtc::Memory::setTemp>();
 }
 
 void open_heat::heating::RadiatorValve::setConfiguredTemp(float temp)
 {
-  if (temp == rtc::read().setTemp) {
+  applySetTemp(temp);
+  if (m_filesystem.getConfig().SetTemperature != temp) {
+    updateConfig();
+  }
+}
+
+void open_heat::heating::RadiatorValve::applySetTemp(float temp)
+{
+  if (temp == rtc::get<&rtc::Memory::setTemp>()) {
     return;
   }
 
   m_logger.log(yal::Level::INFO, "New target temperature %", temp);
   rtc::setSetTemp(temp);
   setNextCheckTimeNow();
+  rtc::setCheckIntervalMillis(rtc::get<&rtc::Memory::minCheckIntervalMillis>());
 
-  updateConfig();
+  // settling and overshoot are measured per set temperature
+  auto stats = rtc::get<&rtc::Memory::controlStats>();
+  stats.setTempChangedMillis = rtc::offsetMillis();
+  stats.settlingSeconds = 0;
+  stats.overshoot = 0;
+  rtc::setControlStats(stats);
 
   for (const auto& handler : m_setTempChangeHandler) {
     handler(temp);
@@ -212,60 +369,54 @@ void open_heat::heating::RadiatorValve::updateConfig()
 
 void open_heat::heating::RadiatorValve::closeValve(unsigned int rotateTime)
 {
-  if (rtc::read().currentRotateTime <= (-VALVE_FULL_ROTATE_TIME)) {
+  if (rtc::get<&rtc::Memory::currentRotateTime>() <= (-VALVE_FULL_ROTATE_TIME)) {
     m_logger.log(
       yal::Level::DEBUG,
       "Valve already fully closed, current rotate time: %",
-      rtc::read().currentRotateTime);
+      rtc::get<&rtc::Memory::currentRotateTime>());
     return;
   }
 
-  if (rtc::read().currentRotateTime < 0) {
+  if (rtc::get<&rtc::Memory::currentRotateTime>() < 0) {
     rotateTime = remainingRotateTime(static_cast<int>(rotateTime), true);
   }
 
   rtc::setCurrentRotateTime(
-    rtc::read().currentRotateTime - rotateTime, VALVE_FULL_ROTATE_TIME);
-  const auto& config = m_filesystem.getConfig().MotorPins;
+    rtc::get<&rtc::Memory::currentRotateTime>() - rotateTime, VALVE_FULL_ROTATE_TIME);
 
   m_logger.log(
     yal::Level::DEBUG,
-    "Closing valve for %ms, currentRotateTime: %ms, vin: %, ground: %",
+    "Closing valve for %ms, currentRotateTime: %ms",
     rotateTime,
-    rtc::read().currentRotateTime,
-    config.Vin,
-    config.Ground);
+    rtc::get<&rtc::Memory::currentRotateTime>());
 
-  rotateValve(rotateTime, config, HIGH, LOW);
+  rotateValve(rotateTime, MotorDriver::Direction::CLOSE);
 }
 
 void open_heat::heating::RadiatorValve::openValve(unsigned int rotateTime)
 {
-  if (rtc::read().currentRotateTime >= VALVE_FULL_ROTATE_TIME) {
+  if (rtc::get<&rtc::Memory::currentRotateTime>() >= VALVE_FULL_ROTATE_TIME) {
     m_logger.log(
       yal::Level::DEBUG,
       "Valve already fully open, current rotate time: %",
-      rtc::read().currentRotateTime);
+      rtc::get<&rtc::Memory::currentRotateTime>());
     return;
   }
 
-  if (rtc::read().currentRotateTime > 0) {
+  if (rtc::get<&rtc::Memory::currentRotateTime>() > 0) {
     rotateTime = remainingRotateTime(static_cast<int>(rotateTime), false);
   }
 
   rtc::setCurrentRotateTime(
-    rtc::read().currentRotateTime + rotateTime, VALVE_FULL_ROTATE_TIME);
-  const auto& config = m_filesystem.getConfig().MotorPins;
+    rtc::get<&rtc::Memory::currentRotateTime>() + rotateTime, VALVE_FULL_ROTATE_TIME);
 
   m_logger.log(
     yal::Level::DEBUG,
-    "Opening valve for %ms, currentRotateTime: %ms, vin: %, ground: %",
+    "Opening valve for %ms, currentRotateTime: %ms",
     rotateTime,
-    rtc::read().currentRotateTime,
-    config.Vin,
-    config.Ground);
+    rtc::get<&rtc::Memory::currentRotateTime>());
 
-  rotateValve(rotateTime, config, LOW, HIGH);
+  rotateValve(rotateTime, MotorDriver::Direction::OPEN);
 }
 
 unsigned int open_heat::heating::RadiatorValve::remainingRotateTime(
@@ -277,7 +428,8 @@ unsigned int open_heat::heating::RadiatorValve::remainingRotateTime(
   // or open and rotate time is negative
   // we still have the full range left
   if ((close && rotateTime < 0) || (!close && rotateTime > 0)) {
-    remainingTime = VALVE_FULL_ROTATE_TIME - std::abs(rtc::read().currentRotateTime);
+    remainingTime
+      = VALVE_FULL_ROTATE_TIME - std::abs(rtc::get<&rtc::Memory::currentRotateTime>());
   } else {
     remainingTime = VALVE_FULL_ROTATE_TIME;
   }
@@ -292,45 +444,52 @@ unsigned int open_heat::heating::RadiatorValve::remainingRotateTime(
 
 void open_heat::heating::RadiatorValve::rotateValve(
   unsigned int rotateTime,
-  const PinSettings& config,
-  int vinState,
-  int groundState)
+  MotorDriver::Direction direction)
 {
-  enablePins();
-  digitalWrite(static_cast<uint8_t>(config.Vin), vinState);
-  digitalWrite(static_cast<uint8_t>(config.Ground), groundState);
+  const auto done = [this, direction](unsigned long runMillis, bool stalled) {
+    auto stats = rtc::get<&rtc::Memory::controlStats>();
+    stats.motorOnMillis += runMillis;
+    rtc::setControlStats(stats);
+
+    if (stalled) {
+      // the end stop is the only absolute position reference of the valve
+      const auto endStop = direction == MotorDriver::Direction::OPEN
+        ? VALVE_FULL_ROTATE_TIME
+        : -VALVE_FULL_ROTATE_TIME;
+      m_logger.log(
+        yal::Level::INFO,
+        "End stop reached, recalibrating rotate time from % to %",
+        rtc::get<&rtc::Memory::currentRotateTime>(),
+        endStop);
+      rtc::setCurrentRotateTime(endStop, VALVE_FULL_ROTATE_TIME);
+    }
+  };
 
-  delay(rotateTime + m_spinUpMillis);
-  disablePins();
-  m_logger.log(yal::Level::DEBUG, "Rotating valve done");
+  m_motor.rotate(direction, rotateTime + m_spinUpMillis, done);
 }
 
-void open_heat::heating::RadiatorValve::disablePins()
+open_heat::heating::Schedule& open_heat::heating::RadiatorValve::schedule()
 {
-  const auto& config = m_filesystem.getConfig().MotorPins;
-
-  digitalWrite(static_cast<uint8_t>(config.Vin), LOW);
-  digitalWrite(static_cast<uint8_t>(config.Ground), LOW);
-
-  pinMode(static_cast<uint8_t>(config.Vin), INPUT);
-  pinMode(static_cast<uint8_t>(config.Ground), INPUT);
+  return m_schedule;
 }
 
-void open_heat::heating::RadiatorValve::enablePins()
+bool open_heat::heating::RadiatorValve::isMotorRunning() const
 {
-  const auto& config = m_filesystem.getConfig().MotorPins;
+  return m_motor.isRunning();
+}
 
-  pinMode(static_cast<uint8_t>(config.Vin), OUTPUT);
-  pinMode(static_cast<uint8_t>(config.Ground), OUTPUT);
+void open_heat::heating::RadiatorValve::waitForMotor()
+{
+  m_motor.idle();
 }
 
 void open_heat::heating::RadiatorValve::setMode(const OperationMode mode)
 {
-  if (rtc::read().isWindowOpen) {
+  if (rtc::get<&rtc::Memory::isWindowOpen>()) {
     rtc::setRestoreMode(false);
   }
 
-  if (mode == rtc::read().mode) {
+  if (mode == rtc::get<&rtc::Memory::mode>()) {
     return;
   }
 
@@ -339,13 +498,22 @@ void open_heat::heating::RadiatorValve::setMode(const OperationMode mode)
   setNextCheckTimeNow();
 
   for (const auto& handler : m_OpModeChangeHandler) {
-    handler(rtc::read().mode);
+    handler(rtc::get<&rtc::Memory::mode>());
   }
 }
 
 OperationMode open_heat::heating::RadiatorValve::getMode()
 {
-  return rtc::read().mode;
+  return rtc::get<&rtc::Memory::mode>();
+}
+
+uint8_t open_heat::heating::RadiatorValve::position()
+{
+  // currentRotateTime is -VALVE_FULL_ROTATE_TIME when closed
+  // and VALVE_FULL_ROTATE_TIME when fully open
+  const auto rotateTime
+    = rtc::get<&rtc::Memory::currentRotateTime>() + VALVE_FULL_ROTATE_TIME;
+  return static_cast<uint8_t>(rotateTime * 100 / (2 * VALVE_FULL_ROTATE_TIME));
 }
 
 const char* open_heat::heating::RadiatorValve::modeToCharArray(const OperationMode mode)
@@ -373,21 +541,23 @@ void open_heat::heating::RadiatorValve::registerModeChangedHandler(
 
 void open_heat::heating::RadiatorValve::setWindowState(const bool isOpen)
 {
-  if (isOpen == rtc::read().isWindowOpen) {
+  if (isOpen == rtc::get<&rtc::Memory::isWindowOpen>()) {
     m_logger.log(yal::Level::DEBUG, "Window mode % already set", isOpen);
     return;
   }
 
   if (isOpen) {
     m_logger.log(yal::Level::DEBUG, "Storing mode, window open");
-    rtc::setLastMode(rtc::read().mode);
+    rtc::setLastMode(rtc::get<&rtc::Memory::mode>());
     setMode(OFF);
     rtc::setRestoreMode(true);
   } else {
-    if (rtc::read().restoreMode) {
+    if (rtc::get<&rtc::Memory::restoreMode>()) {
       m_logger.log(yal::Level::DEBUG, "Restoring mode, window closed");
-      rtc::setValveNextCheckMillis(rtc::offsetMillis() + SLEEP_MILLIS_AFTER_WINDOW_CLOSE);
-      setMode(rtc::read().lastMode);
+      WakeScheduler::schedule(
+        WakeScheduler::Task::VALVE,
+        rtc::offsetMillis() + SLEEP_MILLIS_AFTER_WINDOW_CLOSE);
+      setMode(rtc::get<&rtc::Memory::lastMode>());
     } else {
       m_logger.log(
         yal::Level::DEBUG, "Mode changed while window was open, not enabled old mode");
@@ -409,5 +579,5 @@ void open_heat::heating::RadiatorValve::registerWindowChangeHandler(
 
 void open_heat::heating::RadiatorValve::setNextCheckTimeNow()
 {
-  rtc::setValveNextCheckMillis(0);
+  WakeScheduler::schedule(WakeScheduler::Task::VALVE, 0);
 }
@@ -8,6 +8,9 @@
 
 #include <Filesystem.hpp>
 #include <RTCMemory.hpp>
+#include <heating/MotorDriver.hpp>
+#include <heating/Schedule.hpp>
+#include <heating/ThermalModel.hpp>
 #include <sensors/Temperature.hpp>
 #include <yal/yal.hpp>
 #include <chrono>
@@ -20,13 +23,15 @@ class RadiatorValve {
   RadiatorValve(const RadiatorValve&) = delete;
   RadiatorValve(RadiatorValve&&) = default;
 
-  uint64_t loop();
+  void loop();
   void setup();
   static float getConfiguredTemp();
   void setConfiguredTemp(float temp);
   void setMode(OperationMode mode);
   OperationMode getMode();
   static const char* modeToCharArray(OperationMode mode);
+  // estimated valve opening in percent
+  static uint8_t position();
 
   void registerSetTempChangedHandler(const std::function<void(float)>& handler);
   void registerModeChangedHandler(const std::function<void(OperationMode)>& handler);
@@ -34,11 +39,18 @@ class RadiatorValve {
 
   void setWindowState(bool isOpen);
 
+  Schedule& schedule();
+
+  // the device must not sleep while the motor is running
+  [[nodiscard]] bool isMotorRunning() const;
+  void waitForMotor();
+
   private:
+  void checkValve();
   void openValve(unsigned int rotateTime);
   void closeValve(unsigned int rotateTime);
-  void disablePins();
-  void enablePins();
+  // changes the set temperature in rtc memory only
+  void applySetTemp(float temp);
   void updateConfig();
 
   void setNextCheckTimeNow();
@@ -51,16 +63,54 @@ class RadiatorValve {
     predict the future by extrapolating the last temperature change. This
     value says how far to extrapolate. Larger values make regulation more
     aggressive, smaller values make it less aggressive.
+    Once the thermal model is trained it predicts this many check intervals
+    ahead instead of extrapolating.
     Unit:  1
   */
   static constexpr float PREDICTION_STEEPNESS = 2;
 
+  /**
+    Limits of a single valve movement calculated from the thermal model.
+    Smaller movements are skipped to save motor time, larger ones are capped
+    in case the model is off.
+    Unit: ms
+  */
+  static constexpr int MIN_MODEL_ROTATE_MILLIS = 300;
+  static constexpr int MAX_MODEL_ROTATE_MILLIS = 5000;
+
+  /**
+    The set temperature counts as reached for the control statistics once the
+    measured temperature is within this distance.
+    Unit: °C
+  */
+  static constexpr float SETTLED_TOLERANCE = 0.3F;
+
   Filesystem& m_filesystem;
+  ThermalModel m_thermalModel;
+  MotorDriver m_motor;
+  Schedule m_schedule;
 
   sensors::Temperature*& m_temperatureSensor;
 
-  static constexpr unsigned long m_checkIntervalMillis
-    = static_cast<unsigned long>(5 * 60 * 1000);
+  /**
+    The check interval grows at most by this factor per check, so a slope
+    which is close to zero by chance does not stretch it to the maximum at once.
+    Unit: 1
+  */
+  static constexpr unsigned long MAX_CHECK_INTERVAL_GROWTH = 2;
+
+  /**
+    A check may run up to interval / CHECK_SLACK_DIVISOR early to share the wake
+    with another task.
+    Unit: 1
+  */
+  static constexpr unsigned long CHECK_SLACK_DIVISOR = 4;
+
+  /**
+    Checks closer together than this do not give a usable temperature slope.
+    Unit: ms
+  */
+  static constexpr uint64_t MIN_SLOPE_MILLIS = 60 * 1000;
 
   static constexpr int m_spinUpMillis = 50;
   static constexpr int m_finalRotateMillis = 1'000;
@@ -69,12 +119,13 @@ class RadiatorValve {
   std::vector<std::function<void(bool)>> m_windowStateHandler{};
   std::vector<std::function<void(float)>> m_setTempChangeHandler{};
   [[nodiscard]] static unsigned int remainingRotateTime(int rotateTime, bool close);
-  void rotateValve(
-    unsigned int rotateTime,
-    const PinSettings& config,
-    int vinState,
-    int groundState);
-  static uint64_t nextCheckTime();
+  void rotateValve(unsigned int rotateTime, MotorDriver::Direction direction);
+  static void scheduleCheck(unsigned long intervalMillis);
+  [[nodiscard]] static unsigned long checkInterval(
+    const rtc::Memory& rtcData,
+    float measuredTemp,
+    float lowerLimit,
+    float upperLimit);
   void handleTempTooLow(
     const open_heat::rtc::Memory& rtcData,
     float measuredTemp,
@@ -82,8 +133,12 @@ class RadiatorValve {
     float openHysteresis);
   void handleTempTooHigh(
     const open_heat::rtc::Memory& rtcData,
+    float measuredTemp,
     float predictTemp,
     float closeHysteresis);
+  [[nodiscard]] static int
+  modelRotateTime(float measuredTemp, float setTemp, unsigned long checkIntervalMillis);
+  static void updateControlStats(float measuredTemp, float setTemp);
 
   yal::Logger m_logger;
 };
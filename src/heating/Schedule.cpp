@@ -0,0 +1,308 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "Schedule.hpp"
+#include <WakeScheduler.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <limits>
+
+open_heat::heating::Schedule::Schedule(Filesystem& filesystem) :
+    m_filesystem(filesystem), m_logger("SCHEDULE")
+{
+}
+
+bool open_heat::heating::Schedule::set(const String& payload)
+{
+  PersistedSchedule schedule{};
+  load(schedule);
+
+  PersistedSchedule parsed{};
+  std::strcpy(parsed.timezone, schedule.timezone);
+  if (payload != "off") {
+    const char* entry = payload.c_str();
+    while (*entry != '\0') {
+      char* end = nullptr;
+      const auto minute = std::strtoul(entry, &end, 10);
+      if (end == entry || *end != ',') {
+        // a typo must not clear or truncate the stored schedule
+        m_logger.log(yal::Level::WARNING, "Invalid schedule %", payload.c_str());
+        return false;
+      }
+
+      entry = end + 1;
+      const auto temperature = std::strtof(entry, &end);
+      if (
+        end == entry || (*end != ';' && *end != '\0') || minute >= MINUTES_PER_WEEK
+        || temperature <= 0) {
+        m_logger.log(yal::Level::WARNING, "Invalid schedule %", payload.c_str());
+        return false;
+      }
+
+      if (parsed.count == SCHEDULE_MAX_TRANSITIONS) {
+        m_logger.log(
+          yal::Level::WARNING,
+          "Schedule exceeds % transitions, ignoring the rest",
+          SCHEDULE_MAX_TRANSITIONS);
+        break;
+      }
+
+      parsed.transitions[parsed.count++]
+        = {static_cast<uint16_t>(minute),
+           static_cast<int16_t>(std::lround(temperature * 100))};
+      entry = *end == ';' ? end + 1 : end;
+    }
+  }
+
+  std::sort(
+    parsed.transitions,
+    parsed.transitions + parsed.count,
+    [](const Transition& lhs, const Transition& rhs) {
+      return lhs.minuteOfWeek < rhs.minuteOfWeek;
+    });
+
+  // the payload is retained and arrives on every connect
+  if (
+    parsed.count == schedule.count
+    && std::equal(
+      parsed.transitions,
+      parsed.transitions + parsed.count,
+      schedule.transitions,
+      [](const Transition& lhs, const Transition& rhs) {
+        return lhs.minuteOfWeek == rhs.minuteOfWeek
+          && lhs.temperature == rhs.temperature;
+      })) {
+    return false;
+  }
+
+  persist(parsed);
+  updateNextTransition(parsed);
+  m_logger.log(yal::Level::INFO, "New schedule with % transitions", parsed.count);
+  return true;
+}
+
+void open_heat::heating::Schedule::setTimezone(const String& timezone)
+{
+  PersistedSchedule schedule{};
+  load(schedule);
+  if (timezone.length() >= TIMEZONE_MAX_LEN || timezone == schedule.timezone) {
+    return;
+  }
+
+  std::memset(schedule.timezone, 0, sizeof(schedule.timezone));
+  std::strcpy(schedule.timezone, timezone.c_str());
+  persist(schedule);
+
+  // take the local time again with the new timezone
+  auto state = rtc::get<&rtc::Memory::schedule>();
+  state.clockSynced = false;
+  rtc::setSchedule(state);
+  m_clockSyncStarted = false;
+  startClockSync();
+}
+
+void open_heat::heating::Schedule::startClockSync()
+{
+  if (m_clockSyncStarted) {
+    return;
+  }
+
+  PersistedSchedule schedule{};
+  load(schedule);
+  configTime(schedule.timezone, ntpServer_);
+  m_clockSyncStarted = true;
+}
+
+void open_heat::heating::Schedule::syncClock()
+{
+  const auto now = time(nullptr);
+  if (!m_clockSyncStarted || now < MIN_VALID_TIME) {
+    return;
+  }
+
+  tm local{};
+  localtime_r(&now, &local);
+  // tm_wday starts at sunday
+  const auto minuteOfWeek = static_cast<uint32_t>(
+    ((local.tm_wday + 6) % 7) * 24 * 60 + local.tm_hour * 60 + local.tm_min);
+  const auto localMillis
+    = minuteOfWeek * 60 * 1000 + static_cast<uint32_t>(local.tm_sec) * 1000;
+  const auto weekOffset = static_cast<uint32_t>(
+    (localMillis + MILLIS_PER_WEEK - rtc::offsetMillis() % MILLIS_PER_WEEK)
+    % MILLIS_PER_WEEK);
+
+  auto state = rtc::get<&rtc::Memory::schedule>();
+  if (!state.clockSynced) {
+    state.weekOffsetMillis = weekOffset;
+    state.clockSynced = true;
+    rtc::setSchedule(state);
+
+    PersistedSchedule schedule{};
+    load(schedule);
+    updateNextTransition(schedule);
+    m_logger.log(yal::Level::INFO, "Clock synced, minute of week %", minuteOfWeek);
+    return;
+  }
+
+  // Correct the drift of the rtc clock. The next transition stays the same,
+  // only its time moves, so the table does not have to be read.
+  auto drift = static_cast<int64_t>(weekOffset) - state.weekOffsetMillis;
+  if (drift > static_cast<int64_t>(MILLIS_PER_WEEK / 2)) {
+    drift -= MILLIS_PER_WEEK;
+  } else if (drift < -static_cast<int64_t>(MILLIS_PER_WEEK / 2)) {
+    drift += MILLIS_PER_WEEK;
+  }
+
+  const auto nextTransition = nextTransitionMillis();
+  if (nextTransition != std::numeric_limits<uint64_t>::max()) {
+    WakeScheduler::schedule(
+      WakeScheduler::Task::SCHEDULE,
+      static_cast<uint64_t>(
+        std::max<int64_t>(0, static_cast<int64_t>(nextTransition) - drift)));
+  }
+  state.weekOffsetMillis = weekOffset;
+  rtc::setSchedule(state);
+
+  if (drift != 0) {
+    m_logger.log(yal::Level::DEBUG, "Clock drift % ms corrected", drift);
+  }
+}
+
+uint64_t open_heat::heating::Schedule::nextTransitionMillis()
+{
+  return WakeScheduler::deadline(WakeScheduler::Task::SCHEDULE);
+}
+
+bool open_heat::heating::Schedule::isDue()
+{
+  return WakeScheduler::isDue(WakeScheduler::Task::SCHEDULE);
+}
+
+float open_heat::heating::Schedule::advance()
+{
+  if (!isDue()) {
+    return 0;
+  }
+
+  PersistedSchedule schedule{};
+  if (!load(schedule) || schedule.count == 0) {
+    updateNextTransition(schedule);
+    return 0;
+  }
+
+  auto state = rtc::get<&rtc::Memory::schedule>();
+  if (state.nextIndex >= schedule.count) {
+    updateNextTransition(schedule);
+    return 0;
+  }
+
+  const auto now = rtc::offsetMillis();
+  auto nextTransition = nextTransitionMillis();
+  Transition applied{};
+  for (uint8_t i = 0; i < schedule.count && nextTransition <= now; ++i) {
+    applied = schedule.transitions[state.nextIndex];
+    const auto nextIndex
+      = static_cast<uint8_t>((state.nextIndex + 1) % schedule.count);
+    auto delta = (transitionMillis(schedule.transitions[nextIndex])
+                  + MILLIS_PER_WEEK - transitionMillis(applied))
+      % MILLIS_PER_WEEK;
+    if (delta == 0) {
+      delta = MILLIS_PER_WEEK;
+    }
+
+    state.nextIndex = nextIndex;
+    nextTransition += delta;
+  }
+
+  rtc::setSchedule(state);
+  if (nextTransition <= now) {
+    // slept for more than a week, start over from the current time
+    updateNextTransition(schedule);
+  } else {
+    WakeScheduler::schedule(WakeScheduler::Task::SCHEDULE, nextTransition);
+  }
+
+  m_logger.log(
+    yal::Level::INFO,
+    "Schedule transition at minute % to % °C",
+    applied.minuteOfWeek,
+    static_cast<float>(applied.temperature) / 100);
+  return static_cast<float>(applied.temperature) / 100;
+}
+
+bool open_heat::heating::Schedule::load(PersistedSchedule& schedule)
+{
+  if (
+    !m_filesystem.readFile(scheduleFile_, &schedule, sizeof(schedule))
+    || schedule.count > SCHEDULE_MAX_TRANSITIONS) {
+    std::memset(&schedule, 0, sizeof(schedule));
+    std::strcpy(schedule.timezone, DEFAULT_TIMEZONE);
+    return false;
+  }
+
+  schedule.timezone[TIMEZONE_MAX_LEN - 1] = '\0';
+  return true;
+}
+
+void open_heat::heating::Schedule::persist(const PersistedSchedule& schedule)
+{
+  if (m_filesystem.writeFile(scheduleFile_, &schedule, sizeof(schedule))) {
+    m_logger.log(yal::Level::DEBUG, "Schedule saved");
+  }
+}
+
+void open_heat::heating::Schedule::updateNextTransition(const PersistedSchedule& schedule)
+{
+  auto state = rtc::get<&rtc::Memory::schedule>();
+  auto nextTransition = std::numeric_limits<uint64_t>::max();
+  state.nextIndex = 0;
+
+  if (state.clockSynced && schedule.count > 0) {
+    const auto now = rtc::offsetMillis();
+    const auto nowInWeek = weekMillis(now, state.weekOffsetMillis);
+
+    // first transition after now, wraps around to the start of the week
+    const auto next = std::upper_bound(
+      schedule.transitions,
+      schedule.transitions + schedule.count,
+      nowInWeek,
+      [](uint32_t millis, const Transition& transition) {
+        return millis < transitionMillis(transition);
+      });
+    state.nextIndex = static_cast<uint8_t>(
+      next == schedule.transitions + schedule.count ? 0 : next - schedule.transitions);
+
+    auto delta = (transitionMillis(schedule.transitions[state.nextIndex])
+                  + MILLIS_PER_WEEK - nowInWeek)
+      % MILLIS_PER_WEEK;
+    if (delta == 0) {
+      delta = MILLIS_PER_WEEK;
+    }
+    nextTransition = now + delta;
+
+    m_logger.log(
+      yal::Level::DEBUG,
+      "Next schedule transition % in % ms",
+      state.nextIndex,
+      delta);
+  }
+
+  rtc::setSchedule(state);
+  WakeScheduler::schedule(WakeScheduler::Task::SCHEDULE, nextTransition);
+}
+
+uint32_t open_heat::heating::Schedule::weekMillis(
+  const uint64_t offsetMillis,
+  const uint32_t weekOffset)
+{
+  return static_cast<uint32_t>((offsetMillis + weekOffset) % MILLIS_PER_WEEK);
+}
+
+uint32_t open_heat::heating::Schedule::transitionMillis(const Transition& transition)
+{
+  return static_cast<uint32_t>(transition.minuteOfWeek) * 60 * 1000;
+}
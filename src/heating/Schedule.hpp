@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_SCHEDULE_HPP
+#define OPEN_HEAT_SCHEDULE_HPP
+
+#include <Filesystem.hpp>
+#include <RTCMemory.hpp>
+#include <yal/yal.hpp>
+
+namespace open_heat::heating {
+
+/**
+ * Weekly heating schedule, applied on the device without a radio wake.
+ *
+ * The transitions are stored on the filesystem, sorted by the minute of the week.
+ * The index of the next transition is kept in rtc memory and its time is a task
+ * of the WakeScheduler, so checking whether a transition is due never touches the
+ * filesystem. The table is only read when a transition fires, when the schedule
+ * changes or when the clock was synchronized for the first time.
+ *
+ * The local time is taken from sntp while the radio is up anyway and is kept
+ * between syncs as an offset to rtc::offsetMillis().
+ */
+class Schedule {
+  public:
+  struct Transition {
+    // minutes since monday 00:00 local time
+    uint16_t minuteOfWeek;
+    // set temperature in 1/100 degree celsius
+    int16_t temperature;
+  };
+
+  explicit Schedule(Filesystem& filesystem);
+  Schedule(const Schedule&) = delete;
+
+  /**
+   * Parses and stores a schedule.
+   * Format: <minute of week>,<temperature>;... with minute 0 being monday 00:00,
+   * an empty payload or "off" clears the schedule.
+   * Nothing is written if the schedule did not change.
+   */
+  bool set(const String& payload);
+
+  /**
+   * Sets the POSIX timezone the schedule refers to, e.g. CET-1CEST,M3.5.0,M10.5.0/3
+   */
+  void setTimezone(const String& timezone);
+
+  /**
+   * Starts the sntp client, the radio must be up.
+   */
+  void startClockSync();
+
+  /**
+   * Takes the local time if sntp got an answer meanwhile.
+   */
+  void syncClock();
+
+  // offsetMillis() of the next transition, max if there is none
+  [[nodiscard]] static uint64_t nextTransitionMillis();
+  [[nodiscard]] static bool isDue();
+
+  /**
+   * Moves on to the next transition and returns the set temperature of the
+   * last one that is due. Transitions missed while sleeping are skipped.
+   * Returns 0 if there is nothing to apply.
+   */
+  float advance();
+
+  private:
+  struct PersistedSchedule {
+    char timezone[TIMEZONE_MAX_LEN];
+    uint8_t count;
+    Transition transitions[SCHEDULE_MAX_TRANSITIONS];
+  };
+
+  bool load(PersistedSchedule& schedule);
+  void persist(const PersistedSchedule& schedule);
+  void updateNextTransition(const PersistedSchedule& schedule);
+
+  [[nodiscard]] static uint32_t weekMillis(uint64_t offsetMillis, uint32_t weekOffset);
+  [[nodiscard]] static uint32_t transitionMillis(const Transition& transition);
+
+  static constexpr const char* scheduleFile_ = "/schedule.dat";
+  static constexpr const char* ntpServer_ = "pool.ntp.org";
+
+  static constexpr uint32_t MINUTES_PER_WEEK = 7 * 24 * 60;
+  static constexpr uint32_t MILLIS_PER_WEEK = MINUTES_PER_WEEK * 60 * 1000;
+
+  /**
+    Unix times before this are not set by sntp yet.
+    Unit: s
+  */
+  static constexpr time_t MIN_VALID_TIME = 1'600'000'000;
+
+  Filesystem& m_filesystem;
+  bool m_clockSyncStarted{false};
+  yal::Logger m_logger;
+};
+} // namespace open_heat::heating
+
+#endif // OPEN_HEAT_SCHEDULE_HPP
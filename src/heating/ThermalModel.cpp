@@ -0,0 +1,213 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "ThermalModel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// index of (row, column) in the packed upper triangle of a symmetric 3x3 matrix
+constexpr int packedIndex(int row, int column)
+{
+  return row <= column ? row * 3 - row * (row - 1) / 2 + column - row
+                       : packedIndex(column, row);
+}
+} // namespace
+
+open_heat::heating::ThermalModel::ThermalModel(Filesystem& filesystem) :
+    m_filesystem(filesystem), m_logger("MODEL")
+{
+}
+
+void open_heat::heating::ThermalModel::setup()
+{
+  auto state = rtc::get<&rtc::Memory::thermalModel>();
+  if (state.initialized) {
+    return;
+  }
+
+  PersistedModel persisted{};
+  if (m_filesystem.readFile(modelFile_, &persisted, sizeof(persisted))) {
+    std::copy(
+      std::begin(persisted.coefficients),
+      std::end(persisted.coefficients),
+      std::begin(state.coefficients));
+    state.updates = persisted.updates;
+    resetCovariance(state, RESTORED_VARIANCE);
+    m_logger.log(
+      yal::Level::INFO,
+      "Restored thermal model, gain: %, loss: %, offset: %",
+      state.coefficients[GAIN],
+      state.coefficients[LOSS],
+      state.coefficients[OFFSET]);
+  } else {
+    state.coefficients[GAIN] = DEFAULT_GAIN;
+    state.coefficients[LOSS] = DEFAULT_LOSS;
+    state.coefficients[OFFSET] = 0;
+    state.updates = 0;
+    resetCovariance(state, INITIAL_VARIANCE);
+    m_logger.log(yal::Level::INFO, "Starting with untrained thermal model");
+  }
+
+  state.lastUpdateMillis = 0;
+  state.lastUpdateTemp = 0;
+  state.initialized = true;
+  rtc::setThermalModel(state);
+}
+
+void open_heat::heating::ThermalModel::update(
+  const float temperature,
+  const float valveOpening)
+{
+  auto state = rtc::get<&rtc::Memory::thermalModel>();
+  const auto now = rtc::offsetMillis();
+  const auto lastUpdateMillis = state.lastUpdateMillis;
+  const auto previousTemperature = state.lastUpdateTemp;
+  state.lastUpdateMillis = now;
+  state.lastUpdateTemp = temperature;
+
+  if (
+    lastUpdateMillis == 0 || now <= lastUpdateMillis || previousTemperature == 0
+    || now - lastUpdateMillis < MIN_UPDATE_MILLIS
+    || now - lastUpdateMillis > MAX_UPDATE_MILLIS) {
+    // no usable previous measurement, start over from here
+    state.effectiveOpening = valveOpening;
+    rtc::setThermalModel(state);
+    return;
+  }
+
+  const auto hours = static_cast<float>(now - lastUpdateMillis) / (60 * 60 * 1000);
+  state.effectiveOpening += (valveOpening - state.effectiveOpening)
+    * (1 - std::exp(-hours / VALVE_LAG_HOURS));
+
+  const float regressors[3]
+    = {state.effectiveOpening, -(previousTemperature - REFERENCE_TEMP), 1};
+  const auto measuredRate = (temperature - previousTemperature) / hours;
+
+  auto& theta = state.coefficients;
+  const auto* covariance = state.covariance;
+
+  float predictedRate = 0;
+  float covarianceRegressors[3]{};
+  for (auto row = 0; row < 3; ++row) {
+    predictedRate += regressors[row] * theta[row];
+    for (auto column = 0; column < 3; ++column) {
+      covarianceRegressors[row]
+        += covariance[packedIndex(row, column)] * regressors[column];
+    }
+  }
+
+  const auto error = measuredRate - predictedRate;
+  if (std::abs(error) > MAX_RATE_ERROR) {
+    m_logger.log(
+      yal::Level::DEBUG, "Rate error % too large, not updating thermal model", error);
+    rtc::setThermalModel(state);
+    return;
+  }
+
+  // only forget if there is enough excitation, otherwise the covariance winds up
+  float trace = 0;
+  for (auto row = 0; row < 3; ++row) {
+    trace += covariance[packedIndex(row, row)];
+  }
+  const auto forgetting = trace < MAX_COVARIANCE_TRACE ? FORGETTING_FACTOR : 1.0F;
+
+  // the gain and the covariance update use the same forgetting factor
+  float denominator = forgetting;
+  for (auto row = 0; row < 3; ++row) {
+    denominator += regressors[row] * covarianceRegressors[row];
+  }
+
+  float newCovariance[6];
+  for (auto row = 0; row < 3; ++row) {
+    theta[row] += covarianceRegressors[row] / denominator * error;
+    for (auto column = row; column < 3; ++column) {
+      newCovariance[packedIndex(row, column)]
+        = (covariance[packedIndex(row, column)]
+           - covarianceRegressors[row] * covarianceRegressors[column] / denominator)
+        / forgetting;
+    }
+  }
+  std::copy(std::begin(newCovariance), std::end(newCovariance), state.covariance);
+
+  if (state.updates < std::numeric_limits<uint16_t>::max()) {
+    ++state.updates;
+  }
+
+  m_logger.log(
+    yal::Level::DEBUG,
+    "Thermal model update %: rate %, error %, gain %, loss %, offset %",
+    state.updates,
+    measuredRate,
+    error,
+    theta[GAIN],
+    theta[LOSS],
+    theta[OFFSET]);
+
+  rtc::setThermalModel(state);
+  if (state.updates % PERSIST_INTERVAL_UPDATES == 0) {
+    persist(state);
+  }
+}
+
+bool open_heat::heating::ThermalModel::isTrained()
+{
+  const auto state = rtc::get<&rtc::Memory::thermalModel>();
+  return state.initialized && state.updates >= MIN_TRAINING_UPDATES
+    && state.coefficients[GAIN] > MIN_GAIN && state.coefficients[LOSS] >= 0;
+}
+
+float open_heat::heating::ThermalModel::predict(
+  const float temperature,
+  const float valveOpening,
+  const unsigned long horizonMillis)
+{
+  const auto state = rtc::get<&rtc::Memory::thermalModel>();
+  const auto& theta = state.coefficients;
+  const auto hours = static_cast<float>(horizonMillis) / (60 * 60 * 1000);
+  const auto rate = theta[GAIN] * valveOpening
+    - theta[LOSS] * (temperature - REFERENCE_TEMP) + theta[OFFSET];
+  return temperature + rate * hours;
+}
+
+float open_heat::heating::ThermalModel::requiredOpening(
+  const float temperature,
+  const float targetTemperature,
+  const unsigned long horizonMillis)
+{
+  const auto state = rtc::get<&rtc::Memory::thermalModel>();
+  const auto& theta = state.coefficients;
+  const auto hours = static_cast<float>(horizonMillis) / (60 * 60 * 1000);
+  const auto targetRate = (targetTemperature - temperature) / hours;
+  const auto opening
+    = (targetRate + theta[LOSS] * (temperature - REFERENCE_TEMP) - theta[OFFSET])
+    / theta[GAIN];
+  return std::max(0.0F, std::min(1.0F, opening));
+}
+
+void open_heat::heating::ThermalModel::persist(const rtc::ThermalModelState& state)
+{
+  PersistedModel persisted{};
+  std::copy(
+    std::begin(state.coefficients),
+    std::end(state.coefficients),
+    std::begin(persisted.coefficients));
+  persisted.updates = state.updates;
+
+  if (m_filesystem.writeFile(modelFile_, &persisted, sizeof(persisted))) {
+    m_logger.log(yal::Level::DEBUG, "Thermal model saved");
+  }
+}
+
+void open_heat::heating::ThermalModel::resetCovariance(
+  rtc::ThermalModelState& state,
+  const float variance)
+{
+  std::fill(std::begin(state.covariance), std::end(state.covariance), 0.0F);
+  for (auto row = 0; row < 3; ++row) {
+    state.covariance[packedIndex(row, row)] = variance;
+  }
+}
@@ -0,0 +1,96 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_THERMALMODEL_HPP
+#define OPEN_HEAT_THERMALMODEL_HPP
+
+#include <Filesystem.hpp>
+#include <RTCMemory.hpp>
+#include <yal/yal.hpp>
+
+namespace open_heat::heating {
+
+/**
+ * Lumped thermal model of the room, learned online with recursive least squares:
+ *
+ *   dT/dt = gain * u - loss * (T - REFERENCE_TEMP) + offset
+ *
+ * dT/dt is the temperature change in degree per hour, T the measured temperature
+ * and u the valve opening (0..1) delayed by the valve lag.
+ * The state lives in rtc memory, the coefficients are persisted on the filesystem
+ * so they survive a power loss.
+ */
+class ThermalModel {
+  public:
+  explicit ThermalModel(Filesystem& filesystem);
+  ThermalModel(const ThermalModel&) = delete;
+
+  void setup();
+  void update(float temperature, float valveOpening);
+
+  [[nodiscard]] static bool isTrained();
+  [[nodiscard]] static float predict(
+    float temperature,
+    float valveOpening,
+    unsigned long horizonMillis);
+  [[nodiscard]] static float requiredOpening(
+    float temperature,
+    float targetTemperature,
+    unsigned long horizonMillis);
+
+  private:
+  struct PersistedModel {
+    float coefficients[3];
+    uint16_t updates;
+  };
+
+  void persist(const rtc::ThermalModelState& state);
+  static void resetCovariance(rtc::ThermalModelState& state, float variance);
+
+  enum Coefficient { GAIN, LOSS, OFFSET };
+
+  static constexpr const char* modelFile_ = "/thermal.dat";
+
+  /**
+    Temperature the loss rate refers to, keeps the regressors well conditioned.
+    Unit: degree celsius
+  */
+  static constexpr float REFERENCE_TEMP = 20;
+
+  /**
+    Time constant of the first order lag between valve and room.
+    Unit: hours
+  */
+  static constexpr float VALVE_LAG_HOURS = 0.3F;
+
+  /**
+    Weight of old measurements is multiplied by this for every update.
+    0.995 forgets with a time constant of about 17 hours at 5 minute checks.
+    Unit: 1
+  */
+  static constexpr float FORGETTING_FACTOR = 0.995F;
+
+  // Initial values for a new device, a radiator that heats 2 degree per hour
+  static constexpr float DEFAULT_GAIN = 2;
+  static constexpr float DEFAULT_LOSS = 0.2F;
+  static constexpr float INITIAL_VARIANCE = 100;
+  static constexpr float RESTORED_VARIANCE = 1;
+  static constexpr float MAX_COVARIANCE_TRACE = 1000;
+
+  // Changes above this are caused by open windows or sensor errors
+  static constexpr float MAX_RATE_ERROR = 3;
+
+  static constexpr float MIN_GAIN = 0.1F;
+  static constexpr uint16_t MIN_TRAINING_UPDATES = 24;
+  static constexpr uint16_t PERSIST_INTERVAL_UPDATES = 48;
+  static constexpr unsigned long MIN_UPDATE_MILLIS = 60 * 1000;
+  static constexpr unsigned long MAX_UPDATE_MILLIS = 60 * 60 * 1000;
+
+  Filesystem& m_filesystem;
+  yal::Logger m_logger;
+};
+} // namespace open_heat::heating
+
+#endif // OPEN_HEAT_THERMALMODEL_HPP
@@ -12,7 +12,9 @@
 #include <network/WifiManager.hpp>
 #include <sensors/Battery.hpp>
 
+#include "Profiler.hpp"
 #include "RTCMemory.hpp"
+#include "WakeScheduler.hpp"
 #include <sensors/BME280.hpp>
 #include <sensors/BMP280.hpp>
 #include <sensors/WindowSensor.hpp>
@@ -23,7 +25,7 @@
 // external voltage
 ADC_MODE(ADC_TOUT)
 
-DoubleResetDetector g_drd(DRD_TIMEOUT, DRD_ADDRESS);
+open_heat::hardware::DoubleResetDetector g_drd;
 
 open_heat::sensors::Temperature* g_tempSensor = nullptr;
 open_heat::sensors::Humidity* g_humidSensor = nullptr;
@@ -61,7 +63,7 @@ void setupPins()
   pinMode(LED_PIN, OUTPUT);
   digitalWrite(LED_PIN, LED_OFF);
 
-  const auto& config = g_filesystem.getConfig();
+  const auto& config = g_filesystem.getHardwareConfig();
   if (config.MotorPins.Vin > 1) {
     pinMode(static_cast<uint8_t>(config.MotorPins.Vin), OUTPUT);
     digitalWrite(static_cast<uint8_t>(config.MotorPins.Ground), LOW);
@@ -88,8 +90,9 @@ void setupPins()
 
 void setupTemperatureSensor()
 {
+  open_heat::Profiler::Scope profile(open_heat::Profiler::Phase::SENSOR);
   g_logger.log(yal::Level::DEBUG, "Running setupTemperatureSensor");
-  const auto& config = g_filesystem.getConfig();
+  const auto& config = g_filesystem.getHardwareConfig();
 
   open_heat::sensors::Sensor* sensor;
   if (config.TempSensor == BME) {
@@ -117,34 +120,8 @@ void setupTemperatureSensor()
 
 bool isDoubleReset()
 {
-  if (EspClass::getResetInfoPtr()->reason != REASON_EXT_SYS_RST) {
-    g_logger.log(
-      yal::Level::DEBUG,
-      "no double reset, resetInfo: %",
-      EspClass::getResetInfo().c_str());
-    open_heat::rtc::setDrdDisabled(true);
-    return false;
-  }
-
-  const auto drdDetected = g_drd.detectDoubleReset();
-
-  g_logger.log(yal::Level::DEBUG, "DRD detected: %", drdDetected);
-
-  const auto millisSinceReset
-    = open_heat::rtc::read().lastResetTime - open_heat::rtc::offsetMillis();
-
-  g_logger.log(
-    yal::Level::DEBUG,
-    "millis since reset: %, last reset time %, offset millis: %",
-    millisSinceReset,
-    open_heat::rtc::read().lastResetTime,
-    open_heat::rtc::offsetMillis());
-
-  const auto doubleReset = (drdDetected || millisSinceReset < 10 * 1000)
-    && !open_heat::rtc::read().drdDisabled;
-
-  open_heat::rtc::setDrdDisabled(doubleReset);
-  return doubleReset;
+  open_heat::Profiler::Scope profile(open_heat::Profiler::Phase::DOUBLE_RESET);
+  return g_drd.detect();
 }
 
 void setup()
@@ -153,24 +130,27 @@ void setup()
     g_serialAppender.begin(115200);
   }
 
-  const auto configValid = g_filesystem.setup();
-
-  if (EspClass::getResetInfoPtr()->reason == REASON_DEEP_SLEEP_AWAKE) {
-    g_logger.log(yal::Level::DEBUG, "woke up from deep sleep");
+  open_heat::rtc::setup();
+  const auto warmBoot = EspClass::getResetInfoPtr()->reason == REASON_DEEP_SLEEP_AWAKE
+    && open_heat::rtc::isValid();
 
-    if (!open_heat::rtc::read().drdDisabled) {
-      g_drd.stop();
-      open_heat::rtc::setDrdDisabled(true);
-    }
+  // the filesystem is mounted lazily if mqtt or the web server need it
+  bool configValid;
+  {
+    open_heat::Profiler::Scope profile(open_heat::Profiler::Phase::FILESYSTEM);
+    configValid = warmBoot ? g_filesystem.warmSetup() : g_filesystem.setup();
+  }
 
+  if (warmBoot) {
+    g_logger.log(yal::Level::DEBUG, "woke up from deep sleep");
   } else {
-    // system reset
+    // system reset or rtc memory corrupted
     open_heat::rtc::init(g_filesystem);
   }
 
-  const auto offsetMillis = open_heat::rtc::offsetMillis();
-  g_logger.log(yal::Level::DEBUG, "Set last reset time to %", offsetMillis);
-  open_heat::rtc::setLastResetTime(offsetMillis);
+  auto controlStats = open_heat::rtc::get<&open_heat::rtc::Memory::controlStats>();
+  ++controlStats.wakes;
+  open_heat::rtc::setControlStats(controlStats);
 
   setupPins();
   setupTemperatureSensor();
@@ -188,11 +168,12 @@ void setup()
     g_mqtt.enableDebug(true);
   }
 
-  if (open_heat::rtc::read().debug) {
+  if (open_heat::rtc::get<&open_heat::rtc::Memory::debug>()) {
     g_webServer.setup(nullptr);
   }
 
-  g_drd.stop();
+  open_heat::WakeScheduler::ready(
+    EspClass::getResetInfoPtr()->reason == REASON_DEEP_SLEEP_AWAKE);
   g_logger.log(yal::Level::INFO, "Device startup and setup done");
 
   loop();
@@ -201,14 +182,16 @@ void setup()
 void loop()
 {
   // open_heat::sensors::WindowSensor::loop();
-  const auto mqttSleep = g_mqtt.loop();
+  g_mqtt.loop();
 
   // must be after mqtt to process received commands
-  const auto valveSleep = g_valve.loop();
+  g_valve.loop();
   g_drd.loop();
 
   // do not sleep if debug is enabled.
-  if (open_heat::rtc::read().debug) {
+  if (open_heat::rtc::get<&open_heat::rtc::Memory::debug>()) {
+    // no deep sleep which would write back the rtc memory
+    open_heat::rtc::commit();
     delay(100);
     pinMode(LED_PIN, OUTPUT);
     digitalWrite(LED_PIN, LED_OFF);
@@ -217,33 +200,18 @@ void loop()
     return;
   }
 
-  const auto msg = "Sleep times: valveSleep: "
-    + std::to_string(valveSleep - open_heat::rtc::offsetMillis())
-    + ", mqttSleep: " + std::to_string(mqttSleep - open_heat::rtc::offsetMillis());
-  g_logger.log(yal::Level::DEBUG, msg.c_str());
-
-  const auto minSleepTime = 10000UL;
-  unsigned long idleTime;
-  unsigned long nextCheckMillis;
-  bool enableWifi = false;
-  if (valveSleep < mqttSleep) {
-    nextCheckMillis = valveSleep;
-  } else {
-    nextCheckMillis = mqttSleep;
-    enableWifi = true;
+  // the motor is switched off by a timer, keep the loop running until it is done
+  if (g_valve.isMotorRunning()) {
+    g_valve.waitForMotor();
+    return;
   }
 
-  if (nextCheckMillis < (open_heat::rtc::offsetMillis() + minSleepTime)) {
-    g_logger.log(
-      yal::Level::DEBUG,
-      "Minimal sleep or underflow prevented, sleep set to % ms",
-      minSleepTime);
-    idleTime = minSleepTime;
-  } else {
-    idleTime = nextCheckMillis - open_heat::rtc::offsetMillis();
-  }
+  const auto wake = open_heat::WakeScheduler::nextWake(WiFi.status() == WL_CONNECTED);
 
   // Wait before forcing sleep to send messages.
   delay(50);
-  open_heat::rtc::wifiDeepSleep(idleTime, enableWifi, g_filesystem);
+  g_mqtt.journalMessageQueue();
+  // a reset while sleeping is no double reset
+  g_drd.stop();
+  open_heat::WakeScheduler::sleep(wake, g_filesystem);
 }
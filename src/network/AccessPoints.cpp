@@ -0,0 +1,189 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "AccessPoints.hpp"
+#include <ESP8266WiFi.h>
+#include <RTCMemory.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+
+open_heat::network::AccessPoints::AccessPoints(Filesystem& filesystem) :
+    m_filesystem(filesystem), m_logger("ACCESS_POINTS")
+{
+}
+
+void open_heat::network::AccessPoints::load()
+{
+  if (
+    !m_filesystem.readFile(accessPointsFile_, &m_list, sizeof(m_list))
+    || m_list.count > ACCESS_POINTS_MAX) {
+    std::memset(&m_list, 0, sizeof(m_list));
+  }
+  m_modified = false;
+
+  const auto& credentials = m_filesystem.getConfig().WifiCredentials;
+  set(0, credentials.ssid, credentials.password);
+}
+
+void open_heat::network::AccessPoints::persist()
+{
+  if (!m_modified) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < m_list.count; ++i) {
+    auto& accessPoint = m_list.accessPoints[i];
+    accessPoint.failures = static_cast<uint16_t>(std::min<uint32_t>(
+      failures(i), std::numeric_limits<uint16_t>::max()));
+    rtc::setAccessPointFailures(i, 0);
+  }
+
+  removeEmpty();
+  if (m_filesystem.writeFile(accessPointsFile_, &m_list, sizeof(m_list))) {
+    m_logger.log(yal::Level::DEBUG, "% access points saved", m_list.count);
+  }
+  m_modified = false;
+}
+
+size_t open_heat::network::AccessPoints::size() const
+{
+  return m_list.count;
+}
+
+const open_heat::network::AccessPoints::AccessPoint&
+open_heat::network::AccessPoints::operator[](const size_t index) const
+{
+  return m_list.accessPoints[index];
+}
+
+std::vector<uint8_t> open_heat::network::AccessPoints::ranking() const
+{
+  std::vector<uint8_t> ranking;
+  for (uint8_t i = 0; i < m_list.count; ++i) {
+    if (m_list.accessPoints[i].ssid[0] != '\0' && m_list.accessPoints[i].channel != 0) {
+      ranking.push_back(i);
+    }
+  }
+
+  std::stable_sort(ranking.begin(), ranking.end(), [this](uint8_t lhs, uint8_t rhs) {
+    return m_list.accessPoints[lhs].rssi > m_list.accessPoints[rhs].rssi;
+  });
+  return ranking;
+}
+
+void open_heat::network::AccessPoints::updateFromScan(const int networksFound)
+{
+  for (uint8_t i = 0; i < m_list.count; ++i) {
+    auto& accessPoint = m_list.accessPoints[i];
+    int32_t bestRssi = std::numeric_limits<int8_t>::min();
+    int network = -1;
+    for (auto n = 0; n < networksFound; ++n) {
+      if (WiFi.SSID(n) == accessPoint.ssid && WiFi.RSSI(n) > bestRssi) {
+        bestRssi = WiFi.RSSI(n);
+        network = n;
+      }
+    }
+
+    // not in range, it is not tried without a scan until it is seen again
+    if (network < 0) {
+      if (accessPoint.channel != 0) {
+        accessPoint.channel = 0;
+        m_modified = true;
+      }
+      continue;
+    }
+
+    std::memcpy(accessPoint.bssid, WiFi.BSSID(network), sizeof(accessPoint.bssid));
+    accessPoint.channel = static_cast<uint8_t>(WiFi.channel(network));
+    accessPoint.rssi = static_cast<int8_t>(bestRssi);
+    m_modified = true;
+    m_logger.log(
+      yal::Level::DEBUG,
+      "Found % on channel %, rssi %",
+      accessPoint.ssid,
+      accessPoint.channel,
+      accessPoint.rssi);
+  }
+}
+
+void open_heat::network::AccessPoints::recordConnect(
+  const size_t index,
+  const uint32_t connectMillis)
+{
+  auto& accessPoint = m_list.accessPoints[index];
+  std::memcpy(accessPoint.bssid, WiFi.BSSID(), sizeof(accessPoint.bssid));
+  accessPoint.channel = static_cast<uint8_t>(WiFi.channel());
+  accessPoint.rssi = static_cast<int8_t>(WiFi.RSSI());
+
+  // halving both keeps the average
+  if (
+    accessPoint.connects == std::numeric_limits<uint16_t>::max()
+    || accessPoint.connectMillis > std::numeric_limits<uint32_t>::max() - connectMillis) {
+    accessPoint.connects /= 2;
+    accessPoint.connectMillis /= 2;
+  }
+  ++accessPoint.connects;
+  accessPoint.connectMillis += connectMillis;
+  m_modified = true;
+}
+
+void open_heat::network::AccessPoints::recordFailure(const size_t index)
+{
+  const auto failures = rtc::accessPointFailures(index);
+  if (failures < std::numeric_limits<uint8_t>::max()) {
+    rtc::setAccessPointFailures(index, static_cast<uint8_t>(failures + 1));
+  }
+}
+
+uint32_t open_heat::network::AccessPoints::failures(const size_t index) const
+{
+  return m_list.accessPoints[index].failures + rtc::accessPointFailures(index);
+}
+
+void open_heat::network::AccessPoints::set(
+  const size_t index,
+  const char* const ssid,
+  const char* const password)
+{
+  if (index >= ACCESS_POINTS_MAX) {
+    return;
+  }
+
+  if (index >= m_list.count) {
+    for (auto i = m_list.count; i <= index; ++i) {
+      m_list.accessPoints[i] = {};
+    }
+    m_list.count = static_cast<uint8_t>(index + 1);
+    m_modified = true;
+  }
+
+  auto& accessPoint = m_list.accessPoints[index];
+  if (std::strncmp(accessPoint.ssid, ssid, sizeof(accessPoint.ssid)) != 0) {
+    // another access point, its statistics do not apply
+    accessPoint = {};
+    rtc::setAccessPointFailures(index, 0);
+    std::strncpy(accessPoint.ssid, ssid, sizeof(accessPoint.ssid) - 1);
+    m_modified = true;
+  }
+
+  if (std::strncmp(accessPoint.password, password, sizeof(accessPoint.password)) != 0) {
+    std::memset(accessPoint.password, 0, sizeof(accessPoint.password));
+    std::strncpy(accessPoint.password, password, sizeof(accessPoint.password) - 1);
+    m_modified = true;
+  }
+}
+
+void open_heat::network::AccessPoints::removeEmpty()
+{
+  // the first entry is the one of the config and is kept
+  const auto end = std::remove_if(
+    m_list.accessPoints + 1,
+    m_list.accessPoints + m_list.count,
+    [](const AccessPoint& accessPoint) { return accessPoint.ssid[0] == '\0'; });
+  m_list.count = static_cast<uint8_t>(std::max<ptrdiff_t>(1, end - m_list.accessPoints));
+  std::fill(end, m_list.accessPoints + ACCESS_POINTS_MAX, AccessPoint{});
+}
@@ -0,0 +1,94 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_ACCESSPOINTS_HPP
+#define OPEN_HEAT_ACCESSPOINTS_HPP
+
+#include <Config.hpp>
+#include <Filesystem.hpp>
+#include <yal/yal.hpp>
+#include <vector>
+
+namespace open_heat::network {
+
+/**
+ * Credentials of up to ACCESS_POINTS_MAX access points with the bssid, channel and
+ * rssi they were last seen with and connect statistics.
+ *
+ * The first entry always holds the credentials of the config, the others are
+ * added in the config portal. The list is stored on the filesystem and only
+ * needed if the association cached in rtc memory fails, see WifiManager.
+ */
+class AccessPoints {
+  public:
+  struct AccessPoint {
+    char ssid[SSID_MAX_LEN];
+    char password[PASS_MAX_LEN];
+    uint8_t bssid[6];
+    // 0 if the access point was not seen yet
+    uint8_t channel;
+    // last seen signal strength in dBm, 0 if unknown
+    int8_t rssi;
+    uint16_t connects;
+    // persisted failures, see failures()
+    uint16_t failures;
+    // total time until connected of the connects
+    uint32_t connectMillis;
+  };
+
+  explicit AccessPoints(Filesystem& filesystem);
+  AccessPoints(const AccessPoints&) = delete;
+
+  /**
+   * Loads the list and takes over the credentials of the config.
+   */
+  void load();
+
+  /**
+   * Writes the list if it was modified since it was loaded. The failures
+   * counted in rtc memory meanwhile are added then.
+   */
+  void persist();
+
+  [[nodiscard]] size_t size() const;
+  [[nodiscard]] const AccessPoint& operator[](size_t index) const;
+
+  // Indices of the access points seen before, strongest last seen rssi first
+  [[nodiscard]] std::vector<uint8_t> ranking() const;
+
+  // Takes bssid, channel and rssi of the strongest access point per ssid
+  void updateFromScan(int networksFound);
+
+  void recordConnect(size_t index, uint32_t connectMillis);
+  // Counted in rtc memory, a failure alone does not modify the list
+  static void recordFailure(size_t index);
+  // Failed connects including the ones not persisted yet
+  [[nodiscard]] uint32_t failures(size_t index) const;
+
+  /**
+   * Sets the credentials of an additional access point, index 0 is the one of
+   * the config. An empty ssid removes the access point.
+   */
+  void set(size_t index, const char* ssid, const char* password);
+
+  private:
+  struct PersistedAccessPoints {
+    uint8_t count;
+    AccessPoint accessPoints[ACCESS_POINTS_MAX];
+  };
+
+  void removeEmpty();
+
+  static constexpr const char* accessPointsFile_ = "/accesspoints.dat";
+
+  Filesystem& m_filesystem;
+  PersistedAccessPoints m_list{};
+  bool m_modified{false};
+  yal::Logger m_logger;
+};
+
+} // namespace open_heat::network
+
+#endif // OPEN_HEAT_ACCESSPOINTS_HPP
@@ -0,0 +1,156 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "Journal.hpp"
+#include <RTCMemory.hpp>
+
+namespace {
+uint32_t nowSeconds()
+{
+  return static_cast<uint32_t>(open_heat::rtc::offsetMillis() / 1000);
+}
+} // namespace
+
+open_heat::network::Journal::Journal(Filesystem& filesystem) :
+    m_filesystem(filesystem), m_logger("JOURNAL")
+{
+}
+
+void open_heat::network::Journal::append(const std::vector<Entry>& entries)
+{
+  if (entries.empty()) {
+    return;
+  }
+
+  const auto seconds = String(nowSeconds());
+  String data;
+  for (const auto& entry : entries) {
+    String line = seconds;
+    line += ',';
+    line += entry.topic;
+    line += ',';
+    line += entry.message;
+    if (line.length() > ENTRY_MAX_SIZE) {
+      line.remove(ENTRY_MAX_SIZE);
+    }
+    // one entry per line
+    line.replace('\n', ' ');
+    data += line;
+    data += '\n';
+  }
+
+  auto file = m_filesystem.openFile(newerSegment_, "a");
+  if (file && file.size() + data.length() > SEGMENT_SIZE) {
+    file.close();
+    m_logger.log(yal::Level::WARNING, "Journal full, dropping the oldest entries");
+    m_filesystem.removeFile(olderSegment_);
+    m_filesystem.renameFile(newerSegment_, olderSegment_);
+    file = m_filesystem.openFile(newerSegment_, "a");
+  }
+
+  if (!file) {
+    m_logger.log(yal::Level::ERROR, "Failed to open %", newerSegment_);
+    return;
+  }
+
+  const auto written
+    = file.write(reinterpret_cast<const uint8_t*>(data.c_str()), data.length());
+  file.close();
+  m_logger.log(
+    yal::Level::DEBUG, "Journaled % entries, % bytes", entries.size(), written);
+}
+
+bool open_heat::network::Journal::replay(
+  const std::function<bool(const String&)>& publish)
+{
+  const auto seconds = nowSeconds();
+  return replaySegment(olderSegment_, seconds, publish)
+    && replaySegment(newerSegment_, seconds, publish);
+}
+
+bool open_heat::network::Journal::replaySegment(
+  const char* const path,
+  const uint32_t seconds,
+  const std::function<bool(const String&)>& publish)
+{
+  auto file = m_filesystem.openFile(path, "r");
+  if (!file) {
+    return true;
+  }
+
+  String batch;
+  batch.reserve(BATCH_MAX_SIZE);
+  size_t entries = 0;
+  // bytes of the segment which were published or dropped
+  size_t replayed = 0;
+  size_t read = 0;
+  while (file.available() > 0) {
+    const auto line = file.readStringUntil('\n');
+    const auto lineStart = read;
+    read += line.length() + 1;
+    const auto separator = line.indexOf(',');
+    const auto time = static_cast<uint32_t>(line.substring(0, separator).toInt());
+    if (separator <= 0 || time > seconds) {
+      continue;
+    }
+
+    String entry(seconds - time);
+    entry += line.substring(separator);
+    if (!batch.isEmpty() && batch.length() + entry.length() + 1 > BATCH_MAX_SIZE) {
+      if (!publish(batch)) {
+        file.close();
+        dropReplayed(path, replayed);
+        return false;
+      }
+      replayed = lineStart;
+      batch = String();
+    }
+
+    if (!batch.isEmpty()) {
+      batch += '\n';
+    }
+    batch += entry;
+    ++entries;
+  }
+  file.close();
+
+  if (!batch.isEmpty() && !publish(batch)) {
+    dropReplayed(path, replayed);
+    return false;
+  }
+
+  m_logger.log(yal::Level::INFO, "Replayed % journal entries of %", entries, path);
+  m_filesystem.removeFile(path);
+  return true;
+}
+
+void open_heat::network::Journal::dropReplayed(const char* const path, const size_t bytes)
+{
+  if (bytes == 0) {
+    return;
+  }
+
+  // copied in chunks, a segment does not fit into the heap next to the batch
+  auto source = m_filesystem.openFile(path, "r");
+  auto remaining = m_filesystem.openFile(remainingSegment_, "w");
+  if (!source || !remaining || !source.seek(bytes)) {
+    m_logger.log(yal::Level::ERROR, "Failed to drop the replayed entries of %", path);
+    source.close();
+    remaining.close();
+    return;
+  }
+
+  char chunk[128];
+  while (source.available() > 0) {
+    const auto size = source.readBytes(chunk, sizeof(chunk));
+    remaining.write(reinterpret_cast<const uint8_t*>(chunk), size);
+  }
+  source.close();
+  remaining.close();
+
+  m_filesystem.removeFile(path);
+  m_filesystem.renameFile(remainingSegment_, path);
+  m_logger.log(yal::Level::DEBUG, "Dropped % replayed bytes of %", bytes, path);
+}
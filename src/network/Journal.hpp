@@ -0,0 +1,85 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_JOURNAL_HPP
+#define OPEN_HEAT_JOURNAL_HPP
+
+#include <Config.hpp>
+#include <Filesystem.hpp>
+#include <yal/yal.hpp>
+#include <functional>
+#include <vector>
+
+namespace open_heat::network {
+
+/**
+ * Messages which could not be published, kept on the filesystem until the
+ * broker is reachable again.
+ *
+ * Entries are appended as text lines `<offsetMillis() in seconds>,<topic>,<message>`
+ * to the newer of two segment files, all entries of a wake with one write.
+ * If it is full it replaces the older segment, which drops the oldest entries
+ * and bounds the journal to two segments.
+ */
+class Journal {
+  public:
+  struct Entry {
+    // relative to the configured topic
+    String topic;
+    String message;
+  };
+
+  /**
+    Size of a segment, the journal takes at most two
+    Unit: bytes
+  */
+  static constexpr size_t SEGMENT_SIZE = 8 * 1024;
+
+  /**
+    Longer messages are truncated
+    Unit: bytes
+  */
+  static constexpr size_t ENTRY_MAX_SIZE = 256;
+
+  /**
+    Payload of a replayed batch, leaves room for topic and packet header
+    Unit: bytes
+  */
+  static constexpr size_t BATCH_MAX_SIZE = MQTT_BUFFER_SIZE - MQTT_TOPIC_MAX_SIZE - 32;
+
+  explicit Journal(Filesystem& filesystem);
+  Journal(const Journal&) = delete;
+
+  void append(const std::vector<Entry>& entries);
+
+  /**
+   * Publishes the entries oldest first in batches of lines
+   * `<age in seconds>,<topic>,<message>`. A segment is removed once all of its
+   * batches were published. If a publish fails, the entries of the batches
+   * published before are removed from the segment, the others are sent next time.
+   * Entries with a time after now were written before the rtc memory was
+   * initialized, they are dropped as their age is unknown.
+   */
+  bool replay(const std::function<bool(const String&)>& publish);
+
+  private:
+  bool replaySegment(
+    const char* path,
+    uint32_t seconds,
+    const std::function<bool(const String&)>& publish);
+  // removes the first bytes of a segment
+  void dropReplayed(const char* path, size_t bytes);
+
+  static constexpr const char* olderSegment_ = "/journal0.txt";
+  static constexpr const char* newerSegment_ = "/journal1.txt";
+  static constexpr const char* remainingSegment_ = "/journal.tmp";
+
+  Filesystem& m_filesystem;
+  yal::Logger m_logger;
+};
+
+} // namespace open_heat::network
+
+#endif // OPEN_HEAT_JOURNAL_HPP
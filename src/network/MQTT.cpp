@@ -4,80 +4,134 @@
 //
 
 #include "MQTT.hpp"
+#include "MqttSession.hpp"
+#include "RadioBackoff.hpp"
+#include "RadioPolicy.hpp"
+#include "StateMessage.hpp"
+#include "TelemetryFilter.hpp"
+#include <Profiler.hpp>
 #include <RTCMemory.hpp>
+#include <WakeScheduler.hpp>
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 
+namespace {
+int32_t hundredths(const float value)
+{
+  return static_cast<int32_t>(std::lround(value * 100));
+}
+} // namespace
+
 void open_heat::network::MQTT::setup()
 {
   m_logger.log(yal::Level::INFO, "Running MQTT setup");
   m_mqttClient.onMessage(
     [this](String& topic, String& payload) { messageReceivedCallback(topic, payload); });
 
+  // the state message of the wake contains mode and target temperature
   m_valve.registerModeChangedHandler([this](OperationMode mode) {
-    m_mqttAppender.queue().push(
-      {m_getModeTopic, heating::RadiatorValve::modeToCharArray(mode)});
+    if (m_filesystem.getConfig().MQTT.LegacyTopics) {
+      m_mqttAppender.queue().push(
+        {m_getModeTopic, heating::RadiatorValve::modeToCharArray(mode)});
+    }
   });
 
   m_valve.registerSetTempChangedHandler([this](float temp) {
-    m_mqttAppender.queue().push({m_getConfiguredTempTopic, String(temp)});
+    if (m_filesystem.getConfig().MQTT.LegacyTopics) {
+      m_mqttAppender.queue().push({m_getConfiguredTempTopic, String(temp)});
+    }
   });
 
   m_valve.registerWindowChangeHandler([this](bool state) {
     m_mqttAppender.queue().push({m_windowStateTopic, String(static_cast<int>(state))});
   });
+
+  // the queued messages need their topics before the first connect
+  setupTopics();
 }
 
 bool open_heat::network::MQTT::needLoop()
 {
-  return rtc::offsetMillis() >= rtc::read().mqttNextCheckMillis;
+  return WakeScheduler::isDue(WakeScheduler::Task::MQTT);
 }
 
-uint64_t open_heat::network::MQTT::loop()
+void open_heat::network::MQTT::loop()
 {
   if (!m_configValid) {
     m_logger.log(yal::Level::ERROR, "Config is not valid, no mqtt loop!");
     enableDebug(true);
-    return 0UL;
+    return;
   }
 
   if (!needLoop()) {
-    return rtc::read().mqttNextCheckMillis;
+    return;
   }
 
-  m_wifi.checkWifi();
-  if (!m_mqttClient.connected()) {
-    connect();
+  if (!m_wifi.checkWifi() || (!m_mqttClient.connected() && !connect())) {
+    RadioPolicy::failed();
+    journalWake();
+    // the valve keeps being checked without radio meanwhile
+    const auto delay = RadioBackoff::failed(rtc::get<&rtc::Memory::modemSleepTime>());
+    m_logger.log(
+      yal::Level::WARNING,
+      "Radio unreachable % times in a row, next attempt in % ms",
+      rtc::get<&rtc::Memory::radioFailures>(),
+      delay);
+    WakeScheduler::schedule(
+      WakeScheduler::Task::MQTT,
+      rtc::offsetMillis() + delay,
+      delay / MODEM_SLEEP_SLACK_DIVISOR);
+    return;
   }
+  RadioBackoff::succeeded();
+
+  // sntp answers while the messages are sent
+  m_valve.schedule().startClockSync();
 
   m_mqttClient.loop();
 
   // drain message queue for old messages
   sendMessageQueue();
-
-  if (m_humiditySensor != nullptr) {
-    publish(m_getMeasuredHumidTopic, String(m_humiditySensor->humidity()));
+  m_journal.replay(
+    [this](const String& batch) { return publish(m_journalTopic, batch); });
+
+  // decided before the state is published, which restarts the heartbeat
+  const auto& telemetry = m_filesystem.getConfig().Telemetry;
+  const auto last = rtc::get<&rtc::Memory::publishedState>();
+  const auto seconds = static_cast<uint32_t>(rtc::offsetMillis() / 1000);
+  const auto debug = rtc::get<&rtc::Memory::debug>();
+  if (TelemetryFilter::historyDue(last, telemetry, seconds, debug, rtc::historySize())) {
+    publishHistory();
   }
-  if (m_tempSensor != nullptr) {
-    publish(m_getMeasuredTempTopic, String(m_tempSensor->temperature()));
+  if (TelemetryFilter::statsDue(last, telemetry, seconds, debug)) {
+    publishControlStats();
+    publishSleepStats();
+    publishWakeProfiles();
+    publishWifiStats();
+    publishRadioState();
+    publishAccessPoints();
   }
 
-  publish(m_getModemSleepTopic, String(rtc::read().modemSleepTime));
-
-  m_battery.loop();
-  publish(m_getBatteryTopic + "percent", String(m_battery.percentage()));
-  publish(m_getBatteryTopic + "voltage", String(m_battery.voltage()));
+  {
+    Profiler::Scope profile(Profiler::Phase::BATTERY);
+    m_battery.loop();
+  }
+  RadioPolicy::setSupplyVoltage(m_battery.voltage());
 
-  publish(m_getConfiguredTempTopic, String(rtc::read().setTemp));
-  publish(m_getModeTopic, String(rtc::read().mode));
+  publishState();
 
   // drain message queue for new messages
   sendMessageQueue();
 
-  rtc::setMqttNextCheckMillis(rtc::offsetMillis() + rtc::read().modemSleepTime);
+  m_valve.schedule().syncClock();
+  const auto modemSleepTime = rtc::get<&rtc::Memory::modemSleepTime>();
+  WakeScheduler::schedule(
+    WakeScheduler::Task::MQTT,
+    rtc::offsetMillis() + modemSleepTime,
+    modemSleepTime / MODEM_SLEEP_SLACK_DIVISOR);
 
   m_mqttClient.loop();
-
-  return rtc::read().mqttNextCheckMillis;
 }
 
 void open_heat::network::MQTT::messageReceivedCallback(String& topic, String& payload)
@@ -92,6 +146,16 @@ void open_heat::network::MQTT::messageReceivedCallback(String& topic, String& pa
     handleSetMode(payload);
   } else if (topic == m_setModemSleepTopic) {
     handleSetModemSleep(payload);
+  } else if (topic == m_setMinCheckIntervalTopic) {
+    handleSetCheckInterval(payload, false);
+  } else if (topic == m_setMaxCheckIntervalTopic) {
+    handleSetCheckInterval(payload, true);
+  } else if (topic == m_setAdaptiveCheckIntervalTopic) {
+    handleSetAdaptiveCheckInterval(payload);
+  } else if (topic == m_setScheduleTopic) {
+    m_valve.schedule().set(payload);
+  } else if (topic == m_setTimezoneTopic) {
+    m_valve.schedule().setTimezone(payload);
   } else if (topic == m_debugEnableTopic) {
     handleDebug(payload);
   } else if (topic == m_debugLogLevelTopic) {
@@ -151,7 +215,7 @@ void open_heat::network::MQTT::handleSetModemSleep(const String& payload)
     return;
   }
 
-  if (newTime == rtc::read().modemSleepTime) {
+  if (newTime == rtc::get<&rtc::Memory::modemSleepTime>()) {
     return;
   }
 
@@ -159,17 +223,410 @@ void open_heat::network::MQTT::handleSetModemSleep(const String& payload)
   m_logger.log(yal::Level::INFO, "Set new modem sleep time %", newTime);
 }
 
-void open_heat::network::MQTT::publish(const String& topic, const String& message)
+void open_heat::network::MQTT::handleSetCheckInterval(
+  const String& payload,
+  const bool isMax)
+{
+  const auto newTime = std::strtoul(payload.c_str(), nullptr, 10);
+  if (newTime == 0) {
+    return;
+  }
+
+  const auto rtcData = rtc::read();
+  if (
+    (isMax && newTime < rtcData.minCheckIntervalMillis)
+    || (!isMax && newTime > rtcData.maxCheckIntervalMillis)) {
+    m_logger.log(
+      yal::Level::WARNING,
+      "Check interval % outside of min % and max %",
+      newTime,
+      rtcData.minCheckIntervalMillis,
+      rtcData.maxCheckIntervalMillis);
+    return;
+  }
+
+  if (isMax) {
+    rtc::setMaxCheckIntervalMillis(newTime);
+  } else {
+    rtc::setMinCheckIntervalMillis(newTime);
+  }
+
+  rtc::setCheckIntervalMillis(std::max(
+    rtc::get<&rtc::Memory::minCheckIntervalMillis>(),
+    std::min(
+      rtc::get<&rtc::Memory::maxCheckIntervalMillis>(), rtcData.checkIntervalMillis)));
+  m_logger.log(yal::Level::INFO, "Set new check interval limit %", newTime);
+}
+
+void open_heat::network::MQTT::handleSetAdaptiveCheckInterval(const String& payload)
+{
+  const auto adaptive = payload == "true";
+  rtc::setAdaptiveCheckInterval(adaptive);
+  if (!adaptive) {
+    rtc::setCheckIntervalMillis(rtc::get<&rtc::Memory::minCheckIntervalMillis>());
+  }
+
+  m_logger.log(yal::Level::INFO, "Adaptive check interval %", adaptive);
+}
+
+bool open_heat::network::MQTT::publish(const String& topic, const String& message)
 {
   m_logger.log(
     yal::Level::DEBUG, "MQTT send '%' in topic '%'", message.c_str(), topic.c_str());
   if (!m_mqttClient.publish(topic, message)) {
     m_logger.log(yal::Level::ERROR, "MQTT publish failed: %", m_mqttClient.lastError());
+    RadioPolicy::failed();
+    return false;
+  }
+
+  return true;
+}
+
+bool open_heat::network::MQTT::publish(const String& topic, const StateMessage& message)
+{
+  m_logger.log(
+    yal::Level::DEBUG, "MQTT send % bytes in topic '%'", message.size(), topic.c_str());
+  if (message.overflow()) {
+    m_logger.log(
+      yal::Level::ERROR, "MQTT message exceeds % bytes", StateMessage::MAX_SIZE);
+    return false;
+  }
+
+  if (!m_mqttClient.publish(
+        topic.c_str(), message.data(), static_cast<int>(message.size()), false, 0)) {
+    m_logger.log(yal::Level::ERROR, "MQTT publish failed: %", m_mqttClient.lastError());
+    RadioPolicy::failed();
+    return false;
   }
+
+  return true;
 }
 
-void open_heat::network::MQTT::connect()
+void open_heat::network::MQTT::publishState()
 {
+  const auto& config = m_filesystem.getConfig();
+  const auto current = currentState();
+  const auto last = rtc::get<&rtc::Memory::publishedState>();
+  const auto seconds = static_cast<uint32_t>(rtc::offsetMillis() / 1000);
+  const auto metrics = TelemetryFilter::due(last, current, config.Telemetry, seconds);
+  if (metrics == 0) {
+    m_logger.log(yal::Level::DEBUG, "State within the deadbands, nothing published");
+    return;
+  }
+
+  // the state message always contains all values
+  auto published = publish(m_stateTopic, stateMessage(current, config.MQTT.Format));
+  if (config.MQTT.LegacyTopics) {
+    published &= publishLegacyState(current, metrics);
+  }
+
+  // not published values are sent again on the next wake
+  if (published) {
+    rtc::setPublishedState(TelemetryFilter::published(last, current, metrics, seconds));
+  }
+}
+
+open_heat::network::StateMessage open_heat::network::MQTT::stateMessage(
+  const rtc::PublishedState& state,
+  const StateFormat format) const
+{
+  // temperatures and humidity in 1/100, battery voltage in mV, times in ms
+  StateMessage message(format);
+  if (m_tempSensor != nullptr) {
+    message.add("temp", state.temp);
+  }
+  if (m_humiditySensor != nullptr) {
+    message.add("humidity", state.humidity);
+  }
+  message.add("target", state.target);
+  message.add(
+    "mode",
+    heating::RadiatorValve::modeToCharArray(static_cast<OperationMode>(state.mode)));
+  message.add("valve", state.valve);
+  message.add("battery", state.battery);
+  message.add("voltage", state.millivolts);
+  message.add("sleep", static_cast<int32_t>(state.modemSleepMillis));
+  message.add("check", static_cast<int32_t>(state.checkIntervalMillis));
+  message.finish();
+  return message;
+}
+
+void open_heat::network::MQTT::journalWake()
+{
+  {
+    Profiler::Scope profile(Profiler::Phase::BATTERY);
+    m_battery.loop();
+  }
+
+  // the journal is text, so the state is always json
+  const auto message = stateMessage(currentState(), STATE_JSON);
+  String state;
+  state.concat(message.data(), message.size());
+
+  std::vector<Journal::Entry> entries{{"state", state}};
+  takeMessageQueue(entries, true);
+  m_journal.append(entries);
+}
+
+void open_heat::network::MQTT::journalMessageQueue()
+{
+  std::vector<Journal::Entry> entries;
+  takeMessageQueue(entries, false);
+  m_journal.append(entries);
+}
+
+void open_heat::network::MQTT::takeMessageQueue(
+  std::vector<Journal::Entry>& entries,
+  const bool withLog)
+{
+  const auto first = entries.size();
+  auto& queue = m_mqttAppender.queue();
+  for (; !queue.empty(); queue.pop()) {
+    const auto& msg = queue.front();
+    const auto isLog = msg.topic == m_logTopic || msg.topic == s_logTopic;
+    if (!isLog || withLog) {
+      entries.push_back({msg.topic, msg.message});
+    }
+  }
+
+  // the config is only loaded if there is something to journal
+  if (entries.size() == first) {
+    return;
+  }
+
+  const String baseTopic = m_filesystem.getConfig().MQTT.Topic;
+  for (auto i = first; i < entries.size(); ++i) {
+    auto& topic = entries[i].topic;
+    if (topic.startsWith(baseTopic)) {
+      topic = topic.substring(baseTopic.length());
+    }
+  }
+}
+
+bool open_heat::network::MQTT::publishLegacyState(
+  const rtc::PublishedState& state,
+  const uint16_t metrics)
+{
+  const auto isDue = [metrics](TelemetryFilter::Metric metric) {
+    return (metrics & metric) != 0;
+  };
+  const auto fromHundredths = [](int32_t value) {
+    return String(static_cast<float>(value) / 100);
+  };
+
+  bool published = true;
+  if (m_humiditySensor != nullptr && isDue(TelemetryFilter::HUMIDITY)) {
+    published &= publish(m_getMeasuredHumidTopic, fromHundredths(state.humidity));
+  }
+  if (m_tempSensor != nullptr && isDue(TelemetryFilter::TEMP)) {
+    published &= publish(m_getMeasuredTempTopic, fromHundredths(state.temp));
+  }
+
+  if (isDue(TelemetryFilter::MODEM_SLEEP)) {
+    published &= publish(m_getModemSleepTopic, String(state.modemSleepMillis));
+  }
+  if (isDue(TelemetryFilter::CHECK_INTERVAL)) {
+    published &= publish(m_getCheckIntervalTopic, String(state.checkIntervalMillis));
+  }
+
+  if (isDue(TelemetryFilter::BATTERY)) {
+    published &= publish(m_getBatteryTopic + "percent", String(m_battery.percentage()));
+    published &= publish(m_getBatteryTopic + "voltage", String(m_battery.voltage()));
+  }
+
+  if (isDue(TelemetryFilter::TARGET)) {
+    published &= publish(m_getConfiguredTempTopic, fromHundredths(state.target));
+  }
+  if (isDue(TelemetryFilter::MODE)) {
+    published &= publish(m_getModeTopic, String(state.mode));
+  }
+  if (isDue(TelemetryFilter::VALVE)) {
+    published &= publish(m_getValvePositionTopic, String(state.valve));
+  }
+  return published;
+}
+
+open_heat::rtc::PublishedState open_heat::network::MQTT::currentState()
+{
+  const auto memory = rtc::read();
+  rtc::PublishedState state{};
+  if (m_tempSensor != nullptr) {
+    state.temp = static_cast<int16_t>(hundredths(m_tempSensor->temperature()));
+  }
+  if (m_humiditySensor != nullptr) {
+    state.humidity = static_cast<uint16_t>(hundredths(m_humiditySensor->humidity()));
+  }
+  state.target = static_cast<int16_t>(hundredths(memory.setTemp));
+  state.mode = static_cast<uint8_t>(memory.mode);
+  state.valve = heating::RadiatorValve::position();
+  state.battery = static_cast<uint8_t>(std::lround(m_battery.percentage()));
+  state.millivolts = static_cast<uint16_t>(std::lround(m_battery.voltage() * 1000));
+  state.modemSleepMillis = memory.modemSleepTime;
+  state.checkIntervalMillis = memory.checkIntervalMillis;
+  return state;
+}
+
+void open_heat::network::MQTT::publishHistory()
+{
+  const auto size = rtc::historySize();
+  if (size == 0) {
+    return;
+  }
+
+  // leave room for topic and packet header
+  static constexpr unsigned int maxPayloadSize
+    = MQTT_BUFFER_SIZE - MQTT_TOPIC_MAX_SIZE - 32;
+
+  // Newest sample first, one entry per sample:
+  // <age in seconds>,<temperature in 1/100 degree>,<valve position in percent>;
+  auto age = static_cast<unsigned long>(
+    (rtc::offsetMillis() - rtc::historyNewestMillis()) / 1000);
+  auto published = true;
+  String payload;
+  payload.reserve(maxPayloadSize);
+  for (size_t i = 0; i < size; ++i) {
+    const auto sample = rtc::historySample(i);
+    String entry(age);
+    entry += ',';
+    entry += String(sample.temperature);
+    entry += ',';
+    entry += String(sample.valvePosition);
+    entry += ';';
+
+    if (payload.length() + entry.length() > maxPayloadSize) {
+      published &= publish(m_getTempHistoryTopic, payload);
+      payload = "";
+    }
+
+    payload += entry;
+    age += static_cast<unsigned long>(sample.timeDelta)
+      * rtc::HISTORY_TIME_RESOLUTION_SECONDS;
+  }
+
+  published &= publish(m_getTempHistoryTopic, payload);
+  if (published) {
+    rtc::clearHistory();
+  }
+}
+
+void open_heat::network::MQTT::publishControlStats()
+{
+  // <wakes>,<motor on ms>,<settling time in seconds>,<overshoot in 1/100 degree>
+  const auto stats = rtc::get<&rtc::Memory::controlStats>();
+  String payload(stats.wakes);
+  payload += ',';
+  payload += String(stats.motorOnMillis);
+  payload += ',';
+  payload += String(stats.settlingSeconds);
+  payload += ',';
+  payload += String(static_cast<long>(std::lround(stats.overshoot * 100)));
+  publish(m_getStatsTopic, payload);
+}
+
+void open_heat::network::MQTT::publishSleepStats()
+{
+  // <deep sleeps>,<light sleeps>,<ready ms after deep sleep without radio>,
+  // <ready ms after deep sleep with radio>,<ready ms after light sleep>
+  const auto stats = rtc::get<&rtc::Memory::sleepStats>();
+  String payload(stats.deepSleeps);
+  payload += ',';
+  payload += String(stats.lightSleeps);
+  payload += ',';
+  payload += String(stats.deepReadyMillis[0]);
+  payload += ',';
+  payload += String(stats.deepReadyMillis[1]);
+  payload += ',';
+  payload += String(stats.lightReadyMillis);
+  publish(m_getSleepStatsTopic, payload);
+}
+
+void open_heat::network::MQTT::publishWifiStats()
+{
+  // <fast connects>,<average fast connect ms>,<scan connects>,<average scan connect ms>
+  const auto stats = rtc::get<&rtc::Memory::wifiStats>();
+  const auto average = [](uint32_t total, uint16_t count) {
+    return count == 0 ? 0 : total / count;
+  };
+  String payload(stats.fastConnects);
+  payload += ',';
+  payload += String(average(stats.fastConnectMillis, stats.fastConnects));
+  payload += ',';
+  payload += String(stats.scanConnects);
+  payload += ',';
+  payload += String(average(stats.scanConnectMillis, stats.scanConnects));
+  publish(m_getWifiStatsTopic, payload);
+}
+
+void open_heat::network::MQTT::publishRadioState()
+{
+  // <average rssi>,<tx power in dBm>,<hours since the last rf calibration>
+  const auto state = rtc::get<&rtc::Memory::radioState>();
+  const auto seconds = static_cast<uint32_t>(rtc::offsetMillis() / 1000);
+  String payload(static_cast<int>(state.averageRssi));
+  payload += ',';
+  payload += String(RadioPolicy::txPower());
+  payload += ',';
+  payload += String((seconds - state.calibrationSeconds) / (60 * 60));
+  publish(m_getRadioStatsTopic, payload);
+}
+
+void open_heat::network::MQTT::publishAccessPoints()
+{
+  const auto& accessPoints = m_wifi.accessPoints();
+  if (accessPoints.size() == 0) {
+    return;
+  }
+
+  // One entry per access point:
+  // <ssid>,<last rssi>,<connects>,<average connect ms>,<failures>;
+  String payload;
+  for (size_t i = 0; i < accessPoints.size(); ++i) {
+    const auto& accessPoint = accessPoints[i];
+    payload += accessPoint.ssid;
+    payload += ',';
+    payload += String(static_cast<int>(accessPoint.rssi));
+    payload += ',';
+    payload += String(accessPoint.connects);
+    payload += ',';
+    payload += String(
+      accessPoint.connects == 0 ? 0 : accessPoint.connectMillis / accessPoint.connects);
+    payload += ',';
+    payload += String(accessPoints.failures(i));
+    payload += ';';
+  }
+  publish(m_getAccessPointsTopic, payload);
+}
+
+void open_heat::network::MQTT::publishWakeProfiles()
+{
+  const auto profiles = rtc::get<&rtc::Memory::wakeProfiles>();
+  if (profiles.count == 0) {
+    return;
+  }
+
+  // Newest wake first, one entry per wake:
+  // <filesystem>,<sensor>,<double reset>,<wifi>,<mqtt>,<battery>,<awake>;
+  // all times in ms
+  String payload;
+  for (size_t i = 0; i < profiles.count; ++i) {
+    const auto& wake = profiles.wakes
+      [(profiles.head + rtc::PROFILE_WAKES - 1 - i) % rtc::PROFILE_WAKES];
+    for (const auto phaseMillis : wake.phaseMillis) {
+      payload += String(phaseMillis);
+      payload += ',';
+    }
+    payload += String(wake.awakeMillis);
+    payload += ';';
+  }
+
+  if (publish(m_getProfileTopic, payload)) {
+    Profiler::clear();
+  }
+}
+
+bool open_heat::network::MQTT::connect()
+{
+  Profiler::Scope profile(Profiler::Phase::MQTT);
   const auto& config = m_filesystem.getConfig();
   if ((std::strlen(config.MQTT.Server) == 0 || config.MQTT.Port == 0)) {
     if (m_configValid) {
@@ -182,11 +639,16 @@ void open_heat::network::MQTT::connect()
     }
 
     m_configValid = false;
-    return;
+    return false;
   }
 
   m_mqttClient.setTimeout(
     static_cast<int>(std::chrono::milliseconds(std::chrono::seconds(1)).count()));
+  // the session has to survive a light sleep
+  m_mqttClient.setKeepAlive(KEEP_ALIVE_SECONDS);
+
+  // the broker keeps subscriptions and queued commands while the device sleeps
+  m_mqttClient.setCleanSession(false);
 
   m_mqttClient.begin(config.MQTT.Server, config.MQTT.Port, m_wifiClient);
   const char* username = nullptr;
@@ -207,9 +669,34 @@ void open_heat::network::MQTT::connect()
       config.MQTT.Server,
       config.MQTT.Username,
       config.MQTT.Password);
-    return;
+    return false;
+  }
+
+  const auto sessionPresent = m_mqttClient.sessionPresent();
+  if (!m_topicsSetup) {
+    setupTopics();
+  }
+
+  // the broker keeps the subscriptions and queues qos 1 commands for the session
+  const auto subscriptions
+    = MqttSession::subscriptionsCrc(config.Hostname, subscriptionTopics());
+  if (!MqttSession::needsSubscribe(sessionPresent, subscriptions)) {
+    m_logger.log(yal::Level::DEBUG, "MQTT session resumed");
+    return true;
   }
 
+  m_logger.log(yal::Level::INFO, "MQTT session not present, subscribing");
+  bool subscribed = true;
+  for (const auto* topic : subscriptionTopics()) {
+    subscribed &= subscribe(*topic);
+  }
+  MqttSession::subscribed(subscriptions, subscribed);
+  return true;
+}
+
+void open_heat::network::MQTT::setupTopics()
+{
+  const auto& config = m_filesystem.getConfig();
   setTopic(config.MQTT.Topic, "log", m_logTopic);
 
   m_logger.log(
@@ -218,57 +705,90 @@ void open_heat::network::MQTT::connect()
     config.MQTT.Topic,
     std::strlen(config.MQTT.Topic));
 
+  setTopic(config.MQTT.Topic, "state", m_stateTopic);
+  setTopic(config.MQTT.Topic, "journal", m_journalTopic);
   setTopic(config.MQTT.Topic, "temperature/target/get", m_getConfiguredTempTopic);
   setTopic(config.MQTT.Topic, "temperature/target/set", m_setConfiguredTempTopic);
   setTopic(config.MQTT.Topic, "temperature/measured/get", m_getMeasuredTempTopic);
+  setTopic(config.MQTT.Topic, "temperature/history", m_getTempHistoryTopic);
+  setTopic(config.MQTT.Topic, "stats", m_getStatsTopic);
+  setTopic(config.MQTT.Topic, "stats/sleep", m_getSleepStatsTopic);
+  setTopic(config.MQTT.Topic, "stats/profile", m_getProfileTopic);
+  setTopic(config.MQTT.Topic, "stats/wifi", m_getWifiStatsTopic);
+  setTopic(config.MQTT.Topic, "stats/radio", m_getRadioStatsTopic);
+  setTopic(config.MQTT.Topic, "stats/wifi/accesspoints", m_getAccessPointsTopic);
   setTopic(config.MQTT.Topic, "humidity/measured/get", m_getMeasuredHumidTopic);
+  setTopic(config.MQTT.Topic, "valve/position/get", m_getValvePositionTopic);
   setTopic(config.MQTT.Topic, "modemsleep/set", m_setModemSleepTopic);
   setTopic(config.MQTT.Topic, "modemsleep/get", m_getModemSleepTopic);
+  setTopic(config.MQTT.Topic, "checkinterval/get", m_getCheckIntervalTopic);
+  setTopic(config.MQTT.Topic, "checkinterval/min/set", m_setMinCheckIntervalTopic);
+  setTopic(config.MQTT.Topic, "checkinterval/max/set", m_setMaxCheckIntervalTopic);
+  setTopic(
+    config.MQTT.Topic, "checkinterval/adaptive/set", m_setAdaptiveCheckIntervalTopic);
+  setTopic(config.MQTT.Topic, "schedule/set", m_setScheduleTopic);
+  setTopic(config.MQTT.Topic, "schedule/timezone/set", m_setTimezoneTopic);
   setTopic(config.MQTT.Topic, "battery/", m_getBatteryTopic);
   setTopic(config.MQTT.Topic, "mode/get", m_getModeTopic);
   setTopic(config.MQTT.Topic, "mode/set", m_setModeTopic);
   setTopic(config.MQTT.Topic, "debug/enable", m_debugEnableTopic);
 
-  subscribe(m_debugEnableTopic);
-  subscribe(m_setModeTopic);
-  subscribe(m_setModemSleepTopic);
-  subscribe(m_setConfiguredTempTopic);
-
   if (DISABLE_ALL_LOGGING) {
     m_logger.setLevel(yal::Level::OFF);
   } else {
     setTopic(config.MQTT.Topic, "debug/loglevel", m_debugLogLevelTopic);
-    subscribe(m_debugLogLevelTopic);
   }
 
   if (config.WindowPins.Ground > 0 && config.WindowPins.Vin > 0) {
     setTopic(config.MQTT.Topic, "window/get", m_windowStateTopic);
-    subscribe(m_windowStateTopic);
   }
+
+  m_topicsSetup = true;
 }
 
-void open_heat::network::MQTT::subscribe(const String& topic)
+std::vector<const String*> open_heat::network::MQTT::subscriptionTopics() const
 {
-  if (m_mqttClient.subscribe(topic)) {
+  std::vector<const String*> topics = {
+    &m_debugEnableTopic,
+    &m_setModeTopic,
+    &m_setModemSleepTopic,
+    &m_setMinCheckIntervalTopic,
+    &m_setMaxCheckIntervalTopic,
+    &m_setAdaptiveCheckIntervalTopic,
+    &m_setConfiguredTempTopic,
+    &m_setScheduleTopic,
+    &m_setTimezoneTopic};
+
+  if (!m_debugLogLevelTopic.isEmpty()) {
+    topics.push_back(&m_debugLogLevelTopic);
+  }
+  if (!m_windowStateTopic.isEmpty()) {
+    topics.push_back(&m_windowStateTopic);
+  }
+  return topics;
+}
+
+bool open_heat::network::MQTT::subscribe(const String& topic)
+{
+  if (m_mqttClient.subscribe(topic, SUBSCRIBE_QOS)) {
     m_logger.log(yal::Level::INFO, "MQTT subscribed to topic: %", topic.c_str());
-  } else {
-    m_logger.log(
-      yal::Level::ERROR, "MQTT failed to subscribe to topic: %", topic.c_str());
-    m_logger.log(
-      yal::Level::ERROR,
-      "MQTT last error: %",
-      static_cast<int>(m_mqttClient.lastError()));
+    return true;
   }
+
+  m_logger.log(yal::Level::ERROR, "MQTT failed to subscribe to topic: %", topic.c_str());
+  m_logger.log(
+    yal::Level::ERROR, "MQTT last error: %", static_cast<int>(m_mqttClient.lastError()));
+  return false;
 }
 
 void open_heat::network::MQTT::enableDebug(bool value)
 {
-  if (rtc::read().debug == value) {
+  if (rtc::get<&rtc::Memory::debug>() == value) {
     return;
   }
 
   rtc::setDebug(value);
-  open_heat::rtc::wifiDeepSleep(1, value, m_filesystem);
+  open_heat::rtc::wifiDeepSleep(1, RadioPolicy::sleepMode(value), m_filesystem);
 }
 
 void open_heat::network::MQTT::sendMessageQueue()
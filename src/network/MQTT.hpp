@@ -6,9 +6,12 @@
 #ifndef OPEN_EQIVA_MQTT_CUH
 #define OPEN_EQIVA_MQTT_CUH
 
+#include "Journal.hpp"
+#include "StateMessage.hpp"
 #include "WifiManager.hpp"
 #include <Filesystem.hpp>
 #include <MQTT.h>
+#include <RTCMemory.hpp>
 #include <heating/RadiatorValve.hpp>
 #include <sensors/Battery.hpp>
 #include <sensors/Humidity.hpp>
@@ -17,6 +20,7 @@
 #include <yal/yal.hpp>
 #include <chrono>
 #include <queue>
+#include <vector>
 
 namespace open_heat::network {
 class MQTT {
@@ -34,6 +38,7 @@ class MQTT {
       m_battery(battery),
       m_filesystem(filesystem),
       m_valve(valve),
+      m_journal(filesystem),
       m_logger(yal::Logger("MQTT")),
       m_mqttAppender(yal::appender::ArduinoMQTT<MQTTClient>(
         &m_logger,
@@ -50,23 +55,71 @@ class MQTT {
 
   void setup();
   bool needLoop();
-  uint64_t loop();
+  void loop();
 
   void enableDebug(bool value);
 
+  /**
+   * Keeps queued messages which were not sent in the journal, they would be
+   * lost with the next deep sleep. Log messages are dropped.
+   */
+  void journalMessageQueue();
+
   private:
-  void connect();
-  void publish(const String& topic, const String& message);
+  bool connect();
+  bool publish(const String& topic, const String& message);
+  bool publish(const String& topic, const StateMessage& message);
+  void publishState();
+  bool publishLegacyState(const rtc::PublishedState& state, uint16_t metrics);
+  rtc::PublishedState currentState();
+  [[nodiscard]] StateMessage stateMessage(
+    const rtc::PublishedState& state,
+    StateFormat format) const;
+  // Keeps the state and the queued messages of a wake without connection
+  void journalWake();
+  void takeMessageQueue(std::vector<Journal::Entry>& entries, bool withLog);
+  void publishHistory();
+  void publishControlStats();
+  void publishSleepStats();
+  void publishWakeProfiles();
+  void publishWifiStats();
+  void publishRadioState();
+  void publishAccessPoints();
   void messageReceivedCallback(String& topic, String& payload);
 
   void handleSetConfigTemp(const String& payload);
   void handleSetMode(const String& payload);
   void handleDebug(const String& payload);
-  void subscribe(const String& topic);
+  bool subscribe(const String& topic);
+  void setupTopics();
+  // topics of the commands, window/get is subscribed for historical reasons
+  [[nodiscard]] std::vector<const String*> subscriptionTopics() const;
   void handleLogLevel(const String& payload);
   static void setTopic(const String& baseTopic, const String& subTopic, String& out);
   void sendMessageQueue();
   void handleSetModemSleep(const String& payload);
+  void handleSetCheckInterval(const String& payload, bool isMax);
+  void handleSetAdaptiveCheckInterval(const String& payload);
+
+  /**
+    Messages may be sent up to modemSleepTime / MODEM_SLEEP_SLACK_DIVISOR early
+    to share the wake with a valve check.
+    Unit: 1
+  */
+  static constexpr unsigned long MODEM_SLEEP_SLACK_DIVISOR = 5;
+
+  /**
+    Longer than the longest light sleep, so the broker keeps the session.
+    Unit: s
+  */
+  static constexpr int KEEP_ALIVE_SECONDS = 300;
+
+  /**
+    Commands sent with qos 1 while the device sleeps are queued by the broker
+    and delivered on the next connect.
+    Unit: 1
+  */
+  static constexpr int SUBSCRIBE_QOS = 1;
 
   WifiManager& m_wifi;
 
@@ -75,10 +128,13 @@ class MQTT {
   sensors::Battery& m_battery;
   Filesystem& m_filesystem;
   heating::RadiatorValve& m_valve;
+  Journal m_journal;
 
-  MQTTClient m_mqttClient;
+  MQTTClient m_mqttClient{MQTT_BUFFER_SIZE};
 
   // Topics
+  String m_stateTopic;
+  String m_journalTopic;
   String m_getModeTopic;
   String m_setModeTopic;
 
@@ -86,12 +142,28 @@ class MQTT {
   String m_getConfiguredTempTopic;
 
   String m_getMeasuredTempTopic;
+  String m_getTempHistoryTopic;
+  String m_getStatsTopic;
+  String m_getSleepStatsTopic;
+  String m_getProfileTopic;
+  String m_getWifiStatsTopic;
+  String m_getRadioStatsTopic;
+  String m_getAccessPointsTopic;
   String m_getMeasuredHumidTopic;
+  String m_getValvePositionTopic;
   String m_getBatteryTopic;
 
   String m_setModemSleepTopic;
   String m_getModemSleepTopic;
 
+  String m_getCheckIntervalTopic;
+  String m_setMinCheckIntervalTopic;
+  String m_setMaxCheckIntervalTopic;
+  String m_setAdaptiveCheckIntervalTopic;
+
+  String m_setScheduleTopic;
+  String m_setTimezoneTopic;
+
   String m_debugEnableTopic;
   String m_debugLogLevelTopic;
 
@@ -107,6 +179,7 @@ class MQTT {
   WiFiClient m_wifiClient;
 
   bool m_configValid{true};
+  bool m_topicsSetup{false};
 
   yal::Logger m_logger;
   yal::appender::ArduinoMQTT<MQTTClient> m_mqttAppender;
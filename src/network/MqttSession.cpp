@@ -0,0 +1,36 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "MqttSession.hpp"
+#include <Crc32.hpp>
+#include <RTCMemory.hpp>
+#include <cstring>
+
+uint32_t open_heat::network::MqttSession::subscriptionsCrc(
+  const char* const clientId,
+  const std::vector<const String*>& topics)
+{
+  auto crc = crc32(clientId, std::strlen(clientId));
+  for (const auto* topic : topics) {
+    // including the terminator separates the topics
+    crc = crc32(topic->c_str(), topic->length() + 1, crc);
+  }
+  return crc;
+}
+
+bool open_heat::network::MqttSession::needsSubscribe(
+  const bool sessionPresent,
+  const uint32_t subscriptions)
+{
+  return !sessionPresent
+    || rtc::get<&rtc::Memory::mqttSubscriptionsCrc>() != subscriptions;
+}
+
+void open_heat::network::MqttSession::subscribed(
+  const uint32_t subscriptions,
+  const bool succeeded)
+{
+  rtc::setMqttSubscriptionsCrc(succeeded ? subscriptions : 0);
+}
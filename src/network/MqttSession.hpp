@@ -0,0 +1,37 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_MQTTSESSION_HPP
+#define OPEN_HEAT_MQTTSESSION_HPP
+
+#include <Arduino.h>
+#include <cstdint>
+#include <vector>
+
+namespace open_heat::network {
+
+/**
+ * Subscriptions of the persistent mqtt session. The broker keeps them and queues
+ * qos 1 commands while the device sleeps. A crc over the client id and the
+ * subscribed topics is kept in rtc memory, the topics are only subscribed again
+ * if the broker has no session or the crc changed.
+ */
+class MqttSession {
+  public:
+  // the session belongs to the client id, a new one has no subscriptions
+  static uint32_t subscriptionsCrc(
+    const char* clientId,
+    const std::vector<const String*>& topics);
+
+  // If the topics of the given crc have to be subscribed after a connect
+  static bool needsSubscribe(bool sessionPresent, uint32_t subscriptions);
+
+  // A failed subscription is retried with the next connect
+  static void subscribed(uint32_t subscriptions, bool succeeded);
+};
+
+} // namespace open_heat::network
+
+#endif // OPEN_HEAT_MQTTSESSION_HPP
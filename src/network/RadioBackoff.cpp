@@ -0,0 +1,31 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "RadioBackoff.hpp"
+#include <RTCMemory.hpp>
+#include <limits>
+
+namespace {
+// valve checks between two radio wakes are kept in the rtc history
+static_assert(
+  open_heat::network::RadioBackoff::MAX_BACKOFF_MILLIS
+    / open_heat::rtc::Memory{}.minCheckIntervalMillis
+  <= open_heat::rtc::HISTORY_MIN_SAMPLES);
+} // namespace
+
+uint64_t open_heat::network::RadioBackoff::failed(const uint64_t interval)
+{
+  auto failures = rtc::get<&rtc::Memory::radioFailures>();
+  if (failures < std::numeric_limits<uint8_t>::max()) {
+    ++failures;
+    rtc::setRadioFailures(failures);
+  }
+  return delayMillis(interval, failures);
+}
+
+void open_heat::network::RadioBackoff::succeeded()
+{
+  rtc::setRadioFailures(0);
+}
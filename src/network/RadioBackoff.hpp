@@ -0,0 +1,70 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_RADIOBACKOFF_HPP
+#define OPEN_HEAT_RADIOBACKOFF_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace open_heat::network {
+
+/**
+ * Exponential backoff of the radio wakes while the access point or the broker
+ * is unreachable. The consecutive failures are counted in rtc memory, so the
+ * backoff continues across deep sleeps. The valve is checked without radio
+ * in the meantime.
+ */
+class RadioBackoff {
+  public:
+  /**
+    Upper bound of the time between two attempts, unless the interval is longer
+    Unit: ms
+  */
+  static constexpr uint64_t MAX_BACKOFF_MILLIS = 2 * 60 * 60 * 1000;
+
+  /**
+    Radio time a wake may spend on connect attempts to the access points
+    Unit: ms
+  */
+  static constexpr unsigned long CONNECT_BUDGET_MILLIS = 10'000;
+
+  /**
+    While backing off only every this many failures a scan looks for access
+    points which moved to another channel, the other wakes only try the known ones.
+    Unit: 1
+  */
+  static constexpr uint8_t SCAN_FAILURES = 4;
+
+  /**
+   * Time until the next attempt after the given number of consecutive failures.
+   * Doubles with every failure, starting at the regular interval.
+   */
+  static constexpr uint64_t delayMillis(const uint64_t interval, const uint8_t failures)
+  {
+    const auto ceiling = std::max(interval, MAX_BACKOFF_MILLIS);
+    auto delay = interval;
+    for (uint8_t i = 0; i < failures && delay < ceiling; ++i) {
+      delay *= 2;
+    }
+    return std::min(delay, ceiling);
+  }
+
+  // If a wake after the given number of consecutive failures may scan
+  static constexpr bool scanAllowed(const uint8_t failures)
+  {
+    return failures % SCAN_FAILURES == 0
+      || failures == std::numeric_limits<uint8_t>::max();
+  }
+
+  // Counts a failed attempt and returns the time until the next one
+  static uint64_t failed(uint64_t interval);
+  static void succeeded();
+};
+
+} // namespace open_heat::network
+
+#endif // OPEN_HEAT_RADIOBACKOFF_HPP
@@ -0,0 +1,73 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include "RadioPolicy.hpp"
+#include <ESP8266WiFi.h>
+#include <cmath>
+#include <limits>
+
+void open_heat::network::RadioPolicy::apply()
+{
+  WiFi.setOutputPower(txPower());
+}
+
+void open_heat::network::RadioPolicy::connected(const int32_t rssi)
+{
+  // the sdk reports 31 if it has no rssi
+  if (rssi >= 0 || rssi < std::numeric_limits<int8_t>::min()) {
+    return;
+  }
+
+  auto state = rtc::get<&rtc::Memory::radioState>();
+  const auto sample = static_cast<int8_t>(rssi);
+  state.averageRssi = averageRssi(state.averageRssi, sample);
+  state.txPowerReduction
+    = txPowerReduction(state.txPowerReduction, state.averageRssi, sample);
+  rtc::setRadioState(state);
+}
+
+void open_heat::network::RadioPolicy::failed()
+{
+  auto state = rtc::get<&rtc::Memory::radioState>();
+  state.txPowerReduction = 0;
+  state.calibrated = false;
+  rtc::setRadioState(state);
+  WiFi.setOutputPower(txPower());
+}
+
+void open_heat::network::RadioPolicy::setSupplyVoltage(const float voltage)
+{
+  auto state = rtc::get<&rtc::Memory::radioState>();
+  state.millivolts = static_cast<uint16_t>(std::lround(voltage * 1000));
+  rtc::setRadioState(state);
+}
+
+RFMode open_heat::network::RadioPolicy::sleepMode(const bool enableRF)
+{
+  if (!enableRF) {
+    return RF_DISABLED;
+  }
+
+  const auto memory = rtc::read();
+  auto state = memory.radioState;
+  const auto temp = static_cast<int8_t>(std::lround(memory.lastMeasuredTemp));
+  const auto seconds = static_cast<uint32_t>(rtc::offsetMillis() / 1000);
+  if (!needsCalibration(state, temp, seconds)) {
+    return RF_NO_CAL;
+  }
+
+  state.calibrated = true;
+  state.calibrationTemp = temp;
+  state.calibrationMillivolts = state.millivolts;
+  state.calibrationSeconds = seconds;
+  rtc::setRadioState(state);
+  return RF_CAL;
+}
+
+float open_heat::network::RadioPolicy::txPower()
+{
+  const auto reduction = rtc::get<&rtc::Memory::radioState>().txPowerReduction;
+  return static_cast<float>(MAX_TX_POWER - reduction) / 4;
+}
@@ -0,0 +1,140 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_RADIOPOLICY_HPP
+#define OPEN_HEAT_RADIOPOLICY_HPP
+
+#include <RTCMemory.hpp>
+#include <Esp.h>
+#include <algorithm>
+#include <cstdint>
+
+namespace open_heat::network {
+
+/**
+ * Transmit power and rf calibration based on the state in rtc memory.
+ *
+ * The link is assumed to be symmetric, so the margin of the rssi after
+ * connecting above TARGET_RSSI is taken off the transmit power of the next
+ * connects. A weak connect or a failed link restores the full power at once.
+ *
+ * Deep sleeps with radio only request RF_CAL if the temperature or the supply
+ * voltage changed since the last calibration, it is too old or the link failed.
+ */
+class RadioPolicy {
+  public:
+  /**
+    Transmit power of the sdk and upper bound
+    Unit: 1/4 dBm
+  */
+  static constexpr uint8_t MAX_TX_POWER = 82;
+
+  /**
+    Lower bound of the transmit power
+    Unit: 1/4 dBm
+  */
+  static constexpr uint8_t MIN_TX_POWER = 40;
+
+  /**
+    Largest reduction of the transmit power per connect
+    Unit: 1/4 dB
+  */
+  static constexpr uint8_t TX_POWER_STEP = 8;
+
+  /**
+    Signal strength which is enough for a reliable link
+    Unit: dBm
+  */
+  static constexpr int8_t TARGET_RSSI = -70;
+
+  /**
+    Margin above TARGET_RSSI which is kept when the power is reduced
+    Unit: dB
+  */
+  static constexpr int8_t RSSI_MARGIN = 8;
+
+  /**
+    Temperature change which requires a new calibration
+    Unit: degree celsius
+  */
+  static constexpr int8_t CALIBRATION_TEMP_DELTA = 10;
+
+  /**
+    Supply voltage change which requires a new calibration
+    Unit: mV
+  */
+  static constexpr uint16_t CALIBRATION_MILLIVOLTS_DELTA = 200;
+
+  /**
+    Maximum time between two calibrations
+    Unit: s
+  */
+  static constexpr uint32_t CALIBRATION_INTERVAL_SECONDS = 24 * 60 * 60;
+
+  // Moving average with a weight of 1/4 for the new sample
+  static constexpr int8_t averageRssi(const int8_t average, const int8_t rssi)
+  {
+    if (average == 0) {
+      return rssi;
+    }
+    return static_cast<int8_t>(average + (rssi - average) / 4);
+  }
+
+  /**
+   * Reduction of the transmit power after a connect with the given rssi.
+   * The weaker one of average and rssi counts, so a single weak connect
+   * raises the power at once while it is only lowered step by step.
+   */
+  static constexpr uint8_t txPowerReduction(
+    const uint8_t reduction,
+    const int8_t average,
+    const int8_t rssi)
+  {
+    const int margin = std::min(average, rssi) - (TARGET_RSSI + RSSI_MARGIN);
+    const auto target = std::clamp(margin * 4, 0, MAX_TX_POWER - MIN_TX_POWER);
+    return static_cast<uint8_t>(std::min(target, reduction + TX_POWER_STEP));
+  }
+
+  static constexpr bool needsCalibration(
+    const rtc::RadioState& state,
+    const int8_t temp,
+    const uint32_t seconds)
+  {
+    const auto distance = [](const int lhs, const int rhs) {
+      return lhs > rhs ? lhs - rhs : rhs - lhs;
+    };
+    const auto voltageKnown = state.calibrationMillivolts != 0 && state.millivolts != 0;
+    return !state.calibrated
+      || distance(temp, state.calibrationTemp) >= CALIBRATION_TEMP_DELTA
+      || (voltageKnown
+          && distance(state.millivolts, state.calibrationMillivolts)
+            >= CALIBRATION_MILLIVOLTS_DELTA)
+      || seconds - state.calibrationSeconds >= CALIBRATION_INTERVAL_SECONDS;
+  }
+
+  // Sets the transmit power before connecting
+  static void apply();
+
+  // Adapts the transmit power of the next connects to the rssi after a connect
+  static void connected(int32_t rssi);
+
+  // Full transmit power and a calibration for the next attempts
+  static void failed();
+
+  static void setSupplyVoltage(float voltage);
+
+  /**
+   * Mode of the next deep sleep, the conditions are recorded
+   * if a calibration is requested.
+   */
+  static RFMode sleepMode(bool enableRF);
+
+  // Transmit power of the next connect in dBm
+  static float txPower();
+};
+
+} // namespace open_heat::network
+
+#endif // OPEN_HEAT_RADIOPOLICY_HPP
@@ -0,0 +1,167 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_STATEMESSAGE_HPP
+#define OPEN_HEAT_STATEMESSAGE_HPP
+
+#include <Config.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace open_heat::network {
+
+/**
+ * Flat document of named integers and strings, encoded as json object or as
+ * cbor map (RFC 8949). Fractional values are sent as fixed point integers,
+ * so the encoding does not depend on float formatting and is constexpr.
+ */
+class StateMessage {
+  public:
+  static constexpr size_t MAX_SIZE = 192;
+
+  constexpr explicit StateMessage(const StateFormat format) : m_format(format)
+  {
+    // indefinite length map, the number of fields is not known in advance
+    append(m_format == STATE_CBOR ? CBOR_MAP_START : '{');
+  }
+
+  constexpr void add(const char* const key, const int32_t value)
+  {
+    addKey(key);
+    if (m_format == STATE_CBOR) {
+      if (value < 0) {
+        appendCborHeader(CBOR_NEGATIVE, static_cast<uint32_t>(-(value + 1)));
+      } else {
+        appendCborHeader(CBOR_UNSIGNED, static_cast<uint32_t>(value));
+      }
+      return;
+    }
+
+    if (value < 0) {
+      append('-');
+    }
+    appendDecimal(value < 0 ? 0U - static_cast<uint32_t>(value) : value);
+  }
+
+  constexpr void add(const char* const key, const char* const value)
+  {
+    addKey(key);
+    appendString(value);
+  }
+
+  // Closes the document, nothing can be added afterwards
+  constexpr void finish()
+  {
+    append(m_format == STATE_CBOR ? CBOR_BREAK : '}');
+  }
+
+  [[nodiscard]] constexpr const char* data() const
+  {
+    return m_buffer.data();
+  }
+
+  [[nodiscard]] constexpr size_t size() const
+  {
+    return m_size;
+  }
+
+  // True if a field did not fit into MAX_SIZE, the document must not be sent
+  [[nodiscard]] constexpr bool overflow() const
+  {
+    return m_overflow;
+  }
+
+  private:
+  static constexpr uint8_t CBOR_UNSIGNED = 0;
+  static constexpr uint8_t CBOR_NEGATIVE = 1;
+  static constexpr uint8_t CBOR_TEXT = 3;
+  static constexpr char CBOR_MAP_START = static_cast<char>(0xBF);
+  static constexpr char CBOR_BREAK = static_cast<char>(0xFF);
+
+  constexpr void append(const char value)
+  {
+    if (m_size == MAX_SIZE) {
+      m_overflow = true;
+      return;
+    }
+    m_buffer[m_size++] = value;
+  }
+
+  constexpr void appendCborHeader(const uint8_t majorType, const uint32_t argument)
+  {
+    const auto type = static_cast<uint8_t>(majorType << 5);
+    size_t bytes = 0;
+    if (argument < 24) {
+      append(static_cast<char>(type | argument));
+    } else if (argument <= 0xFF) {
+      append(static_cast<char>(type | 24));
+      bytes = 1;
+    } else if (argument <= 0xFFFF) {
+      append(static_cast<char>(type | 25));
+      bytes = 2;
+    } else {
+      append(static_cast<char>(type | 26));
+      bytes = 4;
+    }
+
+    // big endian
+    for (auto i = bytes; i > 0; --i) {
+      append(static_cast<char>((argument >> ((i - 1) * 8)) & 0xFF));
+    }
+  }
+
+  constexpr void appendDecimal(const uint32_t value)
+  {
+    uint32_t divisor = 1;
+    while (value / divisor >= 10) {
+      divisor *= 10;
+    }
+    for (; divisor > 0; divisor /= 10) {
+      append(static_cast<char>('0' + value / divisor % 10));
+    }
+  }
+
+  // keys and values are plain ascii, nothing is escaped
+  constexpr void appendString(const char* const value)
+  {
+    size_t length = 0;
+    while (value[length] != '\0') {
+      ++length;
+    }
+
+    if (m_format == STATE_CBOR) {
+      appendCborHeader(CBOR_TEXT, static_cast<uint32_t>(length));
+    } else {
+      append('"');
+    }
+    for (size_t i = 0; i < length; ++i) {
+      append(value[i]);
+    }
+    if (m_format == STATE_JSON) {
+      append('"');
+    }
+  }
+
+  constexpr void addKey(const char* const key)
+  {
+    if (m_format == STATE_JSON && m_size > 1) {
+      append(',');
+    }
+    appendString(key);
+    if (m_format == STATE_JSON) {
+      append(':');
+    }
+  }
+
+  StateFormat m_format;
+  std::array<char, MAX_SIZE> m_buffer{};
+  size_t m_size{0};
+  bool m_overflow{false};
+};
+
+} // namespace open_heat::network
+
+#endif // OPEN_HEAT_STATEMESSAGE_HPP
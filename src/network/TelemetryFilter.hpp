@@ -0,0 +1,145 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_TELEMETRYFILTER_HPP
+#define OPEN_HEAT_TELEMETRYFILTER_HPP
+
+#include <Config.hpp>
+#include <RTCMemory.hpp>
+#include <cstdint>
+
+namespace open_heat::network {
+
+/**
+ * Decides which values of the state are published on a wake.
+ * The values of the last publish are kept in rtc memory. Measurements are
+ * due if they moved by at least their deadband, settings on any change.
+ * All values are due if the heartbeat interval expired.
+ * The statistics are only published with the heartbeat, or on every wake in debug
+ * mode, the temperature history also before it would be overwritten.
+ */
+class TelemetryFilter {
+  public:
+  enum Metric : uint16_t {
+    TEMP = 1 << 0,
+    HUMIDITY = 1 << 1,
+    TARGET = 1 << 2,
+    MODE = 1 << 3,
+    VALVE = 1 << 4,
+    // percentage and voltage
+    BATTERY = 1 << 5,
+    MODEM_SLEEP = 1 << 6,
+    CHECK_INTERVAL = 1 << 7,
+    ALL = (1 << 8) - 1
+  };
+
+  static constexpr bool heartbeatDue(
+    const rtc::PublishedState& last,
+    const TelemetrySettings& settings,
+    const uint32_t seconds)
+  {
+    return !last.valid || settings.HeartbeatMinutes == 0
+      || seconds - last.heartbeatSeconds
+      >= static_cast<uint32_t>(settings.HeartbeatMinutes) * 60;
+  }
+
+  static constexpr bool statsDue(
+    const rtc::PublishedState& last,
+    const TelemetrySettings& settings,
+    const uint32_t seconds,
+    const bool debug)
+  {
+    return debug || heartbeatDue(last, settings, seconds);
+  }
+
+  // the history holds the checks of at least HISTORY_MIN_SAMPLES wakes,
+  // it is published once half of them were taken
+  static constexpr bool historyDue(
+    const rtc::PublishedState& last,
+    const TelemetrySettings& settings,
+    const uint32_t seconds,
+    const bool debug,
+    const size_t samples)
+  {
+    return samples > 0
+      && (samples >= rtc::HISTORY_MIN_SAMPLES / 2
+          || statsDue(last, settings, seconds, debug));
+  }
+
+  // Metrics of current which have to be published
+  static constexpr uint16_t due(
+    const rtc::PublishedState& last,
+    const rtc::PublishedState& current,
+    const TelemetrySettings& settings,
+    const uint32_t seconds)
+  {
+    if (heartbeatDue(last, settings, seconds)) {
+      return ALL;
+    }
+
+    uint16_t metrics = 0;
+    metrics |= moved(last.temp, current.temp, settings.TempDeadband) ? TEMP : 0;
+    metrics |= moved(last.humidity, current.humidity, settings.HumidityDeadband)
+      ? HUMIDITY
+      : 0;
+    metrics |= moved(last.millivolts, current.millivolts, settings.VoltageDeadband)
+      ? BATTERY
+      : 0;
+    metrics |= last.target != current.target ? TARGET : 0;
+    metrics |= last.mode != current.mode ? MODE : 0;
+    metrics |= last.valve != current.valve ? VALVE : 0;
+    metrics |= last.modemSleepMillis != current.modemSleepMillis ? MODEM_SLEEP : 0;
+    metrics |= last.checkIntervalMillis != current.checkIntervalMillis ? CHECK_INTERVAL
+                                                                         : 0;
+    return metrics;
+  }
+
+  /**
+   * Takes over the published metrics of current. The others keep their last
+   * published value, so slow drifts are published once they add up.
+   */
+  static constexpr rtc::PublishedState published(
+    const rtc::PublishedState& last,
+    const rtc::PublishedState& current,
+    const uint16_t metrics,
+    const uint32_t seconds)
+  {
+    auto state = last;
+    state.temp = (metrics & TEMP) != 0 ? current.temp : state.temp;
+    state.humidity = (metrics & HUMIDITY) != 0 ? current.humidity : state.humidity;
+    state.target = (metrics & TARGET) != 0 ? current.target : state.target;
+    state.mode = (metrics & MODE) != 0 ? current.mode : state.mode;
+    state.valve = (metrics & VALVE) != 0 ? current.valve : state.valve;
+    if ((metrics & BATTERY) != 0) {
+      state.millivolts = current.millivolts;
+      state.battery = current.battery;
+    }
+    state.modemSleepMillis
+      = (metrics & MODEM_SLEEP) != 0 ? current.modemSleepMillis : state.modemSleepMillis;
+    state.checkIntervalMillis = (metrics & CHECK_INTERVAL) != 0
+      ? current.checkIntervalMillis
+      : state.checkIntervalMillis;
+    if (metrics == ALL) {
+      state.heartbeatSeconds = seconds;
+      state.valid = true;
+    }
+    return state;
+  }
+
+  private:
+  // a deadband of 0 publishes every change
+  static constexpr bool moved(
+    const int32_t last,
+    const int32_t current,
+    const uint16_t deadband)
+  {
+    const auto distance = last > current ? last - current : current - last;
+    return distance > 0 && distance >= deadband;
+  }
+};
+
+} // namespace open_heat::network
+
+#endif // OPEN_HEAT_TELEMETRYFILTER_HPP
@@ -8,6 +8,7 @@
 #include "generated/html/index.hpp"
 #include "generated/html/redirect_15.hpp"
 #include "generated/html/redirect_now.hpp"
+#include <RTCMemory.hpp>
 #include <cstring>
 #include <functional>
 
@@ -24,6 +25,7 @@ void open_heat::network::WebServer::setup(const char* const hostname)
     m_serveIndex = HTML_CONFIG;
     m_logger.log(yal::Level::INFO, "Serving configuration portal");
     m_hostname = String(hostname);
+    m_accessPoints.load();
   } else {
     m_logger.log(yal::Level::INFO, "Serving webinterface");
     m_serveIndex = HTML_INDEX;
@@ -122,6 +124,7 @@ void WebServer::reset(
   response->addHeader("Connection", "close");
   request->onDisconnect([this]() {
     m_logger.log(yal::Level::WARNING, "Restarting");
+    rtc::commit();
     EspClass::reset();
   });
 }
@@ -178,7 +181,8 @@ void WebServer::rootHandleGet(AsyncWebServerRequest* const request)
 void WebServer::rootHandlePost(AsyncWebServerRequest* const request)
 {
   updateSetTemp(request);
-  const auto needReset = updateConfig(request);
+  auto needReset = updateConfig(request);
+  needReset |= updateAccessPoints(request);
   if (needReset) {
     AsyncResponseStream* response = request->beginResponseStream(CONTENT_TYPE_HTML);
     response->printf(HTML_REDIRECT_15, "succeeded");
@@ -206,6 +210,14 @@ bool WebServer::updateConfig(AsyncWebServerRequest* const request)
 
   char sensorTypeBuf[10]{};
 
+  char mqttFormatBuf[8]{};
+  char mqttLegacyTopicsBuf[8]{};
+
+  char tempDeadbandBuf[6]{};
+  char humidityDeadbandBuf[6]{};
+  char voltageDeadbandBuf[6]{};
+  char heartbeatBuf[6]{};
+
   std::vector<std::tuple<const char*, char*>> params = {
     std::tuple<const char*, char*>{"ssid", config.WifiCredentials.ssid},
     std::tuple<const char*, char*>{"wifiPassword", config.WifiCredentials.password},
@@ -216,6 +228,12 @@ bool WebServer::updateConfig(AsyncWebServerRequest* const request)
     std::tuple<const char*, char*>{"mqttUsername", config.MQTT.Username},
     std::tuple<const char*, char*>{"mqttPassword", config.MQTT.Password},
     std::tuple<const char*, char*>{"mqttPort", portBuf},
+    std::tuple<const char*, char*>{"mqttFormat", mqttFormatBuf},
+    std::tuple<const char*, char*>{"mqttLegacyTopics", mqttLegacyTopicsBuf},
+    std::tuple<const char*, char*>{"tempDeadband", tempDeadbandBuf},
+    std::tuple<const char*, char*>{"humidityDeadband", humidityDeadbandBuf},
+    std::tuple<const char*, char*>{"voltageDeadband", voltageDeadbandBuf},
+    std::tuple<const char*, char*>{"heartbeat", heartbeatBuf},
     std::tuple<const char*, char*>{"hostname", config.Hostname},
     std::tuple<const char*, char*>{"motorGround", motorGroundBuf},
     std::tuple<const char*, char*>{"motorVIN", motorVinBuf},
@@ -239,6 +257,32 @@ bool WebServer::updateConfig(AsyncWebServerRequest* const request)
     if (std::strlen(portBuf) > 0) {
       config.MQTT.Port = static_cast<uint16>(std::strtol(portBuf, nullptr, 10));
     }
+    if (std::strlen(mqttFormatBuf) > 0) {
+      String format(mqttFormatBuf);
+      format.toLowerCase();
+      config.MQTT.Format = format == "cbor" ? STATE_CBOR : STATE_JSON;
+    }
+    if (std::strlen(mqttLegacyTopicsBuf) > 0) {
+      String legacyTopics(mqttLegacyTopicsBuf);
+      legacyTopics.toLowerCase();
+      config.MQTT.LegacyTopics = legacyTopics == "on";
+    }
+    if (std::strlen(tempDeadbandBuf) > 0) {
+      config.Telemetry.TempDeadband
+        = static_cast<uint16>(std::strtol(tempDeadbandBuf, nullptr, 10));
+    }
+    if (std::strlen(humidityDeadbandBuf) > 0) {
+      config.Telemetry.HumidityDeadband
+        = static_cast<uint16>(std::strtol(humidityDeadbandBuf, nullptr, 10));
+    }
+    if (std::strlen(voltageDeadbandBuf) > 0) {
+      config.Telemetry.VoltageDeadband
+        = static_cast<uint16>(std::strtol(voltageDeadbandBuf, nullptr, 10));
+    }
+    if (std::strlen(heartbeatBuf) > 0) {
+      config.Telemetry.HeartbeatMinutes
+        = static_cast<uint16>(std::strtol(heartbeatBuf, nullptr, 10));
+    }
     if (std::strlen(motorVinBuf) > 0) {
       config.MotorPins.Vin = static_cast<int8>(std::strtol(motorVinBuf, nullptr, 10));
     }
@@ -272,6 +316,40 @@ bool WebServer::updateConfig(AsyncWebServerRequest* const request)
   return updateConfig;
 }
 
+bool WebServer::updateAccessPoints(AsyncWebServerRequest* const request)
+{
+  // takes the credentials of the config if they were changed as well
+  m_accessPoints.load();
+
+  bool updated = false;
+  for (size_t i = 1; i < ACCESS_POINTS_MAX; ++i) {
+    char ssid[SSID_MAX_LEN]{};
+    char password[PASS_MAX_LEN]{};
+    if (!updateField(request, ("ssid" + String(i)).c_str(), ssid, sizeof(ssid))) {
+      continue;
+    }
+
+    updateField(
+      request, ("wifiPassword" + String(i)).c_str(), password, sizeof(password));
+    m_accessPoints.set(i, ssid, password);
+    updated = true;
+  }
+
+  m_accessPoints.persist();
+  return updated;
+}
+
+String WebServer::accessPointField(const String& var, const char* const prefix)
+{
+  const auto index = static_cast<size_t>(var.substring(std::strlen(prefix)).toInt());
+  if (index == 0 || index >= m_accessPoints.size()) {
+    return {};
+  }
+
+  const auto& accessPoint = m_accessPoints[index];
+  return var.startsWith(F("SSID_")) ? accessPoint.ssid : accessPoint.password;
+}
+
 void WebServer::updateSetTemp(const AsyncWebServerRequest* const request)
 {
   static const char* paramSetTemp = "setTemp";
@@ -341,6 +419,25 @@ String WebServer::indexHTMLProcessor(const String& var)
     return config.MQTT.Username;
   } else if (var == F("MQTT_PW")) {
     return config.MQTT.Password;
+  } else if (var == F("MQTT_FORMAT_JSON_SELECTED")) {
+    return config.MQTT.Format == STATE_JSON ? "selected" : "";
+  } else if (var == F("MQTT_FORMAT_CBOR_SELECTED")) {
+    return config.MQTT.Format == STATE_CBOR ? "selected" : "";
+  } else if (var == F("MQTT_LEGACY_OFF_SELECTED")) {
+    return config.MQTT.LegacyTopics ? "" : "selected";
+  } else if (var == F("MQTT_LEGACY_ON_SELECTED")) {
+    return config.MQTT.LegacyTopics ? "selected" : "";
+  }
+
+  // Telemetry
+  else if (var == F("TEMP_DEADBAND")) {
+    return String(config.Telemetry.TempDeadband);
+  } else if (var == F("HUMIDITY_DEADBAND")) {
+    return String(config.Telemetry.HumidityDeadband);
+  } else if (var == F("VOLTAGE_DEADBAND")) {
+    return String(config.Telemetry.VoltageDeadband);
+  } else if (var == F("HEARTBEAT")) {
+    return String(config.Telemetry.HeartbeatMinutes);
   }
 
   // Header
@@ -394,6 +491,10 @@ String WebServer::indexHTMLProcessor(const String& var)
     return String(config.WifiCredentials.ssid);
   } else if (var == F("WIFI_PASSWORD")) {
     return String(config.WifiCredentials.password);
+  } else if (var.startsWith(F("SSID_"))) {
+    return accessPointField(var, "SSID_");
+  } else if (var.startsWith(F("WIFI_PASSWORD_"))) {
+    return accessPointField(var, "WIFI_PASSWORD_");
   } else if (var == F("NETWORK_LIST")) {
     String networks;
     for (const auto& ap : m_accessPointList) {
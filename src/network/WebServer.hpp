@@ -6,6 +6,7 @@
 #ifndef WEBSERVER_HPP_
 #define WEBSERVER_HPP_
 
+#include "AccessPoints.hpp"
 #include <ESPAsyncWebServer.h>
 #include <Filesystem.hpp>
 #include <heating/RadiatorValve.hpp>
@@ -25,6 +26,7 @@ class WebServer {
       m_tempSensor(tempSensor),
       battery_(battery),
       valve_(valve),
+      m_accessPoints(filesystem),
       asyncWebServer_(AsyncWebServer(80))
   {
   }
@@ -44,6 +46,8 @@ class WebServer {
   sensors::Temperature*& m_tempSensor;
   sensors::Battery& battery_;
   open_heat::heating::RadiatorValve& valve_;
+  // additional access points, only loaded in the configuration portal
+  AccessPoints m_accessPoints;
 
   AsyncWebServer asyncWebServer_;
   const char* m_serveIndex;
@@ -77,6 +81,8 @@ class WebServer {
   void updateSetTemp(const AsyncWebServerRequest* request);
   void togglePost(AsyncWebServerRequest* pRequest);
   bool updateConfig(AsyncWebServerRequest* request);
+  bool updateAccessPoints(AsyncWebServerRequest* request);
+  String accessPointField(const String& var, const char* prefix);
 
   bool isCaptivePortal(AsyncWebServerRequest* pRequest);
   void onNotFound(AsyncWebServerRequest* request);
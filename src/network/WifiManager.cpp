@@ -4,8 +4,13 @@
 //
 
 #include "WifiManager.hpp"
+#include "RadioBackoff.hpp"
+#include "RadioPolicy.hpp"
+#include <Profiler.hpp>
 #include <RTCMemory.hpp>
+#include <algorithm>
 #include <cstring>
+#include <limits>
 
 namespace open_heat {
 namespace network {
@@ -19,7 +24,14 @@ void WifiManager::setup(bool doubleReset)
     startConfigPortal = true;
   }
 
-  if (startConfigPortal || connectMultiWiFi() != WL_CONNECTED) {
+  // The portal never returns and keeps the radio on, so it is only started
+  // without credentials or on request. A failing connect with credentials is
+  // an outage, which is retried with a backoff while the radio is off.
+  if (!startConfigPortal && connectMultiWiFi() != WL_CONNECTED) {
+    m_setupFailed = true;
+  }
+
+  if (startConfigPortal) {
     // Starts access point
     pinMode(LED_PIN, OUTPUT);
     digitalWrite(LED_PIN, LED_ON);
@@ -29,8 +41,6 @@ void WifiManager::setup(bool doubleReset)
     }
     digitalWrite(LED_PIN, LED_OFF);
   }
-
-  checkWifi();
 }
 
 bool WifiManager::loadAPsFromConfig()
@@ -112,69 +122,101 @@ bool WifiManager::checkWifi()
     return true;
   }
 
+  // setup just tried, do not keep the radio on for another attempt
+  if (m_setupFailed) {
+    m_setupFailed = false;
+    return false;
+  }
+
   m_logger.log(yal::Level::WARNING, "WIFi disconnected, reconnecting...");
   if (connectMultiWiFi() == WL_CONNECTED) {
-    m_reconnectCount = 0;
     return true;
   }
 
-  m_logger.log(
-    yal::Level::WARNING, "WiFi reconnection failed, % times", ++m_reconnectCount);
+  m_logger.log(yal::Level::WARNING, "WiFi reconnection failed");
   return false;
 }
 
+const AccessPoints& WifiManager::accessPoints() const
+{
+  return m_accessPoints;
+}
+
 wl_status_t WifiManager::connectMultiWiFi()
 {
+  Profiler::Scope profile(Profiler::Phase::WIFI);
   WiFi.forceSleepWake();
   m_logger.log(yal::Level::INFO, "Connecting WiFi...");
   const auto startTime = rtc::offsetMillis();
+  m_connectStartMillis = millis();
 
   const auto& config = m_fileSystem.getConfig();
 
   // STA = client mode
   WiFi.mode(WIFI_STA);
   WiFi.setHostname(config.Hostname);
+  RadioPolicy::apply();
 
-  fastConfig connectConfig{};
-  const auto hasFastConfig
-    = getFastConnectConfig(config.WifiCredentials.ssid, connectConfig);
-  wl_status_t status;
-  if (hasFastConfig) {
-    m_logger.log(yal::Level::DEBUG, "Using fast connect");
-    status = WiFi.begin(
-      config.WifiCredentials.ssid,
-      config.WifiCredentials.password,
-      connectConfig.channel,
-      connectConfig.bssid,
-      true);
-  } else {
-    m_logger.log(yal::Level::DEBUG, "Using standard connect");
-    status = WiFi.begin(config.WifiCredentials.ssid, config.WifiCredentials.password);
+  m_accessPoints.load();
+  auto cache = rtc::get<&rtc::Memory::wifiCache>();
+  auto accessPoint = cache.accessPoint;
+  const auto hasCache = cache.channel != 0 && accessPoint < m_accessPoints.size();
+
+  auto status = WL_DISCONNECTED;
+  if (hasCache) {
+    status = connectCached(cache, m_accessPoints[accessPoint]);
   }
 
-  int i = 0;
-  while ((i++ < 60) && (status != WL_CONNECTED)) {
-    delay(100);
-    status = WiFi.status();
-    if (status == WL_CONNECTED) {
-      break;
+  const auto fastConnect = status == WL_CONNECTED;
+  if (!fastConnect) {
+    if (hasCache) {
+      m_logger.log(yal::Level::WARNING, "Cached access point not available");
+      m_accessPoints.recordFailure(accessPoint);
+      WiFi.disconnect();
+    }
+    cache = {};
+    rtc::setWifiCache(cache);
+
+    status = connectRanked(accessPoint, hasCache ? accessPoint : ACCESS_POINTS_MAX);
+    // the access points are most likely down if the backoff already runs
+    const auto scan
+      = RadioBackoff::scanAllowed(rtc::get<&rtc::Memory::radioFailures>());
+    if (status != WL_CONNECTED && scan && remainingBudget() > 0) {
+      status = connectScanned(accessPoint);
     }
   }
 
   const auto connectTime = rtc::offsetMillis() - startTime;
   if (status == WL_CONNECTED) {
+    RadioPolicy::connected(WiFi.RSSI());
+    cache.accessPoint = accessPoint;
+    cacheAssociation(cache);
+    countConnect(fastConnect, connectTime);
+    // connects with the cached association are only counted in rtc memory,
+    // so the list is not written on every wake
+    if (!fastConnect) {
+      m_accessPoints.recordConnect(
+        accessPoint,
+        static_cast<uint32_t>(
+          std::min<uint64_t>(connectTime, std::numeric_limits<uint32_t>::max())));
+    }
+
     //@formatter:off
     m_logger.log(
       yal::Level::INFO,
       "Wifi connected:\n"
       "\ttime: %\n"
+      "\tfast connect: %\n"
       "\tSSID: %\n"
       "\tRSSI=%\n"
+      "\tTX power: % dBm\n"
       "\tChannel: %\n"
       "\tIP address: %",
       connectTime,
+      fastConnect,
       WiFi.SSID().c_str(),
       static_cast<int>(WiFi.RSSI()),
+      RadioPolicy::txPower(),
       WiFi.channel(),
       WiFi.localIP().toString().c_str());
     //@formatter:on
@@ -182,25 +224,154 @@ wl_status_t WifiManager::connectMultiWiFi()
     m_logger.log(yal::Level::WARNING, "WiFi connect timeout");
   }
 
+  m_accessPoints.persist();
   return status;
 }
 
-bool WifiManager::getFastConnectConfig(const String& ssid, fastConfig& config)
+wl_status_t WifiManager::connectCached(
+  const rtc::WifiCache& cache,
+  const AccessPoints::AccessPoint& accessPoint)
 {
-  // adopted from
-  // https://github.com/roberttidey/WiFiManager/blob/feature_fastconnect/WiFiManager.cpp
-  int networksFound = WiFi.scanNetworks();
-  int32_t scan_rssi = -200;
-  for (auto i = 0; i < networksFound; i++) {
-    if (ssid == WiFi.SSID(i)) {
-      if (WiFi.RSSI(i) > scan_rssi) {
-        config.bssid = WiFi.BSSID(i);
-        config.channel = WiFi.channel(i);
-        return true;
-      }
+  if (isLeaseValid(cache)) {
+    m_logger.log(yal::Level::DEBUG, "Using cached association and lease");
+    WiFi.config(
+      IPAddress(cache.ip),
+      IPAddress(cache.gateway),
+      IPAddress(cache.subnet),
+      IPAddress(cache.dns));
+  } else {
+    m_logger.log(yal::Level::DEBUG, "Using cached association");
+    const IPAddress dhcp(static_cast<uint32_t>(0));
+    WiFi.config(dhcp, dhcp, dhcp);
+  }
+
+  WiFi.begin(accessPoint.ssid, accessPoint.password, cache.channel, cache.bssid, true);
+  return waitForConnection(CACHED_CONNECT_TIMEOUT_MILLIS);
+}
+
+wl_status_t WifiManager::connectRanked(uint8_t& accessPoint, const size_t skip)
+{
+  // the cached lease might be the reason the connect failed
+  const IPAddress dhcp(static_cast<uint32_t>(0));
+  WiFi.config(dhcp, dhcp, dhcp);
+
+  for (const auto index : m_accessPoints.ranking()) {
+    if (remainingBudget() == 0) {
+      break;
     }
+
+    if (index == skip) {
+      continue;
+    }
+
+    const auto& candidate = m_accessPoints[index];
+    m_logger.log(
+      yal::Level::DEBUG,
+      "Trying % on channel %, last rssi %",
+      candidate.ssid,
+      candidate.channel,
+      candidate.rssi);
+    WiFi.begin(
+      candidate.ssid, candidate.password, candidate.channel, candidate.bssid, true);
+    if (waitForConnection(CACHED_CONNECT_TIMEOUT_MILLIS) == WL_CONNECTED) {
+      accessPoint = index;
+      return WL_CONNECTED;
+    }
+
+    m_accessPoints.recordFailure(index);
+    WiFi.disconnect();
   }
-  return false;
+
+  return WL_DISCONNECTED;
+}
+
+wl_status_t WifiManager::connectScanned(uint8_t& accessPoint)
+{
+  m_logger.log(yal::Level::DEBUG, "Searching for known access points");
+  m_accessPoints.updateFromScan(WiFi.scanNetworks());
+
+  const auto ranking = m_accessPoints.ranking();
+  accessPoint = ranking.empty() ? 0 : ranking.front();
+  const auto& candidate = m_accessPoints[accessPoint];
+  if (ranking.empty()) {
+    m_logger.log(yal::Level::DEBUG, "Using standard connect");
+    WiFi.begin(candidate.ssid, candidate.password);
+  } else {
+    m_logger.log(yal::Level::DEBUG, "Using fast connect to %", candidate.ssid);
+    WiFi.begin(
+      candidate.ssid, candidate.password, candidate.channel, candidate.bssid, true);
+  }
+
+  const auto status = waitForConnection(CONNECT_TIMEOUT_MILLIS);
+  if (status != WL_CONNECTED) {
+    m_accessPoints.recordFailure(accessPoint);
+  }
+  return status;
+}
+
+wl_status_t WifiManager::waitForConnection(const unsigned long timeoutMillis)
+{
+  const auto start = millis();
+  const auto timeout = std::min(timeoutMillis, remainingBudget());
+  auto status = WiFi.status();
+  while (status != WL_CONNECTED && millis() - start < timeout) {
+    delay(100);
+    status = WiFi.status();
+  }
+
+  return status;
+}
+
+unsigned long WifiManager::remainingBudget() const
+{
+  const auto spent = millis() - m_connectStartMillis;
+  return spent < RadioBackoff::CONNECT_BUDGET_MILLIS
+    ? RadioBackoff::CONNECT_BUDGET_MILLIS - spent
+    : 0;
+}
+
+void WifiManager::cacheAssociation(rtc::WifiCache cache)
+{
+  std::memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+  cache.channel = static_cast<uint8_t>(WiFi.channel());
+
+  // the lease is only taken if it was obtained from the dhcp server
+  if (!isLeaseValid(cache)) {
+    cache.ip = WiFi.localIP();
+    cache.gateway = WiFi.gatewayIP();
+    cache.subnet = WiFi.subnetMask();
+    cache.dns = WiFi.dnsIP();
+    cache.leaseSeconds = static_cast<uint32_t>(rtc::offsetMillis() / 1000);
+  }
+
+  rtc::setWifiCache(cache);
+}
+
+void WifiManager::countConnect(const bool fastConnect, const uint64_t connectMillis)
+{
+  auto stats = rtc::get<&rtc::Memory::wifiStats>();
+  auto& count = fastConnect ? stats.fastConnects : stats.scanConnects;
+  auto& total = fastConnect ? stats.fastConnectMillis : stats.scanConnectMillis;
+  const auto millis = static_cast<uint32_t>(
+    std::min<uint64_t>(connectMillis, std::numeric_limits<uint16_t>::max()));
+
+  // halving both keeps the average
+  if (
+    count == std::numeric_limits<uint16_t>::max()
+    || total > std::numeric_limits<uint32_t>::max() - millis) {
+    count /= 2;
+    total /= 2;
+  }
+
+  ++count;
+  total += millis;
+  rtc::setWifiStats(stats);
+}
+
+bool WifiManager::isLeaseValid(const rtc::WifiCache& cache)
+{
+  const auto now = static_cast<uint32_t>(rtc::offsetMillis() / 1000);
+  return cache.ip != 0 && now - cache.leaseSeconds < DHCP_LEASE_REUSE_SECONDS;
 }
 
 } // namespace network
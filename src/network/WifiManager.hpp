@@ -8,37 +8,74 @@
 
 #include <chrono>
 
+#include "AccessPoints.hpp"
 #include "WebServer.hpp"
 #include <Config.hpp>
 #include <Filesystem.hpp>
+#include <RTCMemory.hpp>
 #include <yal/yal.hpp>
 
 namespace open_heat::network {
 class WifiManager {
   public:
   WifiManager(Filesystem& filesystem, WebServer& webServer) :
-      m_webServer(webServer), m_fileSystem(filesystem), m_logger(yal::Logger("WIFI")){};
+      m_webServer(webServer),
+      m_fileSystem(filesystem),
+      m_accessPoints(filesystem),
+      m_logger(yal::Logger("WIFI")){};
 
   void setup(bool doubleReset);
   bool checkWifi();
 
-  private:
-  struct fastConfig {
-    uint8_t* bssid = nullptr;
-    uint32_t channel = 0;
-  };
+  // Loaded by the last connect
+  [[nodiscard]] const AccessPoints& accessPoints() const;
 
+  private:
   [[noreturn]] bool showConfigurationPortal();
   bool loadAPsFromConfig();
   [[nodiscard]] std::vector<String> getApList() const;
-  bool getFastConnectConfig(const String& ssid, fastConfig& config);
 
   wl_status_t connectMultiWiFi();
+  // Connects to the access point of the last association without a scan
+  wl_status_t connectCached(
+    const rtc::WifiCache& cache,
+    const AccessPoints::AccessPoint& accessPoint);
+  // Tries the access points seen before without a scan, strongest first
+  wl_status_t connectRanked(uint8_t& accessPoint, size_t skip);
+  wl_status_t connectScanned(uint8_t& accessPoint);
+  // Waits at most until the connect budget of the wake is spent
+  wl_status_t waitForConnection(unsigned long timeoutMillis);
+  [[nodiscard]] unsigned long remainingBudget() const;
+
+  void cacheAssociation(rtc::WifiCache cache);
+  static void countConnect(bool fastConnect, uint64_t connectMillis);
+  [[nodiscard]] static bool isLeaseValid(const rtc::WifiCache& cache);
+
+  /**
+    Time to wait for the connection
+    Unit: ms
+  */
+  static constexpr unsigned long CONNECT_TIMEOUT_MILLIS = 6000;
+
+  /**
+    Time to wait for the cached access point before scanning
+    Unit: ms
+  */
+  static constexpr unsigned long CACHED_CONNECT_TIMEOUT_MILLIS = 3000;
+
+  /**
+    The dhcp lease is configured statically for this long without asking the
+    dhcp server, it must be shorter than the lease time of the router.
+    Unit: s
+  */
+  static constexpr uint32_t DHCP_LEASE_REUSE_SECONDS = 60 * 60;
 
-  unsigned char m_reconnectCount = 0;
+  bool m_setupFailed = false;
+  unsigned long m_connectStartMillis = 0;
 
   WebServer& m_webServer;
   Filesystem& m_fileSystem;
+  AccessPoints m_accessPoints;
   yal::Logger m_logger;
 };
 
@@ -26,7 +26,7 @@ WindowSensor::WindowSensor(Filesystem* filesystem, heating::RadiatorValve*& valv
 
 void WindowSensor::setup()
 {
-  const auto& config = m_filesystem->getConfig();
+  const auto& config = m_filesystem->getHardwareConfig();
   if (config.WindowPins.Ground <= 0 || config.WindowPins.Vin <= 0) {
     m_logger.log(yal::Level::WARNING, "Window pins not set up.");
     return;
@@ -74,7 +74,7 @@ void WindowSensor::loop()
   }
 
   delay(250);
-  const auto& config = m_filesystem->getConfig();
+  const auto& config = m_filesystem->getHardwareConfig();
   const auto stateNow = digitalRead(static_cast<uint8_t>(config.WindowPins.Vin)) == HIGH;
   if (stateNow == m_isOpen) {
     m_valve->setWindowState(m_isOpen);
@@ -86,7 +86,7 @@ void WindowSensor::loop()
 }
 void ICACHE_RAM_ATTR WindowSensor::sensorChangedInterrupt()
 {
-  const auto& config = m_filesystem->getConfig();
+  const auto& config = m_filesystem->getHardwareConfig();
   m_isOpen = digitalRead(static_cast<uint8_t>(config.WindowPins.Vin)) == HIGH;
 
   m_logger.log(yal::Level::DEBUG, "Window switch changed, new state: %", m_isOpen);
@@ -0,0 +1,176 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+// Host replacement of the Arduino core for the native unit tests.
+// Time only advances through delay() or shim::advanceMillis().
+
+#ifndef OPEN_HEAT_SHIM_ARDUINO_H
+#define OPEN_HEAT_SHIM_ARDUINO_H
+
+#include <pins_arduino.h>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define LED_BUILTIN 2
+
+class String {
+  public:
+  String() = default;
+  String(const char* value) : m_value(value != nullptr ? value : "") {}
+  String(std::string value) : m_value(std::move(value)) {}
+  explicit String(char value) : m_value(1, value) {}
+  explicit String(int value) : m_value(std::to_string(value)) {}
+  explicit String(unsigned int value) : m_value(std::to_string(value)) {}
+  explicit String(long value) : m_value(std::to_string(value)) {}
+  explicit String(unsigned long value) : m_value(std::to_string(value)) {}
+  explicit String(long long value) : m_value(std::to_string(value)) {}
+  explicit String(unsigned long long value) : m_value(std::to_string(value)) {}
+  explicit String(double value) : m_value(std::to_string(value)) {}
+
+  const char* c_str() const { return m_value.c_str(); }
+  unsigned int length() const { return static_cast<unsigned int>(m_value.size()); }
+  bool isEmpty() const { return m_value.empty(); }
+  void reserve(unsigned int size) { m_value.reserve(size); }
+
+  String& operator+=(const String& other)
+  {
+    m_value += other.m_value;
+    return *this;
+  }
+  String& operator+=(const char* other)
+  {
+    m_value += other;
+    return *this;
+  }
+  String& operator+=(char other)
+  {
+    m_value += other;
+    return *this;
+  }
+  friend String operator+(const String& lhs, const String& rhs)
+  {
+    return lhs.m_value + rhs.m_value;
+  }
+  friend String operator+(const String& lhs, const char* rhs)
+  {
+    return lhs.m_value + rhs;
+  }
+  friend String operator+(const char* lhs, const String& rhs)
+  {
+    return lhs + rhs.m_value;
+  }
+  bool operator==(const String& other) const { return m_value == other.m_value; }
+  bool operator==(const char* other) const { return m_value == other; }
+  bool operator!=(const String& other) const { return m_value != other.m_value; }
+  char operator[](unsigned int index) const { return m_value[index]; }
+
+  int indexOf(char value, unsigned int from = 0) const
+  {
+    const auto position = m_value.find(value, from);
+    return position == std::string::npos ? -1 : static_cast<int>(position);
+  }
+  String substring(unsigned int from) const { return m_value.substr(from); }
+  String substring(unsigned int from, unsigned int to) const
+  {
+    return m_value.substr(from, to - from);
+  }
+  bool startsWith(const String& prefix) const
+  {
+    return m_value.rfind(prefix.m_value, 0) == 0;
+  }
+  long toInt() const { return std::atol(m_value.c_str()); }
+  float toFloat() const { return static_cast<float>(std::atof(m_value.c_str())); }
+  void toLowerCase()
+  {
+    for (auto& c : m_value) {
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+  }
+  void replace(char from, char to)
+  {
+    for (auto& c : m_value) {
+      c = c == from ? to : c;
+    }
+  }
+  void remove(unsigned int index) { m_value.erase(index); }
+  bool concat(const char* data, unsigned int size)
+  {
+    m_value.append(data, size);
+    return true;
+  }
+
+  private:
+  std::string m_value;
+};
+
+namespace shim {
+inline uint64_t microsNow = 0;
+inline uint8_t pinLevels[32]{};
+inline int pwmDuty[32]{};
+inline int analogValue = 0;
+
+inline void advanceMillis(uint64_t millis)
+{
+  microsNow += millis * 1000;
+}
+} // namespace shim
+
+inline unsigned long millis()
+{
+  return static_cast<unsigned long>(shim::microsNow / 1000);
+}
+
+inline unsigned long micros()
+{
+  return static_cast<unsigned long>(shim::microsNow);
+}
+
+inline void delay(unsigned long millis)
+{
+  shim::advanceMillis(millis);
+}
+
+inline void yield() {}
+inline void pinMode(uint8_t, uint8_t) {}
+// as on the device, digitalWrite stops the pwm of the pin
+inline void digitalWrite(uint8_t pin, uint8_t level)
+{
+  shim::pinLevels[pin % 32] = level;
+  shim::pwmDuty[pin % 32] = 0;
+}
+inline int digitalRead(uint8_t pin)
+{
+  return shim::pinLevels[pin % 32];
+}
+inline void analogWriteRange(uint32_t) {}
+inline void analogWrite(uint8_t pin, int duty)
+{
+  shim::pwmDuty[pin % 32] = duty;
+}
+inline int analogRead(uint8_t)
+{
+  return shim::analogValue;
+}
+// sntp never answers, time() stays at the host time
+inline void configTime(const char*, const char*) {}
+
+#include <Esp.h>
+
+inline String EspClass::getResetInfo()
+{
+  return "native";
+}
+
+#endif // OPEN_HEAT_SHIM_ARDUINO_H
@@ -0,0 +1,69 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+// Records the radio settings the firmware applies, nothing is sent.
+// Scan results and the association are taken from shim::networks.
+
+#ifndef OPEN_HEAT_SHIM_ESP8266WIFI_H
+#define OPEN_HEAT_SHIM_ESP8266WIFI_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <vector>
+
+enum WiFiMode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+enum WiFiSleepType_t { WIFI_NONE_SLEEP = 0, WIFI_LIGHT_SLEEP = 1, WIFI_MODEM_SLEEP = 2 };
+
+namespace shim {
+struct Network {
+  String ssid;
+  int32_t rssi;
+  uint8_t bssid[6];
+  int32_t channel;
+};
+
+inline std::vector<Network> networks;
+// index in networks of the associated access point
+inline size_t associated = 0;
+} // namespace shim
+
+class ESP8266WiFiClass {
+  public:
+  bool mode(WiFiMode_t mode)
+  {
+    m_mode = mode;
+    return true;
+  }
+  WiFiMode_t getMode() const { return m_mode; }
+
+  bool setSleepMode(WiFiSleepType_t type, uint8_t = 0)
+  {
+    m_sleepMode = type;
+    return true;
+  }
+  WiFiSleepType_t getSleepMode() const { return m_sleepMode; }
+
+  String SSID(uint8_t network) const { return shim::networks[network].ssid; }
+  int32_t RSSI(uint8_t network) const { return shim::networks[network].rssi; }
+  uint8_t* BSSID(uint8_t network) const { return shim::networks[network].bssid; }
+  int32_t channel(uint8_t network) const { return shim::networks[network].channel; }
+
+  String SSID() const { return SSID(shim::associated); }
+  int8_t RSSI() const { return static_cast<int8_t>(RSSI(shim::associated)); }
+  uint8_t* BSSID() const { return BSSID(shim::associated); }
+  int32_t channel() const { return channel(shim::associated); }
+
+  void setOutputPower(float dBm) { m_outputPower = dBm; }
+  float outputPower() const { return m_outputPower; }
+
+  private:
+  WiFiMode_t m_mode{WIFI_STA};
+  WiFiSleepType_t m_sleepMode{WIFI_NONE_SLEEP};
+  float m_outputPower{20.5F};
+};
+
+inline ESP8266WiFiClass WiFi;
+
+#endif // OPEN_HEAT_SHIM_ESP8266WIFI_H
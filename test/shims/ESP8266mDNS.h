@@ -0,0 +1,11 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_SHIM_ESP8266MDNS_H
+#define OPEN_HEAT_SHIM_ESP8266MDNS_H
+
+// included by hardware/ESP8266.h, not used by the tested code
+
+#endif // OPEN_HEAT_SHIM_ESP8266MDNS_H
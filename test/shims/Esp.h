@@ -0,0 +1,83 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+// Host replacement of EspClass. The rtc user memory is a plain array, which keeps
+// its content across a simulated reboot, see shim::reboot in the tests.
+
+#ifndef OPEN_HEAT_SHIM_ESP_H
+#define OPEN_HEAT_SHIM_ESP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+class String;
+
+enum rst_reason {
+  REASON_DEFAULT_RST = 0,
+  REASON_WDT_RST,
+  REASON_EXCEPTION_RST,
+  REASON_SOFT_WDT_RST,
+  REASON_SOFT_RESTART,
+  REASON_DEEP_SLEEP_AWAKE,
+  REASON_EXT_SYS_RST
+};
+
+struct rst_info {
+  uint32_t reason;
+};
+
+enum RFMode { RF_DEFAULT = 0, RF_CAL = 1, RF_NO_CAL = 2, RF_DISABLED = 4 };
+
+namespace shim {
+inline uint8_t rtcUserMemory[512]{};
+// blocks transferred over the rtc bus, the tests clear them
+inline size_t rtcReadBlocks = 0;
+inline size_t rtcWrittenBlocks = 0;
+inline rst_info resetInfo{REASON_DEFAULT_RST};
+inline uint64_t deepSleepMicros = 0;
+inline RFMode deepSleepMode = RF_DEFAULT;
+} // namespace shim
+
+class EspClass {
+  public:
+  // offset in blocks of 4 bytes, as on the device
+  bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size)
+  {
+    if (offset * 4 + size > sizeof(shim::rtcUserMemory)) {
+      return false;
+    }
+    std::memcpy(data, &shim::rtcUserMemory[offset * 4], size);
+    shim::rtcReadBlocks += (size + 3) / 4;
+    return true;
+  }
+
+  bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size)
+  {
+    if (offset * 4 + size > sizeof(shim::rtcUserMemory)) {
+      return false;
+    }
+    std::memcpy(&shim::rtcUserMemory[offset * 4], data, size);
+    shim::rtcWrittenBlocks += (size + 3) / 4;
+    return true;
+  }
+
+  static void deepSleep(uint64_t micros, RFMode mode = RF_DEFAULT)
+  {
+    shim::deepSleepMicros = micros;
+    shim::deepSleepMode = mode;
+  }
+
+  static rst_info* getResetInfoPtr()
+  {
+    return &shim::resetInfo;
+  }
+
+  static String getResetInfo();
+};
+
+inline EspClass ESP;
+
+#endif // OPEN_HEAT_SHIM_ESP_H
@@ -0,0 +1,139 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+// In-memory filesystem with the subset of the Arduino FS api the firmware uses.
+
+#ifndef OPEN_HEAT_SHIM_FS_H
+#define OPEN_HEAT_SHIM_FS_H
+
+#include <Arduino.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace shim {
+inline std::map<std::string, std::shared_ptr<std::string>> files;
+// open() calls which may write, the tests count flash writes with it
+inline size_t fileWrites = 0;
+inline size_t fileReadBytes = 0;
+inline size_t mounts = 0;
+} // namespace shim
+
+class File {
+  public:
+  File() = default;
+  File(std::shared_ptr<std::string> content, size_t position) :
+      m_content(std::move(content)), m_position(position)
+  {
+  }
+
+  explicit operator bool() const { return m_content != nullptr; }
+  size_t size() const { return m_content->size(); }
+  int available() const { return static_cast<int>(m_content->size() - m_position); }
+
+  size_t write(const uint8_t* data, size_t size)
+  {
+    m_content->replace(m_position, size, reinterpret_cast<const char*>(data), size);
+    m_position += size;
+    return size;
+  }
+
+  size_t readBytes(char* data, size_t size)
+  {
+    const auto count = std::min(size, m_content->size() - m_position);
+    std::copy_n(m_content->data() + m_position, count, data);
+    m_position += count;
+    shim::fileReadBytes += count;
+    return count;
+  }
+
+  String readStringUntil(char terminator)
+  {
+    const auto end = m_content->find(terminator, m_position);
+    const auto last = end == std::string::npos ? m_content->size() : end;
+    String value(m_content->substr(m_position, last - m_position));
+    m_position = std::min(m_content->size(), last + 1);
+    return value;
+  }
+
+  bool seek(uint32_t position)
+  {
+    if (position > m_content->size()) {
+      return false;
+    }
+    m_position = position;
+    return true;
+  }
+
+  void close() { m_content.reset(); }
+
+  private:
+  std::shared_ptr<std::string> m_content;
+  size_t m_position{0};
+};
+
+class Dir {
+  public:
+  bool next()
+  {
+    m_iterator = m_started ? std::next(m_iterator) : shim::files.begin();
+    m_started = true;
+    return m_iterator != shim::files.end();
+  }
+  String fileName() const { return m_iterator->first; }
+  size_t fileSize() const { return m_iterator->second->size(); }
+
+  private:
+  bool m_started{false};
+  std::map<std::string, std::shared_ptr<std::string>>::iterator m_iterator;
+};
+
+class FS {
+  public:
+  bool begin()
+  {
+    ++shim::mounts;
+    return true;
+  }
+  bool format()
+  {
+    shim::files.clear();
+    return true;
+  }
+
+  File open(const char* path, const char* mode)
+  {
+    const auto modeChar = mode[0];
+    auto file = shim::files.find(path);
+    if (modeChar == 'r') {
+      return file == shim::files.end() ? File() : File(file->second, 0);
+    }
+
+    ++shim::fileWrites;
+    if (file == shim::files.end() || modeChar == 'w') {
+      shim::files[path] = std::make_shared<std::string>();
+    }
+    const auto& content = shim::files[path];
+    return {content, modeChar == 'a' ? content->size() : 0};
+  }
+
+  Dir openDir(const char*) { return {}; }
+  bool exists(const char* path) { return shim::files.count(path) > 0; }
+  bool remove(const char* path) { return shim::files.erase(path) > 0; }
+
+  bool rename(const char* from, const char* to)
+  {
+    const auto file = shim::files.find(from);
+    if (file == shim::files.end()) {
+      return false;
+    }
+    shim::files[to] = file->second;
+    shim::files.erase(from);
+    return true;
+  }
+};
+
+#endif // OPEN_HEAT_SHIM_FS_H
@@ -0,0 +1,22 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_SHIM_IPADDRESS_H
+#define OPEN_HEAT_SHIM_IPADDRESS_H
+
+#include <cstdint>
+
+class IPAddress {
+  public:
+  IPAddress() = default;
+  IPAddress(uint32_t address) : m_address(address) {}
+  operator uint32_t() const { return m_address; }
+  bool isSet() const { return m_address != 0; }
+
+  private:
+  uint32_t m_address{0};
+};
+
+#endif // OPEN_HEAT_SHIM_IPADDRESS_H
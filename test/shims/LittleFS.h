@@ -0,0 +1,13 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_SHIM_LITTLEFS_H
+#define OPEN_HEAT_SHIM_LITTLEFS_H
+
+#include <FS.h>
+
+inline FS LittleFS;
+
+#endif // OPEN_HEAT_SHIM_LITTLEFS_H
@@ -0,0 +1,58 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+// Device lifecycle for the native unit tests.
+
+#ifndef OPEN_HEAT_SHIM_NATIVEDEVICE_HPP
+#define OPEN_HEAT_SHIM_NATIVEDEVICE_HPP
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <FS.h>
+#include <user_interface.h>
+#include <algorithm>
+
+namespace open_heat::rtc {
+// RAM state of RTCMemory.cpp, a reboot loses it
+extern bool m_loaded;
+extern bool m_valid;
+} // namespace open_heat::rtc
+
+namespace shim {
+
+// RAM is lost, the rtc user memory and the files are kept
+inline void reboot(const rst_reason reason = REASON_DEEP_SLEEP_AWAKE)
+{
+  microsNow = 0;
+  resetInfo.reason = reason;
+  open_heat::rtc::m_loaded = false;
+  open_heat::rtc::m_valid = false;
+}
+
+// A power loss leaves random content in the rtc user memory
+inline void powerOn()
+{
+  std::fill(std::begin(rtcUserMemory), std::end(rtcUserMemory), 0xA5);
+  reboot(REASON_DEFAULT_RST);
+}
+
+// Power on of a new device
+inline void factoryReset()
+{
+  files.clear();
+  fileWrites = 0;
+  fileReadBytes = 0;
+  mounts = 0;
+  rtcReadBlocks = 0;
+  rtcWrittenBlocks = 0;
+  sleepType = NONE_SLEEP_T;
+  networks.clear();
+  associated = 0;
+  powerOn();
+}
+
+} // namespace shim
+
+#endif // OPEN_HEAT_SHIM_NATIVEDEVICE_HPP
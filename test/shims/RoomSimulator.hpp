@@ -0,0 +1,137 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+// Lumped capacitance model of a room heated by one radiator, for the native tests.
+//
+// The valve stem moves while the motor pins are driven and stops at the end stops,
+// where the stalled motor pulls the supply voltage on A0 down. The stem opening
+// sets the flow of supply water into the radiator, the radiator body heats the
+// room and the room loses heat to the outside:
+//
+//   C_r dT_r/dt = K_v * u * (T_s - T_r) - UA_r * (T_r - T)
+//   C   dT/dt   = UA_r * (T_r - T) - UA_o * (T - T_o)
+//
+// The model is integrated up to rtc::offsetMillis() whenever it is read, so it
+// follows the simulated time across light and deep sleeps.
+
+#ifndef OPEN_HEAT_SHIM_ROOMSIMULATOR_HPP
+#define OPEN_HEAT_SHIM_ROOMSIMULATOR_HPP
+
+#include <Arduino.h>
+#include <Config.hpp>
+#include <RTCMemory.hpp>
+#include <sensors/Temperature.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace shim {
+
+class RoomSimulator : public open_heat::sensors::Temperature {
+  public:
+  struct Parameters {
+    // heat capacity of air, walls and furniture, in J/K
+    float roomCapacity = 1.0e6F;
+    // heat capacity of the radiator body and its water, in J/K
+    float radiatorCapacity = 5.0e4F;
+    // heat transfer radiator to room, in W/K
+    float radiatorConductance = 40;
+    // heat carried by the supply water through the fully open valve, in W/K
+    float valveConductance = 60;
+    // heat loss of the room to the outside, in W/K
+    float lossConductance = 20;
+    float supplyTemp = 55;
+    float outsideTemp = 5;
+    // stem travel between the end stops at full motor duty, in ms
+    uint32_t travelMillis = 80'000;
+  };
+
+  RoomSimulator(const Parameters& parameters, const float roomTemp, const float opening) :
+      m_parameters(parameters),
+      m_roomTemp(roomTemp),
+      m_radiatorTemp(roomTemp),
+      m_stemMillis(opening * static_cast<float>(parameters.travelMillis))
+  {
+    analogValue = SUPPLY_ADC;
+  }
+
+  float temperature() override
+  {
+    update();
+    // resolution of the bme280, which also remembers the measurement
+    const auto temp = std::round(m_roomTemp * 100) / 100;
+    open_heat::rtc::setLastMeasuredTemp(temp);
+    return temp;
+  }
+
+  // Integrates up to now with the motor pins as they were since the last update,
+  // must be called before the pins change.
+  void update()
+  {
+    // opening the valve drives the ground pin, see MotorDriver::start
+    const auto drive = driven(DEFAULT_MOTOR_GROUND) - driven(DEFAULT_MOTOR_VIN);
+    const auto now = open_heat::rtc::offsetMillis();
+    while (m_millis < now) {
+      const auto next = std::min(now, (m_millis / STEP_MILLIS + 1) * STEP_MILLIS);
+      const auto travel = static_cast<float>(m_parameters.travelMillis);
+      m_stemMillis = std::max(
+        0.0F,
+        std::min(travel, m_stemMillis + drive * static_cast<float>(next - m_millis)));
+      m_millis = next;
+      if (m_millis % STEP_MILLIS == 0) {
+        step();
+      }
+    }
+
+    const auto atEndStop = (drive > 0 && opening() >= 1) || (drive < 0 && opening() <= 0);
+    analogValue = atEndStop ? SUPPLY_ADC - STALL_ADC_DROP : SUPPLY_ADC;
+  }
+
+  // stem opening, 0 is closed and 1 fully open
+  [[nodiscard]] float opening() const
+  {
+    return m_stemMillis / static_cast<float>(m_parameters.travelMillis);
+  }
+
+  [[nodiscard]] float roomTemp() const { return m_roomTemp; }
+
+  void setOutsideTemp(const float temp) { m_parameters.outsideTemp = temp; }
+
+  private:
+  // supply voltage on A0 while the motor turns and how much it drops when it stalls
+  static constexpr int SUPPLY_ADC = 800;
+  static constexpr int STALL_ADC_DROP = 100;
+
+  // the temperatures change slowly, they are integrated once per second
+  static constexpr uint64_t STEP_MILLIS = 1000;
+
+  static float driven(const uint8_t pin)
+  {
+    return pinLevels[pin % 32] == HIGH
+      ? 1
+      : static_cast<float>(pwmDuty[pin % 32]) / MOTOR_PWM_RANGE;
+  }
+
+  void step()
+  {
+    const auto& p = m_parameters;
+    const auto seconds = static_cast<float>(STEP_MILLIS) / 1000;
+    const auto supplied
+      = p.valveConductance * opening() * (p.supplyTemp - m_radiatorTemp);
+    const auto emitted = p.radiatorConductance * (m_radiatorTemp - m_roomTemp);
+    const auto lost = p.lossConductance * (m_roomTemp - p.outsideTemp);
+    m_radiatorTemp += (supplied - emitted) * seconds / p.radiatorCapacity;
+    m_roomTemp += (emitted - lost) * seconds / p.roomCapacity;
+  }
+
+  Parameters m_parameters;
+  float m_roomTemp;
+  float m_radiatorTemp;
+  float m_stemMillis;
+  uint64_t m_millis{0};
+};
+
+} // namespace shim
+
+#endif // OPEN_HEAT_SHIM_ROOMSIMULATOR_HPP
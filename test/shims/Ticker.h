@@ -0,0 +1,95 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+// Host replacement of the sdk timers for the native unit tests.
+// Callbacks only run from shim::runTimers(), the time does not advance by itself.
+
+#ifndef OPEN_HEAT_SHIM_TICKER_H
+#define OPEN_HEAT_SHIM_TICKER_H
+
+#include <Arduino.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+class Ticker;
+
+namespace shim {
+inline std::vector<Ticker*> tickers;
+void runTimers();
+} // namespace shim
+
+class Ticker {
+  public:
+  using callback_function_t = std::function<void()>;
+
+  Ticker() = default;
+  Ticker(const Ticker&) = delete;
+  ~Ticker() { detach(); }
+
+  void once_ms(uint32_t milliseconds, callback_function_t callback)
+  {
+    arm(milliseconds, false, std::move(callback));
+  }
+
+  void attach_ms(uint32_t milliseconds, callback_function_t callback)
+  {
+    arm(milliseconds, true, std::move(callback));
+  }
+
+  void detach()
+  {
+    shim::tickers.erase(
+      std::remove(shim::tickers.begin(), shim::tickers.end(), this),
+      shim::tickers.end());
+  }
+
+  bool active() const
+  {
+    return std::find(shim::tickers.begin(), shim::tickers.end(), this)
+      != shim::tickers.end();
+  }
+
+  private:
+  friend void shim::runTimers();
+
+  void arm(uint32_t milliseconds, bool repeat, callback_function_t callback)
+  {
+    detach();
+    m_period = milliseconds;
+    m_due = millis() + milliseconds;
+    m_repeat = repeat;
+    m_callback = std::move(callback);
+    shim::tickers.push_back(this);
+  }
+
+  unsigned long m_period{0};
+  unsigned long m_due{0};
+  bool m_repeat{false};
+  callback_function_t m_callback;
+};
+
+namespace shim {
+// Runs the callbacks of all expired timers
+inline void runTimers()
+{
+  const auto expired = tickers;
+  for (auto* ticker : expired) {
+    if (!ticker->active() || ticker->m_due > millis()) {
+      continue;
+    }
+
+    auto callback = ticker->m_callback;
+    if (ticker->m_repeat) {
+      ticker->m_due += std::max(ticker->m_period, 1UL);
+    } else {
+      ticker->detach();
+    }
+    callback();
+  }
+}
+} // namespace shim
+
+#endif // OPEN_HEAT_SHIM_TICKER_H
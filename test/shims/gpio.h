@@ -0,0 +1,13 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_SHIM_GPIO_H
+#define OPEN_HEAT_SHIM_GPIO_H
+
+#include <user_interface.h>
+
+#define GPIO_ID_PIN(pin) (pin)
+
+#endif // OPEN_HEAT_SHIM_GPIO_H
@@ -0,0 +1,67 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_SHIM_INTERRUPTS_H
+#define OPEN_HEAT_SHIM_INTERRUPTS_H
+
+#include <csignal>
+#include <sys/time.h>
+
+// Interrupts are simulated with a timer signal, which runs the routine between
+// any two instructions of the main loop, as an ISR does on the device.
+namespace shim {
+inline void (*isr)() = nullptr;
+
+inline void interruptHandler(int)
+{
+  if (isr != nullptr) {
+    isr();
+  }
+}
+
+inline void startInterrupts(void (*routine)(), const long intervalMicros)
+{
+  isr = routine;
+  struct sigaction action {};
+  action.sa_handler = interruptHandler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGALRM, &action, nullptr);
+
+  const itimerval timer{{0, intervalMicros}, {0, intervalMicros}};
+  setitimer(ITIMER_REAL, &timer, nullptr);
+}
+
+inline void stopInterrupts()
+{
+  const itimerval timer{};
+  setitimer(ITIMER_REAL, &timer, nullptr);
+  isr = nullptr;
+}
+} // namespace shim
+
+namespace esp8266 {
+// masks the simulated interrupts while it exists
+class InterruptLock {
+  public:
+  InterruptLock()
+  {
+    sigset_t interrupts;
+    sigemptyset(&interrupts);
+    sigaddset(&interrupts, SIGALRM);
+    sigprocmask(SIG_BLOCK, &interrupts, &m_previous);
+  }
+
+  ~InterruptLock() { sigprocmask(SIG_SETMASK, &m_previous, nullptr); }
+
+  InterruptLock(const InterruptLock&) = delete;
+  InterruptLock& operator=(const InterruptLock&) = delete;
+
+  private:
+  sigset_t m_previous{};
+};
+} // namespace esp8266
+
+#endif // OPEN_HEAT_SHIM_INTERRUPTS_H
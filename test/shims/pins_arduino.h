@@ -0,0 +1,16 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_SHIM_PINS_ARDUINO_H
+#define OPEN_HEAT_SHIM_PINS_ARDUINO_H
+
+// nodemcuv2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+#define A0 17
+
+#endif // OPEN_HEAT_SHIM_PINS_ARDUINO_H
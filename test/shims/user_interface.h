@@ -0,0 +1,53 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_SHIM_USER_INTERFACE_H
+#define OPEN_HEAT_SHIM_USER_INTERFACE_H
+
+#include <Arduino.h>
+#include <cstdint>
+
+typedef enum { NONE_SLEEP_T = 0, LIGHT_SLEEP_T, MODEM_SLEEP_T } sleep_type_t;
+enum { GPIO_PIN_INTR_LOLEVEL = 4, GPIO_PIN_INTR_HILEVEL = 5 };
+
+namespace shim {
+inline sleep_type_t sleepType = NONE_SLEEP_T;
+} // namespace shim
+
+inline bool wifi_set_sleep_type(sleep_type_t type)
+{
+  shim::sleepType = type;
+  return true;
+}
+
+inline sleep_type_t wifi_get_sleep_type()
+{
+  return shim::sleepType;
+}
+
+inline void wifi_fpm_set_sleep_type(sleep_type_t) {}
+inline void wifi_fpm_open() {}
+inline void wifi_fpm_close() {}
+inline void wifi_fpm_set_wakeup_cb(void (*)()) {}
+inline int8_t wifi_fpm_do_sleep(uint32_t)
+{
+  return 0;
+}
+inline void gpio_pin_wakeup_enable(uint32_t, int) {}
+inline void gpio_pin_wakeup_disable() {}
+inline void system_phy_set_max_tpw(uint8_t) {}
+
+// one tick per us, the calibration is 4096 ticks per 1/4096 us
+inline uint32_t system_get_rtc_time()
+{
+  return static_cast<uint32_t>(shim::microsNow);
+}
+
+inline uint32_t system_rtc_clock_cali_proc()
+{
+  return 4096;
+}
+
+#endif // OPEN_HEAT_SHIM_USER_INTERFACE_H
@@ -0,0 +1,25 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#ifndef OPEN_HEAT_SHIM_YAL_HPP
+#define OPEN_HEAT_SHIM_YAL_HPP
+
+// Log messages are dropped in the tests
+namespace yal {
+enum class Level { TRACE, DEBUG, INFO, WARNING, ERROR, FATAL, OFF };
+
+class Logger {
+  public:
+  Logger() = default;
+  explicit Logger(const char*) {}
+
+  template<typename... Args>
+  void log(Level, const char*, const Args&...) const
+  {
+  }
+};
+} // namespace yal
+
+#endif // OPEN_HEAT_SHIM_YAL_HPP
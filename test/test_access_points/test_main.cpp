@@ -0,0 +1,113 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <NativeDevice.hpp>
+#include <RTCMemory.hpp>
+#include <network/AccessPoints.hpp>
+#include <cstring>
+#include <unity.h>
+
+using open_heat::network::AccessPoints;
+
+namespace {
+// device with credentials of "home" which was seen before on channel 6
+void configured(open_heat::Filesystem& fs)
+{
+  open_heat::rtc::init(fs);
+  auto& credentials = fs.getConfig().WifiCredentials;
+  std::strcpy(credentials.ssid, "home");
+  std::strcpy(credentials.password, "password");
+
+  shim::networks = {{"home", -60, {1, 2, 3, 4, 5, 6}, 6}};
+  AccessPoints accessPoints(fs);
+  accessPoints.load();
+  accessPoints.updateFromScan(1);
+  accessPoints.persist();
+}
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+}
+
+void tearDown() {}
+
+void test_failures_do_not_write_the_list()
+{
+  open_heat::Filesystem fs;
+  configured(fs);
+  const auto writes = shim::fileWrites;
+
+  // a failed wake during an outage
+  AccessPoints accessPoints(fs);
+  accessPoints.load();
+  AccessPoints::recordFailure(0);
+  AccessPoints::recordFailure(0);
+  accessPoints.persist();
+
+  TEST_ASSERT_EQUAL(writes, shim::fileWrites);
+  TEST_ASSERT_EQUAL(2, accessPoints.failures(0));
+}
+
+void test_failures_are_persisted_with_the_next_write()
+{
+  open_heat::Filesystem fs;
+  configured(fs);
+
+  AccessPoints accessPoints(fs);
+  accessPoints.load();
+  AccessPoints::recordFailure(0);
+  accessPoints.recordConnect(0, 2000);
+  accessPoints.persist();
+  TEST_ASSERT_EQUAL(0, open_heat::rtc::accessPointFailures(0));
+
+  // the rtc memory is lost, the list keeps the failure
+  shim::powerOn();
+  open_heat::rtc::init(fs);
+  AccessPoints restarted(fs);
+  restarted.load();
+  TEST_ASSERT_EQUAL(1, restarted.failures(0));
+  TEST_ASSERT_EQUAL(1, restarted[0].connects);
+}
+
+void test_scan_updates_the_ranking()
+{
+  open_heat::Filesystem fs;
+  configured(fs);
+
+  AccessPoints accessPoints(fs);
+  accessPoints.load();
+  accessPoints.set(1, "attic", "password");
+  shim::networks = {{"attic", -50, {6, 5, 4, 3, 2, 1}, 11}, {"home", -70, {}, 6}};
+  accessPoints.updateFromScan(2);
+
+  const auto ranking = accessPoints.ranking();
+  TEST_ASSERT_EQUAL(2, ranking.size());
+  TEST_ASSERT_EQUAL(1, ranking[0]);
+  TEST_ASSERT_EQUAL(11, accessPoints[1].channel);
+}
+
+void test_other_access_point_starts_without_failures()
+{
+  open_heat::Filesystem fs;
+  configured(fs);
+
+  AccessPoints accessPoints(fs);
+  accessPoints.load();
+  AccessPoints::recordFailure(0);
+  accessPoints.set(0, "office", "password");
+  TEST_ASSERT_EQUAL(0, accessPoints.failures(0));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_failures_do_not_write_the_list);
+  RUN_TEST(test_failures_are_persisted_with_the_next_write);
+  RUN_TEST(test_scan_updates_the_ranking);
+  RUN_TEST(test_other_access_point_starts_without_failures);
+  return UNITY_END();
+}
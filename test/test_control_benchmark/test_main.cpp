@@ -0,0 +1,226 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+// Closed loop benchmark of the valve control against the simulated room of
+// shim::RoomSimulator. Every scenario runs several days of wakes in simulated
+// time, the way main.cpp does without a broker, and the control statistics are
+// compared with the baseline below. A change that makes the control worse fails
+// here, one that makes it better has to lower the baseline.
+
+#include <NativeDevice.hpp>
+#include <RTCMemory.hpp>
+#include <RoomSimulator.hpp>
+#include <WakeScheduler.hpp>
+#include <heating/RadiatorValve.hpp>
+#include <cstdio>
+#include <unity.h>
+
+using namespace open_heat;
+
+namespace {
+constexpr uint64_t MILLIS_PER_HOUR = 60 * 60 * 1000;
+constexpr uint64_t MILLIS_PER_DAY = 24 * MILLIS_PER_HOUR;
+
+// comfort temperature from 6:00 to 22:00, the simulation starts at midnight
+constexpr float NIGHT_TEMP = 17;
+constexpr float DAY_TEMP = 21;
+constexpr uint64_t DAY_START_MILLIS = 6 * MILLIS_PER_HOUR;
+constexpr uint64_t NIGHT_START_MILLIS = 22 * MILLIS_PER_HOUR;
+
+struct Metrics {
+  // worst over the morning heat ups, which are the steps the control can overshoot
+  float overshoot;
+  uint32_t settlingSeconds;
+  // totals of the scenario
+  uint32_t motorOnMillis;
+  uint32_t wakes;
+};
+
+struct Scenario {
+  const char* name;
+  shim::RoomSimulator::Parameters room;
+  int days;
+  // measured with the control this benchmark was added for
+  Metrics baseline;
+};
+
+/**
+  A regression has to exceed the baseline by more than this, so the benchmark
+  does not fail on rounding differences between compilers.
+  Unit: 1
+*/
+constexpr double TOLERANCE = 1.05;
+
+float setTempAt(const uint64_t millis)
+{
+  const auto timeOfDay = millis % MILLIS_PER_DAY;
+  const auto comfort = timeOfDay >= DAY_START_MILLIS && timeOfDay < NIGHT_START_MILLIS;
+  return comfort ? DAY_TEMP : NIGHT_TEMP;
+}
+
+uint64_t nextTransition(const uint64_t millis)
+{
+  const auto day = millis - millis % MILLIS_PER_DAY;
+  for (const auto transition :
+       {day + DAY_START_MILLIS, day + NIGHT_START_MILLIS, day + MILLIS_PER_DAY}) {
+    if (transition > millis) {
+      return transition;
+    }
+  }
+  return day + MILLIS_PER_DAY + DAY_START_MILLIS;
+}
+
+class Benchmark {
+  public:
+  explicit Benchmark(const Scenario& scenario) :
+      m_room(scenario.room, NIGHT_TEMP, 0.5F),
+      m_sensor(&m_room),
+      m_endMillis(static_cast<uint64_t>(scenario.days) * MILLIS_PER_DAY)
+  {
+  }
+
+  Metrics run()
+  {
+    powerOn();
+    while (rtc::offsetMillis() < m_endMillis) {
+      boot();
+    }
+
+    m_metrics.motorOnMillis = rtc::get<&rtc::Memory::controlStats>().motorOnMillis;
+    return m_metrics;
+  }
+
+  private:
+  void powerOn()
+  {
+    Filesystem fs;
+    fs.setup();
+    rtc::init(fs);
+    heating::RadiatorValve valve(m_sensor, fs);
+    valve.setup();
+    valve.setConfiguredTemp(setTempAt(0));
+    valve.setMode(HEAT);
+    rtc::commit();
+  }
+
+  // runs the wakes of one boot, light sleeps keep the RAM
+  void boot()
+  {
+    Filesystem fs;
+    fs.warmSetup();
+    heating::RadiatorValve valve(m_sensor, fs);
+    valve.setup();
+
+    WakeScheduler::Wake wake{};
+    do {
+      ++m_metrics.wakes;
+      applyProgram(valve);
+      valve.loop();
+      while (valve.isMotorRunning()) {
+        // the room sees the pins before the timers switch them
+        m_room.update();
+        shim::runTimers();
+        valve.waitForMotor();
+      }
+      m_room.update();
+
+      // no broker is configured, the program changes the set temperature instead
+      WakeScheduler::cancel(WakeScheduler::Task::MQTT);
+      WakeScheduler::schedule(
+        WakeScheduler::Task::SCHEDULE, nextTransition(rtc::offsetMillis()));
+      wake = WakeScheduler::nextWake(false);
+      WakeScheduler::sleep(wake, fs);
+    } while (wake.lightSleep && rtc::offsetMillis() < m_endMillis);
+
+    shim::reboot();
+  }
+
+  void applyProgram(heating::RadiatorValve& valve)
+  {
+    const auto setTemp = setTempAt(rtc::offsetMillis());
+    if (setTemp == heating::RadiatorValve::getConfiguredTemp()) {
+      return;
+    }
+
+    // the statistics cover the time since the last change
+    if (setTemp < heating::RadiatorValve::getConfiguredTemp()) {
+      const auto stats = rtc::get<&rtc::Memory::controlStats>();
+      // a heat up which did not settle counts with its full duration
+      const auto elapsedMillis = rtc::offsetMillis() - stats.setTempChangedMillis;
+      const auto settlingSeconds = stats.settlingSeconds > 0
+        ? stats.settlingSeconds
+        : static_cast<uint32_t>(elapsedMillis / 1000);
+      m_metrics.overshoot = std::max(m_metrics.overshoot, stats.overshoot);
+      m_metrics.settlingSeconds = std::max(m_metrics.settlingSeconds, settlingSeconds);
+    }
+    valve.setConfiguredTemp(setTemp);
+  }
+
+  shim::RoomSimulator m_room;
+  sensors::Temperature* m_sensor;
+  uint64_t m_endMillis;
+  Metrics m_metrics{};
+};
+
+void assertNotWorse(const char* metric, const double baseline, const double actual)
+{
+  char message[96];
+  std::snprintf(
+    message, sizeof(message), "%s regressed from %.2f to %.2f", metric, baseline, actual);
+  TEST_ASSERT_TRUE_MESSAGE(actual <= baseline * TOLERANCE, message);
+}
+
+void check(const Scenario& scenario)
+{
+  const auto metrics = Benchmark(scenario).run();
+
+  char message[160];
+  std::snprintf(
+    message,
+    sizeof(message),
+    "%s: overshoot %.2f C, settling %u s, motor on %u ms, %u wakes",
+    scenario.name,
+    static_cast<double>(metrics.overshoot),
+    metrics.settlingSeconds,
+    metrics.motorOnMillis,
+    metrics.wakes);
+  TEST_MESSAGE(message);
+
+  const auto& baseline = scenario.baseline;
+  assertNotWorse("overshoot", baseline.overshoot, metrics.overshoot);
+  assertNotWorse("settling", baseline.settlingSeconds, metrics.settlingSeconds);
+  assertNotWorse("motor on", baseline.motorOnMillis, metrics.motorOnMillis);
+  assertNotWorse("wakes", baseline.wakes, metrics.wakes);
+}
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+}
+
+void tearDown() {}
+
+void test_cold_week()
+{
+  shim::RoomSimulator::Parameters room;
+  room.outsideTemp = -5;
+  check({"cold week", room, 7, {0.60F, 13500, 4307585, 1576}});
+}
+
+void test_mild_days()
+{
+  shim::RoomSimulator::Parameters room;
+  room.outsideTemp = 12;
+  check({"mild days", room, 4, {1.89F, 6900, 858595, 850}});
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_cold_week);
+  RUN_TEST(test_mild_days);
+  return UNITY_END();
+}
@@ -0,0 +1,135 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <NativeDevice.hpp>
+#include <hardware/DoubleResetDetector.hpp>
+#include <unity.h>
+
+using open_heat::hardware::DoubleResetDetector;
+using Reset = DoubleResetDetector::Reset;
+
+void setUp()
+{
+  shim::factoryReset();
+}
+
+void tearDown() {}
+
+void test_power_on_arms_the_flag()
+{
+  const auto result = DoubleResetDetector::evaluate(Reset::POWER_ON, 0);
+  TEST_ASSERT_FALSE(result.doubleReset);
+  TEST_ASSERT_EQUAL_HEX32(DoubleResetDetector::FLAG_ARMED, result.flag);
+}
+
+void test_second_reset_is_a_double_reset()
+{
+  const auto first
+    = DoubleResetDetector::evaluate(Reset::EXTERNAL, DoubleResetDetector::FLAG_CLEAR);
+  TEST_ASSERT_FALSE(first.doubleReset);
+  TEST_ASSERT_TRUE(
+    DoubleResetDetector::evaluate(Reset::EXTERNAL, first.flag).doubleReset);
+}
+
+void test_third_reset_is_a_new_first_one()
+{
+  const auto second
+    = DoubleResetDetector::evaluate(Reset::EXTERNAL, DoubleResetDetector::FLAG_ARMED);
+  TEST_ASSERT_TRUE(second.doubleReset);
+  TEST_ASSERT_FALSE(
+    DoubleResetDetector::evaluate(Reset::EXTERNAL, second.flag).doubleReset);
+}
+
+void test_deep_sleep_wake_clears_the_flag()
+{
+  const auto wake
+    = DoubleResetDetector::evaluate(Reset::OTHER, DoubleResetDetector::FLAG_ARMED);
+  TEST_ASSERT_FALSE(wake.doubleReset);
+  TEST_ASSERT_FALSE(
+    DoubleResetDetector::evaluate(Reset::EXTERNAL, wake.flag).doubleReset);
+}
+
+void test_random_flag_after_power_loss()
+{
+  TEST_ASSERT_FALSE(
+    DoubleResetDetector::evaluate(Reset::EXTERNAL, 0xFFFFFFFF).doubleReset);
+}
+
+void test_detects_two_resets_in_rtc_memory()
+{
+  DoubleResetDetector powerOn;
+  TEST_ASSERT_FALSE(powerOn.detect());
+
+  shim::reboot(REASON_EXT_SYS_RST);
+  DoubleResetDetector reset;
+  TEST_ASSERT_TRUE(reset.detect());
+
+  shim::reboot(REASON_EXT_SYS_RST);
+  DoubleResetDetector third;
+  TEST_ASSERT_FALSE(third.detect());
+}
+
+void test_reset_after_the_timeout_is_single()
+{
+  DoubleResetDetector powerOn;
+  TEST_ASSERT_FALSE(powerOn.detect());
+  shim::advanceMillis(11 * 1000);
+  powerOn.loop();
+
+  shim::reboot(REASON_EXT_SYS_RST);
+  DoubleResetDetector reset;
+  TEST_ASSERT_FALSE(reset.detect());
+}
+
+void test_reset_after_sleeping_is_single()
+{
+  DoubleResetDetector powerOn;
+  TEST_ASSERT_FALSE(powerOn.detect());
+  powerOn.stop();
+
+  shim::reboot(REASON_DEEP_SLEEP_AWAKE);
+  DoubleResetDetector wake;
+  TEST_ASSERT_FALSE(wake.detect());
+
+  shim::reboot(REASON_EXT_SYS_RST);
+  DoubleResetDetector reset;
+  TEST_ASSERT_FALSE(reset.detect());
+}
+
+void test_detection_does_not_touch_the_filesystem()
+{
+  const auto resets = {
+    REASON_DEFAULT_RST,
+    REASON_EXT_SYS_RST,
+    REASON_EXT_SYS_RST,
+    REASON_DEEP_SLEEP_AWAKE,
+    REASON_EXT_SYS_RST};
+  for (const auto reason : resets) {
+    shim::reboot(reason);
+    DoubleResetDetector detector;
+    detector.detect();
+    shim::advanceMillis(11 * 1000);
+    detector.loop();
+  }
+
+  TEST_ASSERT_EQUAL(0, shim::mounts);
+  TEST_ASSERT_EQUAL(0, shim::fileWrites);
+  TEST_ASSERT_TRUE(shim::files.empty());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_power_on_arms_the_flag);
+  RUN_TEST(test_second_reset_is_a_double_reset);
+  RUN_TEST(test_third_reset_is_a_new_first_one);
+  RUN_TEST(test_deep_sleep_wake_clears_the_flag);
+  RUN_TEST(test_random_flag_after_power_loss);
+  RUN_TEST(test_detects_two_resets_in_rtc_memory);
+  RUN_TEST(test_reset_after_the_timeout_is_single);
+  RUN_TEST(test_reset_after_sleeping_is_single);
+  RUN_TEST(test_detection_does_not_touch_the_filesystem);
+  return UNITY_END();
+}
@@ -0,0 +1,224 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <Filesystem.hpp>
+#include <NativeDevice.hpp>
+#include <RTCMemory.hpp>
+#include <cstring>
+#include <unity.h>
+
+namespace {
+// Config as written by the firmware before the config was versioned
+typedef struct {
+  char ssid[32];
+  char password[64];
+} WiFiCredentialsV1;
+
+typedef struct {
+  char Server[32]{};
+  unsigned short Port = 1883;
+  char Topic[64]{};
+  char Username[32]{};
+  char Password[32]{};
+} MQTTSettingsV1;
+
+typedef struct {
+  char Username[32]{};
+  char Password[64]{};
+} UpdateSettingsV1;
+
+typedef struct {
+  WiFiCredentialsV1 WifiCredentials{"", ""};
+  MQTTSettingsV1 MQTT{};
+  UpdateSettingsV1 Update{};
+  char Hostname[32]{};
+  float SetTemperature{18};
+  OperationMode Mode{OFF};
+  PinSettings MotorPins{DEFAULT_MOTOR_GROUND, DEFAULT_MOTOR_VIN};
+  PinSettings WindowPins{};
+  int8_t TempVin{DEFAULT_TEMP_VIN};
+  TemperatureSensor TempSensor{TemperatureSensor::BME};
+} ConfigV1;
+
+void writeConfigV1()
+{
+  ConfigV1 config{};
+  std::strcpy(config.WifiCredentials.ssid, "home");
+  std::strcpy(config.WifiCredentials.password, "password");
+  std::strcpy(config.MQTT.Server, "broker");
+  config.MQTT.Port = 8883;
+  std::strcpy(config.MQTT.Topic, "heat/living/");
+  std::strcpy(config.MQTT.Username, "mqtt");
+  std::strcpy(config.MQTT.Password, "secret");
+  std::strcpy(config.Update.Username, "update");
+  std::strcpy(config.Update.Password, "letmein");
+  std::strcpy(config.Hostname, "living");
+  config.SetTemperature = 21.5;
+  config.Mode = HEAT;
+  config.WindowPins = {D8, D7};
+  config.TempSensor = BMP;
+
+  shim::files["/config.dat"] = std::make_shared<std::string>(
+    reinterpret_cast<const char*>(&config), sizeof(config));
+}
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+}
+
+void tearDown() {}
+
+void test_version_1_config_is_migrated()
+{
+  writeConfigV1();
+  open_heat::Filesystem fs;
+  TEST_ASSERT_TRUE(fs.setup());
+
+  const auto& config = fs.getConfig();
+  TEST_ASSERT_EQUAL_STRING("home", config.WifiCredentials.ssid);
+  TEST_ASSERT_EQUAL_STRING("password", config.WifiCredentials.password);
+  TEST_ASSERT_EQUAL_STRING("broker", config.MQTT.Server);
+  TEST_ASSERT_EQUAL(8883, config.MQTT.Port);
+  TEST_ASSERT_EQUAL_STRING("heat/living/", config.MQTT.Topic);
+  TEST_ASSERT_EQUAL_STRING("mqtt", config.MQTT.Username);
+  TEST_ASSERT_EQUAL_STRING("secret", config.MQTT.Password);
+  TEST_ASSERT_EQUAL_STRING("update", config.Update.Username);
+  TEST_ASSERT_EQUAL_STRING("letmein", config.Update.Password);
+  TEST_ASSERT_EQUAL_STRING("living", config.Hostname);
+  TEST_ASSERT_EQUAL_FLOAT(21.5, config.SetTemperature);
+  TEST_ASSERT_EQUAL(HEAT, config.Mode);
+  TEST_ASSERT_EQUAL(DEFAULT_MOTOR_GROUND, config.MotorPins.Ground);
+  TEST_ASSERT_EQUAL(DEFAULT_MOTOR_VIN, config.MotorPins.Vin);
+  TEST_ASSERT_EQUAL(D8, config.WindowPins.Ground);
+  TEST_ASSERT_EQUAL(D7, config.WindowPins.Vin);
+  TEST_ASSERT_EQUAL(DEFAULT_TEMP_VIN, config.TempVin);
+  TEST_ASSERT_EQUAL(BMP, config.TempSensor);
+}
+
+void test_migration_keeps_the_defaults_of_new_settings()
+{
+  writeConfigV1();
+  open_heat::Filesystem fs;
+  fs.setup();
+
+  const auto& config = fs.getConfig();
+  const TelemetrySettings telemetry{};
+  TEST_ASSERT_EQUAL(STATE_JSON, config.MQTT.Format);
+  // subscribers of the single value topics keep working
+  TEST_ASSERT_TRUE(config.MQTT.LegacyTopics);
+  TEST_ASSERT_EQUAL_MEMORY(&telemetry, &config.Telemetry, sizeof(telemetry));
+}
+
+void test_migrated_config_is_persisted()
+{
+  writeConfigV1();
+  open_heat::Filesystem migrating;
+  migrating.setup();
+  TEST_ASSERT_EQUAL(
+    sizeof(CONFIG_VERSION) + sizeof(Config), shim::files["/config.dat"]->size());
+
+  shim::reboot();
+  const auto writes = shim::fileWrites;
+  open_heat::Filesystem fs;
+  TEST_ASSERT_TRUE(fs.setup());
+  TEST_ASSERT_EQUAL(writes, shim::fileWrites);
+  TEST_ASSERT_EQUAL_STRING("broker", fs.getConfig().MQTT.Server);
+}
+
+void test_persisted_config_is_read_again()
+{
+  open_heat::Filesystem persisting;
+  TEST_ASSERT_FALSE(persisting.setup());
+  auto& config = persisting.getConfig();
+  std::strcpy(config.MQTT.Server, "broker");
+  config.MQTT.Format = STATE_CBOR;
+  config.MQTT.LegacyTopics = false;
+  config.Telemetry.HeartbeatMinutes = 15;
+  persisting.persistConfig();
+
+  shim::reboot();
+  open_heat::Filesystem fs;
+  TEST_ASSERT_TRUE(fs.setup());
+  TEST_ASSERT_EQUAL_STRING("broker", fs.getConfig().MQTT.Server);
+  TEST_ASSERT_EQUAL(STATE_CBOR, fs.getConfig().MQTT.Format);
+  TEST_ASSERT_FALSE(fs.getConfig().MQTT.LegacyTopics);
+  TEST_ASSERT_EQUAL(15, fs.getConfig().Telemetry.HeartbeatMinutes);
+}
+
+void test_unknown_version_invalidates_the_config()
+{
+  open_heat::Filesystem persisting;
+  persisting.setup();
+  std::strcpy(persisting.getConfig().MQTT.Server, "broker");
+  persisting.persistConfig();
+  (*shim::files["/config.dat"])[0] = static_cast<char>(CONFIG_VERSION + 1);
+
+  shim::reboot();
+  open_heat::Filesystem fs;
+  TEST_ASSERT_FALSE(fs.setup());
+  TEST_ASSERT_EQUAL_STRING("", fs.getConfig().MQTT.Server);
+}
+
+void test_warm_boot_does_not_mount_the_filesystem()
+{
+  writeConfigV1();
+  open_heat::Filesystem migrating;
+  migrating.setup();
+  shim::mounts = 0;
+  shim::fileReadBytes = 0;
+
+  // power on
+  open_heat::Filesystem cold;
+  TEST_ASSERT_TRUE(cold.setup());
+  open_heat::rtc::init(cold);
+  open_heat::rtc::commit();
+  TEST_ASSERT_EQUAL(1, shim::mounts);
+  TEST_ASSERT_EQUAL(sizeof(CONFIG_VERSION) + sizeof(Config), shim::fileReadBytes);
+
+  // valve wake
+  shim::reboot();
+  shim::fileReadBytes = 0;
+  open_heat::Filesystem warm;
+  TEST_ASSERT_TRUE(warm.warmSetup());
+  const auto& hardware = warm.getHardwareConfig();
+  TEST_ASSERT_EQUAL(D8, hardware.WindowPins.Ground);
+  TEST_ASSERT_EQUAL(BMP, hardware.TempSensor);
+  TEST_ASSERT_EQUAL(1, shim::mounts);
+  TEST_ASSERT_EQUAL(0, shim::fileReadBytes);
+
+  // radio wake, mounted once the full config is needed
+  TEST_ASSERT_EQUAL_STRING("broker", warm.getConfig().MQTT.Server);
+  TEST_ASSERT_EQUAL(2, shim::mounts);
+}
+
+void test_power_loss_mounts_the_filesystem()
+{
+  writeConfigV1();
+  open_heat::Filesystem cold;
+  cold.setup();
+  open_heat::rtc::init(cold);
+  open_heat::rtc::commit();
+
+  shim::powerOn();
+  open_heat::Filesystem fs;
+  TEST_ASSERT_TRUE(fs.warmSetup());
+  TEST_ASSERT_EQUAL(2, shim::mounts);
+  TEST_ASSERT_EQUAL(D8, fs.getHardwareConfig().WindowPins.Ground);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_version_1_config_is_migrated);
+  RUN_TEST(test_migration_keeps_the_defaults_of_new_settings);
+  RUN_TEST(test_migrated_config_is_persisted);
+  RUN_TEST(test_persisted_config_is_read_again);
+  RUN_TEST(test_unknown_version_invalidates_the_config);
+  RUN_TEST(test_warm_boot_does_not_mount_the_filesystem);
+  RUN_TEST(test_power_loss_mounts_the_filesystem);
+  return UNITY_END();
+}
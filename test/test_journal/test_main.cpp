@@ -0,0 +1,206 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <NativeDevice.hpp>
+#include <RTCMemory.hpp>
+#include <network/Journal.hpp>
+#include <algorithm>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+using open_heat::network::Journal;
+
+namespace {
+std::vector<std::string> published;
+
+bool publish(const String& batch)
+{
+  published.emplace_back(batch.c_str());
+  return true;
+}
+
+bool failPublish(const String&)
+{
+  return false;
+}
+
+// publishes the first batches, then the broker goes away
+size_t publishLimit = 0;
+bool limitedPublish(const String& batch)
+{
+  if (published.size() >= publishLimit) {
+    return false;
+  }
+  return publish(batch);
+}
+
+std::string content(const char* path)
+{
+  const auto file = shim::files.find(path);
+  return file == shim::files.end() ? std::string() : *file->second;
+}
+
+// fills about one segment with entries of a wake
+void appendWakes(Journal& journal, size_t wakes)
+{
+  for (size_t i = 0; i < wakes; ++i) {
+    journal.append({{"state", String(std::string(100, 'x'))}});
+    shim::advanceMillis(60 * 1000);
+  }
+}
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+  open_heat::Filesystem fs;
+  open_heat::rtc::init(fs);
+  published.clear();
+}
+
+void tearDown() {}
+
+void test_entries_of_a_wake_are_appended_with_one_write()
+{
+  open_heat::Filesystem fs;
+  Journal journal(fs);
+  shim::advanceMillis(5000);
+  const auto writes = shim::fileWrites;
+  journal.append({{"state", "{\"temp\":2100}"}, {"log", "line\nbreak"}});
+
+  TEST_ASSERT_EQUAL(writes + 1, shim::fileWrites);
+  TEST_ASSERT_EQUAL_STRING(
+    "5,state,{\"temp\":2100}\n5,log,line break\n", content("/journal1.txt").c_str());
+}
+
+void test_replay_sends_the_age_and_removes_the_segment()
+{
+  open_heat::Filesystem fs;
+  Journal journal(fs);
+  journal.append({{"state", "a"}, {"mode/get", "0"}});
+  shim::advanceMillis(90 * 1000);
+
+  TEST_ASSERT_TRUE(journal.replay(publish));
+  TEST_ASSERT_EQUAL(1, published.size());
+  TEST_ASSERT_EQUAL_STRING("90,state,a\n90,mode/get,0", published[0].c_str());
+  TEST_ASSERT_FALSE(shim::files.count("/journal1.txt"));
+
+  published.clear();
+  TEST_ASSERT_TRUE(journal.replay(publish));
+  TEST_ASSERT_TRUE(published.empty());
+}
+
+void test_long_entries_are_truncated()
+{
+  open_heat::Filesystem fs;
+  Journal journal(fs);
+  journal.append({{"log", String(std::string(1000, 'x'))}});
+
+  TEST_ASSERT_EQUAL(Journal::ENTRY_MAX_SIZE + 1, content("/journal1.txt").size());
+}
+
+void test_replay_is_split_into_batches()
+{
+  open_heat::Filesystem fs;
+  Journal journal(fs);
+  appendWakes(journal, 40);
+
+  TEST_ASSERT_TRUE(journal.replay(publish));
+  TEST_ASSERT_GREATER_THAN(1, published.size());
+  size_t entries = 0;
+  for (const auto& batch : published) {
+    TEST_ASSERT_LESS_OR_EQUAL(Journal::BATCH_MAX_SIZE, batch.size());
+    entries += std::count(batch.begin(), batch.end(), '\n') + 1;
+  }
+  TEST_ASSERT_EQUAL(40, entries);
+  // oldest first
+  TEST_ASSERT_EQUAL(0, published[0].find("2400,state,"));
+}
+
+void test_full_segment_replaces_the_older_one()
+{
+  open_heat::Filesystem fs;
+  Journal journal(fs);
+  const auto entriesPerSegment = Journal::SEGMENT_SIZE / 112;
+  appendWakes(journal, 3 * entriesPerSegment);
+
+  TEST_ASSERT_LESS_OR_EQUAL(Journal::SEGMENT_SIZE, content("/journal0.txt").size());
+  TEST_ASSERT_LESS_OR_EQUAL(Journal::SEGMENT_SIZE, content("/journal1.txt").size());
+
+  // the oldest third was dropped
+  TEST_ASSERT_TRUE(journal.replay(publish));
+  const auto oldest = std::stoul(published[0].substr(0, published[0].find(',')));
+  TEST_ASSERT_LESS_THAN(2 * entriesPerSegment * 60 + 60, oldest);
+}
+
+void test_failed_replay_keeps_the_entries()
+{
+  open_heat::Filesystem fs;
+  Journal journal(fs);
+  journal.append({{"state", "a"}});
+
+  TEST_ASSERT_FALSE(journal.replay(failPublish));
+  TEST_ASSERT_TRUE(journal.replay(publish));
+  TEST_ASSERT_EQUAL(1, published.size());
+}
+
+void test_failed_replay_resumes_after_the_published_batches()
+{
+  open_heat::Filesystem fs;
+  Journal journal(fs);
+  appendWakes(journal, 40);
+
+  publishLimit = 2;
+  TEST_ASSERT_FALSE(journal.replay(limitedPublish));
+  TEST_ASSERT_EQUAL(2, published.size());
+  const auto entriesOf = [](const std::string& batch) {
+    return static_cast<size_t>(std::count(batch.begin(), batch.end(), '\n') + 1);
+  };
+  const auto sent = entriesOf(published[0]) + entriesOf(published[1]);
+  TEST_ASSERT_FALSE(shim::files.count("/journal.tmp"));
+
+  // only the entries which were not published are sent again
+  published.clear();
+  TEST_ASSERT_TRUE(journal.replay(publish));
+  size_t resent = 0;
+  for (const auto& batch : published) {
+    resent += entriesOf(batch);
+  }
+  TEST_ASSERT_EQUAL(40, sent + resent);
+  TEST_ASSERT_FALSE(shim::files.count("/journal1.txt"));
+}
+
+void test_entries_from_before_the_rtc_reset_are_dropped()
+{
+  open_heat::Filesystem fs;
+  Journal journal(fs);
+  shim::advanceMillis(600 * 1000);
+  journal.append({{"state", "old"}});
+
+  // power loss, offsetMillis() starts at 0 again
+  shim::powerOn();
+  open_heat::rtc::init(fs);
+  shim::advanceMillis(60 * 1000);
+  journal.append({{"state", "new"}});
+
+  TEST_ASSERT_TRUE(journal.replay(publish));
+  TEST_ASSERT_EQUAL(1, published.size());
+  TEST_ASSERT_EQUAL_STRING("0,state,new", published[0].c_str());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_entries_of_a_wake_are_appended_with_one_write);
+  RUN_TEST(test_replay_sends_the_age_and_removes_the_segment);
+  RUN_TEST(test_long_entries_are_truncated);
+  RUN_TEST(test_replay_is_split_into_batches);
+  RUN_TEST(test_full_segment_replaces_the_older_one);
+  RUN_TEST(test_failed_replay_keeps_the_entries);
+  RUN_TEST(test_failed_replay_resumes_after_the_published_batches);
+  RUN_TEST(test_entries_from_before_the_rtc_reset_are_dropped);
+  return UNITY_END();
+}
@@ -0,0 +1,126 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <NativeDevice.hpp>
+#include <Ticker.h>
+#include <heating/MotorDriver.hpp>
+#include <unity.h>
+
+using open_heat::heating::MotorDriver;
+
+namespace {
+// runs the main loop until all commands are done
+void idleUntilStopped(MotorDriver& motor)
+{
+  while (motor.isRunning()) {
+    motor.idle();
+    shim::runTimers();
+  }
+}
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+  shim::analogValue = 800;
+}
+
+void tearDown() {}
+
+void test_ramp_rises_linearly_to_the_ceiling()
+{
+  TEST_ASSERT_EQUAL(0, MotorDriver::rampDuty(0, 100, 100));
+  TEST_ASSERT_EQUAL(MOTOR_PWM_RANGE / 2, MotorDriver::rampDuty(50, 100, 100));
+  TEST_ASSERT_EQUAL(MOTOR_PWM_RANGE, MotorDriver::rampDuty(100, 100, 100));
+  TEST_ASSERT_EQUAL(MOTOR_PWM_RANGE / 2, MotorDriver::rampDuty(500, 100, 50));
+  // no ramp
+  TEST_ASSERT_EQUAL(MOTOR_PWM_RANGE, MotorDriver::rampDuty(0, 0, 100));
+}
+
+void test_run_is_extended_by_the_ramp_deficit()
+{
+  // the ramp turns the valve as far as half its duration at full duty
+  TEST_ASSERT_EQUAL(1125, MotorDriver::rampedMillis(1000, 250));
+  TEST_ASSERT_EQUAL(250, MotorDriver::rampedMillis(125, 250));
+  // ends within the ramp, 100^2 / (2 * 250) = 20
+  TEST_ASSERT_EQUAL(100, MotorDriver::rampedMillis(20, 250));
+  TEST_ASSERT_EQUAL(0, MotorDriver::rampedMillis(0, 250));
+  TEST_ASSERT_EQUAL(1000, MotorDriver::rampedMillis(1000, 0));
+}
+
+void test_rotation_matches_a_run_without_ramp()
+{
+  open_heat::Filesystem fs;
+  MotorDriver motor(fs);
+  motor.setup();
+
+  // integrates the duty cycle of the pwm pin over the run
+  const auto pwmPin = static_cast<uint8_t>(fs.getHardwareConfig().MotorPins.Ground);
+  float fullDutyMillis = 0;
+  unsigned long runMillis = 0;
+  motor.rotate(MotorDriver::Direction::OPEN, 1000, [&](unsigned long run, bool) {
+    runMillis = run;
+  });
+  while (motor.isRunning()) {
+    const auto duty = shim::pinLevels[pwmPin] == HIGH
+      ? MOTOR_PWM_RANGE
+      : shim::pwmDuty[pwmPin];
+    fullDutyMillis += static_cast<float>(duty) / MOTOR_PWM_RANGE;
+    shim::advanceMillis(1);
+    shim::runTimers();
+    motor.loop();
+  }
+
+  TEST_ASSERT_EQUAL(MotorDriver::rampedMillis(1000, MOTOR_RAMP_MILLIS), runMillis);
+  TEST_ASSERT_FLOAT_WITHIN(15, 1000, fullDutyMillis);
+}
+
+void test_idle_enables_light_sleep_while_running()
+{
+  open_heat::Filesystem fs;
+  MotorDriver motor(fs);
+  motor.setup();
+
+  motor.rotate(MotorDriver::Direction::OPEN, 1000);
+  motor.idle();
+  TEST_ASSERT_EQUAL(LIGHT_SLEEP_T, shim::sleepType);
+}
+
+void test_sleep_type_is_restored_when_the_motor_stops()
+{
+  open_heat::Filesystem fs;
+  MotorDriver motor(fs);
+  motor.setup();
+  wifi_set_sleep_type(MODEM_SLEEP_T);
+
+  motor.rotate(MotorDriver::Direction::OPEN, 1000);
+  motor.rotate(MotorDriver::Direction::CLOSE, 500);
+  idleUntilStopped(motor);
+  TEST_ASSERT_EQUAL(MODEM_SLEEP_T, shim::sleepType);
+}
+
+void test_sleep_type_is_restored_on_stop()
+{
+  open_heat::Filesystem fs;
+  MotorDriver motor(fs);
+  motor.setup();
+
+  motor.rotate(MotorDriver::Direction::OPEN, 1000);
+  motor.idle();
+  motor.stop();
+  TEST_ASSERT_EQUAL(NONE_SLEEP_T, shim::sleepType);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_ramp_rises_linearly_to_the_ceiling);
+  RUN_TEST(test_run_is_extended_by_the_ramp_deficit);
+  RUN_TEST(test_rotation_matches_a_run_without_ramp);
+  RUN_TEST(test_idle_enables_light_sleep_while_running);
+  RUN_TEST(test_sleep_type_is_restored_when_the_motor_stops);
+  RUN_TEST(test_sleep_type_is_restored_on_stop);
+  return UNITY_END();
+}
@@ -0,0 +1,136 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <NativeDevice.hpp>
+#include <RTCMemory.hpp>
+#include <network/MqttSession.hpp>
+#include <unity.h>
+
+using open_heat::network::MqttSession;
+
+namespace {
+const String MODE_TOPIC("heat/mode/set");
+const String TEMP_TOPIC("heat/temperature/target/set");
+const String WINDOW_TOPIC("heat/window/get");
+const std::vector<const String*> TOPICS{&MODE_TOPIC, &TEMP_TOPIC};
+
+// Broker which keeps the session of the client id while the device sleeps.
+// Returns the round trips until the device is ready: connect and subscribes.
+struct Broker {
+  bool sessionPresent{false};
+
+  size_t connect(const char* clientId, const std::vector<const String*>& topics)
+  {
+    const auto subscriptions = MqttSession::subscriptionsCrc(clientId, topics);
+    if (!MqttSession::needsSubscribe(sessionPresent, subscriptions)) {
+      return 1;
+    }
+    sessionPresent = true;
+    MqttSession::subscribed(subscriptions, true);
+    return 1 + topics.size();
+  }
+};
+
+// the rtc memory is written back before the device sleeps
+void deepSleep()
+{
+  open_heat::rtc::commit();
+  shim::reboot();
+}
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+  open_heat::Filesystem fs;
+  open_heat::rtc::init(fs);
+}
+
+void tearDown() {}
+
+void test_new_session_subscribes()
+{
+  Broker broker;
+  TEST_ASSERT_EQUAL(1 + TOPICS.size(), broker.connect("living", TOPICS));
+}
+
+void test_present_session_is_resumed()
+{
+  Broker broker;
+  broker.connect("living", TOPICS);
+
+  // every later wake only connects
+  size_t roundTrips = 0;
+  for (int wake = 0; wake < 96; ++wake) {
+    deepSleep();
+    roundTrips += broker.connect("living", TOPICS);
+  }
+  TEST_ASSERT_EQUAL(96, roundTrips);
+}
+
+void test_lost_session_subscribes_again()
+{
+  Broker broker;
+  broker.connect("living", TOPICS);
+
+  // broker restarted without persistence
+  broker.sessionPresent = false;
+  TEST_ASSERT_EQUAL(1 + TOPICS.size(), broker.connect("living", TOPICS));
+}
+
+void test_changed_subscriptions_subscribe_again()
+{
+  Broker broker;
+  broker.connect("living", TOPICS);
+
+  const std::vector<const String*> withWindow{&MODE_TOPIC, &TEMP_TOPIC, &WINDOW_TOPIC};
+  TEST_ASSERT_EQUAL(1 + withWindow.size(), broker.connect("living", withWindow));
+  // a new client id has a new session
+  TEST_ASSERT_EQUAL(1 + withWindow.size(), broker.connect("kitchen", withWindow));
+}
+
+void test_topics_are_separated_in_the_crc()
+{
+  const String joined("heat/mode/setheat/temperature/target/set");
+  TEST_ASSERT_NOT_EQUAL(
+    MqttSession::subscriptionsCrc("living", TOPICS),
+    MqttSession::subscriptionsCrc("living", {&joined}));
+}
+
+void test_failed_subscription_is_retried()
+{
+  const auto subscriptions = MqttSession::subscriptionsCrc("living", TOPICS);
+  MqttSession::subscribed(subscriptions, false);
+  TEST_ASSERT_TRUE(MqttSession::needsSubscribe(true, subscriptions));
+
+  MqttSession::subscribed(subscriptions, true);
+  TEST_ASSERT_FALSE(MqttSession::needsSubscribe(true, subscriptions));
+}
+
+void test_power_loss_subscribes_again()
+{
+  Broker broker;
+  broker.connect("living", TOPICS);
+
+  open_heat::rtc::commit();
+  // the rtc memory is initialized again after a power loss
+  shim::powerOn();
+  open_heat::Filesystem fs;
+  open_heat::rtc::init(fs);
+  TEST_ASSERT_EQUAL(1 + TOPICS.size(), broker.connect("living", TOPICS));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_new_session_subscribes);
+  RUN_TEST(test_present_session_is_resumed);
+  RUN_TEST(test_lost_session_subscribes_again);
+  RUN_TEST(test_changed_subscriptions_subscribe_again);
+  RUN_TEST(test_topics_are_separated_in_the_crc);
+  RUN_TEST(test_failed_subscription_is_retried);
+  RUN_TEST(test_power_loss_subscribes_again);
+  return UNITY_END();
+}
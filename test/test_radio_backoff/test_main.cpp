@@ -0,0 +1,110 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <NativeDevice.hpp>
+#include <network/RadioBackoff.hpp>
+#include <RTCMemory.hpp>
+#include <cstdio>
+#include <unity.h>
+
+using open_heat::network::RadioBackoff;
+
+namespace {
+constexpr uint64_t MINUTE = 60 * 1000;
+
+// Radio wakes during an outage of the given length which starts at a radio wake
+uint32_t outageRadioWakes(const uint64_t outage, const uint64_t interval)
+{
+  uint32_t wakes = 0;
+  for (uint64_t time = 0; time < outage; ++wakes) {
+    time += RadioBackoff::failed(interval);
+  }
+  return wakes;
+}
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+  open_heat::Filesystem fs;
+  open_heat::rtc::init(fs);
+}
+
+void tearDown() {}
+
+void test_delay_doubles_with_every_failure()
+{
+  TEST_ASSERT_EQUAL_UINT64(15 * MINUTE, RadioBackoff::delayMillis(15 * MINUTE, 0));
+  TEST_ASSERT_EQUAL_UINT64(30 * MINUTE, RadioBackoff::delayMillis(15 * MINUTE, 1));
+  TEST_ASSERT_EQUAL_UINT64(60 * MINUTE, RadioBackoff::delayMillis(15 * MINUTE, 2));
+}
+
+void test_delay_is_capped()
+{
+  TEST_ASSERT_EQUAL_UINT64(
+    RadioBackoff::MAX_BACKOFF_MILLIS, RadioBackoff::delayMillis(15 * MINUTE, 200));
+}
+
+void test_longer_interval_is_never_shortened()
+{
+  TEST_ASSERT_EQUAL_UINT64(
+    4 * 60 * MINUTE, RadioBackoff::delayMillis(4 * 60 * MINUTE, 3));
+}
+
+void test_failures_are_counted_in_rtc_memory()
+{
+  TEST_ASSERT_EQUAL_UINT64(30 * MINUTE, RadioBackoff::failed(15 * MINUTE));
+  TEST_ASSERT_EQUAL_UINT64(60 * MINUTE, RadioBackoff::failed(15 * MINUTE));
+  TEST_ASSERT_EQUAL(2, open_heat::rtc::read().radioFailures);
+
+  RadioBackoff::succeeded();
+  TEST_ASSERT_EQUAL(0, open_heat::rtc::read().radioFailures);
+  TEST_ASSERT_EQUAL_UINT64(30 * MINUTE, RadioBackoff::failed(15 * MINUTE));
+}
+
+void test_failure_count_saturates()
+{
+  for (int i = 0; i < 300; ++i) {
+    RadioBackoff::failed(15 * MINUTE);
+  }
+  TEST_ASSERT_EQUAL(255, open_heat::rtc::read().radioFailures);
+}
+
+void test_outage_takes_few_radio_wakes()
+{
+  // 8 instead of 48 radio wakes in 12 hours with 15 minute modem sleep
+  const auto wakes = outageRadioWakes(12 * 60 * MINUTE, 15 * MINUTE);
+  TEST_ASSERT_EQUAL(8, wakes);
+
+  // every failed wake spends at most the connect budget with the radio on
+  const auto radioSeconds = wakes * RadioBackoff::CONNECT_BUDGET_MILLIS / 1000;
+  char message[64];
+  std::snprintf(message, sizeof(message), "12 h outage: %lu s radio on", radioSeconds);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_OR_EQUAL(80, radioSeconds);
+}
+
+void test_scans_are_rare_while_backing_off()
+{
+  TEST_ASSERT_TRUE(RadioBackoff::scanAllowed(0));
+  TEST_ASSERT_FALSE(RadioBackoff::scanAllowed(1));
+  TEST_ASSERT_FALSE(RadioBackoff::scanAllowed(3));
+  TEST_ASSERT_TRUE(RadioBackoff::scanAllowed(RadioBackoff::SCAN_FAILURES));
+  // the failure count saturates, access points which moved are still found
+  TEST_ASSERT_TRUE(RadioBackoff::scanAllowed(255));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_delay_doubles_with_every_failure);
+  RUN_TEST(test_delay_is_capped);
+  RUN_TEST(test_longer_interval_is_never_shortened);
+  RUN_TEST(test_failures_are_counted_in_rtc_memory);
+  RUN_TEST(test_failure_count_saturates);
+  RUN_TEST(test_outage_takes_few_radio_wakes);
+  RUN_TEST(test_scans_are_rare_while_backing_off);
+  return UNITY_END();
+}
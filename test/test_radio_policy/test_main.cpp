@@ -0,0 +1,98 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <ESP8266WiFi.h>
+#include <NativeDevice.hpp>
+#include <network/RadioPolicy.hpp>
+#include <unity.h>
+
+using Policy = open_heat::network::RadioPolicy;
+using open_heat::rtc::RadioState;
+
+namespace {
+constexpr uint8_t MAX_REDUCTION = Policy::MAX_TX_POWER - Policy::MIN_TX_POWER;
+constexpr RadioState CALIBRATED{-60, 0, 20, true, 3000, 3000, 1000};
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+  open_heat::Filesystem fs;
+  open_heat::rtc::init(fs);
+}
+
+void tearDown() {}
+
+void test_average_rssi()
+{
+  TEST_ASSERT_EQUAL_INT8(-60, Policy::averageRssi(0, -60));
+  TEST_ASSERT_EQUAL_INT8(-65, Policy::averageRssi(-60, -80));
+}
+
+void test_power_is_lowered_step_by_step_on_a_strong_link()
+{
+  TEST_ASSERT_EQUAL(Policy::TX_POWER_STEP, Policy::txPowerReduction(0, -50, -50));
+  TEST_ASSERT_EQUAL(MAX_REDUCTION, Policy::txPowerReduction(MAX_REDUCTION, -40, -40));
+  // at most down to the margin above the target
+  TEST_ASSERT_EQUAL(8, Policy::txPowerReduction(32, -60, -60));
+}
+
+void test_weak_connect_restores_full_power()
+{
+  TEST_ASSERT_EQUAL(0, Policy::txPowerReduction(MAX_REDUCTION, -50, -75));
+}
+
+void test_calibration_conditions()
+{
+  TEST_ASSERT_FALSE(Policy::needsCalibration(CALIBRATED, 25, 2000));
+  TEST_ASSERT_TRUE(Policy::needsCalibration(CALIBRATED, 8, 2000));
+  TEST_ASSERT_TRUE(Policy::needsCalibration(
+    CALIBRATED, 20, 1000 + Policy::CALIBRATION_INTERVAL_SECONDS));
+  TEST_ASSERT_TRUE(
+    Policy::needsCalibration({-60, 0, 20, true, 3000, 2700, 1000}, 20, 2000));
+  // unknown supply voltage
+  TEST_ASSERT_FALSE(
+    Policy::needsCalibration({-60, 0, 20, true, 0, 2700, 1000}, 20, 2000));
+  TEST_ASSERT_TRUE(Policy::needsCalibration({}, 0, 0));
+}
+
+void test_sleep_mode_calibrates_once()
+{
+  TEST_ASSERT_EQUAL(RF_DISABLED, Policy::sleepMode(false));
+  TEST_ASSERT_EQUAL(RF_CAL, Policy::sleepMode(true));
+  TEST_ASSERT_EQUAL(RF_NO_CAL, Policy::sleepMode(true));
+
+  Policy::failed();
+  TEST_ASSERT_EQUAL(RF_CAL, Policy::sleepMode(true));
+}
+
+void test_connects_lower_the_transmit_power()
+{
+  Policy::connected(-40);
+  Policy::connected(-40);
+  Policy::apply();
+  TEST_ASSERT_EQUAL_FLOAT(
+    (Policy::MAX_TX_POWER - 2 * Policy::TX_POWER_STEP) / 4.0F, WiFi.outputPower());
+
+  // no rssi
+  Policy::connected(31);
+  TEST_ASSERT_EQUAL(
+    2 * Policy::TX_POWER_STEP, open_heat::rtc::read().radioState.txPowerReduction);
+
+  Policy::failed();
+  TEST_ASSERT_EQUAL_FLOAT(Policy::MAX_TX_POWER / 4.0F, WiFi.outputPower());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_average_rssi);
+  RUN_TEST(test_power_is_lowered_step_by_step_on_a_strong_link);
+  RUN_TEST(test_weak_connect_restores_full_power);
+  RUN_TEST(test_calibration_conditions);
+  RUN_TEST(test_sleep_mode_calibrates_once);
+  RUN_TEST(test_connects_lower_the_transmit_power);
+  return UNITY_END();
+}
@@ -0,0 +1,149 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+// Rtc memory access of a valve wake, through the RAM shadow and the way it was
+// done before: every read copied the struct from the rtc bus and every setter
+// read and wrote it back. The bus transfers are exact. The times are host times
+// of the copies and the checksum, the latency of the rtc bus is not included.
+
+#include <NativeDevice.hpp>
+#include <RTCMemory.hpp>
+#include <chrono>
+#include <cstdio>
+#include <unity.h>
+
+using namespace open_heat;
+
+namespace {
+// rtc accesses of a wake which only checks the valve
+constexpr int WAKE_READS = 32;
+constexpr int WAKE_WRITES = 8;
+constexpr int WAKES = 1000;
+
+struct Cost {
+  size_t readBlocks;
+  size_t writtenBlocks;
+  double micros;
+};
+
+template<typename Wake>
+Cost measure(Wake&& wake)
+{
+  shim::rtcReadBlocks = 0;
+  shim::rtcWrittenBlocks = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < WAKES; ++i) {
+    wake(i);
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return {
+    shim::rtcReadBlocks / WAKES,
+    shim::rtcWrittenBlocks / WAKES,
+    std::chrono::duration<double, std::micro>(end - start).count() / WAKES};
+}
+
+rtc::Memory busRead()
+{
+  rtc::Memory memory;
+  ESP.rtcUserMemoryRead(0, reinterpret_cast<uint32_t*>(&memory), sizeof(memory));
+  // the copy must not be reduced to the field which is used
+  asm volatile("" : : "g"(&memory) : "memory");
+  return memory;
+}
+
+void busWrite(rtc::Memory& memory)
+{
+  ESP.rtcUserMemoryWrite(0, reinterpret_cast<uint32_t*>(&memory), sizeof(memory));
+}
+
+// volatile, so the reads are not optimized away
+volatile float sink = 0;
+
+void directWake(const int wake)
+{
+  for (int i = 0; i < WAKE_READS; ++i) {
+    sink = busRead().setTemp;
+  }
+  for (int i = 0; i < WAKE_WRITES; ++i) {
+    auto memory = busRead();
+    memory.lastMeasuredTemp = static_cast<float>(wake + i);
+    busWrite(memory);
+  }
+}
+
+void shadowWake(const int wake)
+{
+  shim::reboot();
+  for (int i = 0; i < WAKE_READS; ++i) {
+    sink = rtc::read().setTemp;
+  }
+  for (int i = 0; i < WAKE_WRITES; ++i) {
+    rtc::setLastMeasuredTemp(static_cast<float>(wake + i));
+  }
+  rtc::commit();
+}
+
+void report(const char* name, const Cost& cost)
+{
+  char message[128];
+  std::snprintf(
+    message,
+    sizeof(message),
+    "%s: %zu rtc blocks read, %zu written, %.2f us per wake",
+    name,
+    cost.readBlocks,
+    cost.writtenBlocks,
+    cost.micros);
+  TEST_MESSAGE(message);
+}
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+  Filesystem fs;
+  rtc::init(fs);
+  rtc::commit();
+}
+
+void tearDown() {}
+
+void test_shadow_transfers_less_than_direct_access()
+{
+  const auto direct = measure(directWake);
+  setUp();
+  const auto shadow = measure(shadowWake);
+  report("direct", direct);
+  report("shadow", shadow);
+
+  TEST_ASSERT_EQUAL(rtc::MEMORY_BLOCKS * (WAKE_READS + WAKE_WRITES), direct.readBlocks);
+  TEST_ASSERT_EQUAL(rtc::MEMORY_BLOCKS * WAKE_WRITES, direct.writtenBlocks);
+
+  // the image is read once on setup, the header and the block of the field
+  // are written on commit
+  TEST_ASSERT_LESS_THAN(rtc::USER_MEMORY_SIZE / rtc::BLOCK_SIZE, shadow.readBlocks);
+  TEST_ASSERT_EQUAL(4 + 1, shadow.writtenBlocks);
+}
+
+void test_setters_and_reads_do_not_touch_the_bus()
+{
+  rtc::setup();
+  shim::rtcReadBlocks = 0;
+  shim::rtcWrittenBlocks = 0;
+
+  rtc::setSetTemp(22);
+  rtc::setMode(HEAT);
+  TEST_ASSERT_EQUAL_FLOAT(22, rtc::read().setTemp);
+  TEST_ASSERT_EQUAL(0, shim::rtcReadBlocks);
+  TEST_ASSERT_EQUAL(0, shim::rtcWrittenBlocks);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_shadow_transfers_less_than_direct_access);
+  RUN_TEST(test_setters_and_reads_do_not_touch_the_bus);
+  return UNITY_END();
+}
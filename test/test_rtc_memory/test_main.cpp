@@ -0,0 +1,356 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <NativeDevice.hpp>
+#include <RTCMemory.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <interrupts.h>
+#include <unity.h>
+#include <vector>
+
+using namespace open_heat;
+
+namespace {
+// magic, layout version, size and crc
+constexpr size_t HEADER_BLOCKS = 4;
+constexpr size_t MEMORY_OFFSET = HEADER_BLOCKS * rtc::BLOCK_SIZE;
+
+void initialized()
+{
+  Filesystem fs;
+  rtc::init(fs);
+  rtc::commit();
+}
+
+// Every write of the simulated ISR sets all values of a field to the same number,
+// so a reader which sees different values got a torn copy.
+volatile uint32_t isrWrites = 0;
+volatile bool reading = false;
+volatile uint32_t interruptedReads = 0;
+
+void isrWrite()
+{
+  isrWrites = isrWrites + 1;
+  const uint32_t value = isrWrites;
+  rtc::setWakeTask(0, {value, value});
+  rtc::ThermalModelState model{};
+  std::fill(std::begin(model.coefficients), std::end(model.coefficients), value);
+  std::fill(std::begin(model.covariance), std::end(model.covariance), value);
+  rtc::setThermalModel(model);
+  if (reading) {
+    interruptedReads = interruptedReads + 1;
+  }
+}
+
+bool consistent(const rtc::ThermalModelState& model)
+{
+  return std::all_of(
+    std::begin(model.covariance), std::end(model.covariance), [&model](float value) {
+      return value == model.coefficients[0] && value == model.coefficients[1]
+        && value == model.coefficients[2];
+    });
+}
+
+bool consistent(const rtc::WakeTask& task)
+{
+  return task.deadlineMillis == task.slackMillis;
+}
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+}
+
+void tearDown() {}
+
+void test_uninitialized_memory_is_invalid()
+{
+  TEST_ASSERT_FALSE(rtc::isValid());
+}
+
+void test_committed_memory_survives_a_reboot()
+{
+  initialized();
+  rtc::setSetTemp(21.5F);
+  rtc::setMode(HEAT);
+  rtc::setModemSleepTime(42000);
+  rtc::commit();
+
+  shim::reboot();
+  TEST_ASSERT_TRUE(rtc::isValid());
+  const auto memory = rtc::read();
+  TEST_ASSERT_EQUAL_FLOAT(21.5F, memory.setTemp);
+  TEST_ASSERT_EQUAL(HEAT, memory.mode);
+  TEST_ASSERT_EQUAL_UINT32(42000, memory.modemSleepTime);
+}
+
+void test_uncommitted_changes_are_lost()
+{
+  initialized();
+  rtc::setSetTemp(21.5F);
+
+  shim::reboot(REASON_EXT_SYS_RST);
+  TEST_ASSERT_TRUE(rtc::isValid());
+  TEST_ASSERT_EQUAL_FLOAT(Config{}.SetTemperature, rtc::read().setTemp);
+}
+
+void test_crc_detects_a_flipped_bit()
+{
+  initialized();
+  shim::rtcUserMemory[MEMORY_OFFSET + offsetof(rtc::Memory, setTemp)] ^= 0x10;
+
+  shim::reboot();
+  TEST_ASSERT_FALSE(rtc::isValid());
+}
+
+void test_changed_layout_is_invalid()
+{
+  initialized();
+  // layout version of the header
+  shim::rtcUserMemory[rtc::BLOCK_SIZE] ^= 0x01;
+
+  shim::reboot();
+  TEST_ASSERT_FALSE(rtc::isValid());
+}
+
+void test_crc_covers_the_history()
+{
+  initialized();
+  rtc::addHistorySample(20, 0);
+  rtc::commit();
+  // time of the newest sample, the history follows the memory
+  shim::rtcUserMemory[MEMORY_OFFSET + sizeof(rtc::Memory)] ^= 0x01;
+
+  shim::reboot();
+  TEST_ASSERT_FALSE(rtc::isValid());
+}
+
+void test_changed_size_is_invalid()
+{
+  initialized();
+  // size of the header
+  shim::rtcUserMemory[2 * rtc::BLOCK_SIZE] ^= 0x04;
+
+  shim::reboot();
+  TEST_ASSERT_FALSE(rtc::isValid());
+}
+
+void test_init_restores_the_config_after_invalid_memory()
+{
+  Filesystem fs;
+  auto& config = fs.getConfig();
+  config.SetTemperature = 23;
+  config.Mode = HEAT;
+  fs.persistConfig();
+  initialized();
+  rtc::setSetTemp(17);
+  rtc::commit();
+  shim::rtcUserMemory[MEMORY_OFFSET] ^= 0x01;
+
+  shim::reboot();
+  TEST_ASSERT_FALSE(rtc::isValid());
+  Filesystem rebootedFs;
+  rtc::init(rebootedFs);
+  TEST_ASSERT_TRUE(rtc::isValid());
+  TEST_ASSERT_EQUAL_FLOAT(23, rtc::read().setTemp);
+  TEST_ASSERT_EQUAL(HEAT, rtc::read().mode);
+}
+
+void test_random_content_after_power_loss_is_invalid()
+{
+  initialized();
+
+  shim::powerOn();
+  TEST_ASSERT_FALSE(rtc::isValid());
+}
+
+void test_commit_writes_only_modified_blocks()
+{
+  initialized();
+  shim::rtcWrittenBlocks = 0;
+  rtc::commit();
+  TEST_ASSERT_EQUAL(0, shim::rtcWrittenBlocks);
+
+  rtc::setSetTemp(19);
+  rtc::commit();
+  // the header with the new crc and the float
+  TEST_ASSERT_EQUAL(HEADER_BLOCKS + 1, shim::rtcWrittenBlocks);
+
+  shim::rtcWrittenBlocks = 0;
+  rtc::setSetTemp(19);
+  rtc::commit();
+  TEST_ASSERT_EQUAL(0, shim::rtcWrittenBlocks);
+}
+
+void test_fields_do_not_overlap()
+{
+  initialized();
+  rtc::setWakeRadio(false);
+  rtc::setRadioFailures(3);
+  rtc::setMqttSubscriptionsCrc(0xDEADBEEF);
+  rtc::setIsWindowOpen(true);
+  rtc::commit();
+
+  shim::reboot();
+  const auto memory = rtc::read();
+  TEST_ASSERT_FALSE(memory.wakeRadio);
+  TEST_ASSERT_EQUAL(3, memory.radioFailures);
+  TEST_ASSERT_EQUAL_HEX32(0xDEADBEEF, memory.mqttSubscriptionsCrc);
+  TEST_ASSERT_TRUE(memory.isWindowOpen);
+  TEST_ASSERT_FALSE(memory.restoreMode);
+}
+
+void test_history_keeps_the_newest_samples()
+{
+  initialized();
+  size_t capacity = 0;
+  for (int i = 0; i < 100; ++i) {
+    rtc::addHistorySample(20 + i * 0.01F, static_cast<uint8_t>(i));
+    shim::advanceMillis(60 * 1000);
+    capacity = std::max(capacity, rtc::historySize());
+  }
+  rtc::commit();
+
+  shim::reboot();
+  TEST_ASSERT_TRUE(rtc::isValid());
+  TEST_ASSERT_EQUAL(capacity, rtc::historySize());
+  TEST_ASSERT_LESS_THAN(100, capacity);
+  TEST_ASSERT_GREATER_OR_EQUAL(rtc::HISTORY_MIN_SAMPLES, capacity);
+
+  const auto newest = rtc::historySample(0);
+  TEST_ASSERT_EQUAL(99, newest.valvePosition);
+  TEST_ASSERT_EQUAL(2099, newest.temperature);
+  TEST_ASSERT_EQUAL(60 / rtc::HISTORY_TIME_RESOLUTION_SECONDS, newest.timeDelta);
+  TEST_ASSERT_EQUAL(100 - capacity, rtc::historySample(capacity - 1).valvePosition);
+}
+
+void test_reset_flag_is_not_part_of_the_image()
+{
+  initialized();
+  rtc::writeResetFlag(0x12345678);
+  Filesystem fs;
+  rtc::init(fs);
+  rtc::commit();
+
+  shim::reboot();
+  TEST_ASSERT_TRUE(rtc::isValid());
+  TEST_ASSERT_EQUAL_HEX32(0x12345678, rtc::readResetFlag());
+}
+
+void test_offset_millis_continues_across_deep_sleep()
+{
+  initialized();
+  shim::advanceMillis(1500);
+  Filesystem fs;
+  rtc::wifiDeepSleep(10'000, RF_DISABLED, fs);
+  TEST_ASSERT_EQUAL_UINT64(10'000'000, shim::deepSleepMicros);
+  TEST_ASSERT_EQUAL(RF_DISABLED, shim::deepSleepMode);
+
+  shim::reboot();
+  shim::advanceMillis(200);
+  TEST_ASSERT_EQUAL_UINT64(11'700, rtc::offsetMillis());
+  TEST_ASSERT_FALSE(rtc::get<&rtc::Memory::wakeRadio>());
+}
+
+void test_get_returns_the_field_of_read()
+{
+  initialized();
+  rtc::setSetTemp(19.5F);
+  rtc::setCheckIntervalMillis(123'000);
+  rtc::setWakeTask(1, {4711, 42});
+
+  TEST_ASSERT_EQUAL_FLOAT(rtc::read().setTemp, rtc::get<&rtc::Memory::setTemp>());
+  TEST_ASSERT_EQUAL_UINT32(123'000, rtc::get<&rtc::Memory::checkIntervalMillis>());
+  TEST_ASSERT_EQUAL_UINT64(4711, rtc::wakeTask(1).deadlineMillis);
+  TEST_ASSERT_EQUAL_UINT32(42, rtc::wakeTask(1).slackMillis);
+}
+
+void test_get_does_not_access_the_rtc_memory()
+{
+  initialized();
+  shim::reboot();
+  rtc::get<&rtc::Memory::debug>();
+  const auto loadBlocks = shim::rtcReadBlocks;
+
+  // served from the shadow copy loaded by the first access
+  rtc::get<&rtc::Memory::setTemp>();
+  rtc::wakeTask(0);
+  TEST_ASSERT_EQUAL(loadBlocks, shim::rtcReadBlocks);
+}
+
+void test_readers_never_see_a_torn_write_of_an_isr()
+{
+  initialized();
+  rtc::setWakeTask(0, {0, 0});
+  constexpr uint32_t targetInterruptedReads = 2000;
+  std::vector<std::array<uint8_t, sizeof(shim::rtcUserMemory)>> committed;
+  size_t tornReads = 0;
+
+  const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+  const auto running = [end]() {
+    return interruptedReads < targetInterruptedReads
+      && std::chrono::steady_clock::now() < end;
+  };
+  shim::startInterrupts(isrWrite, 20);
+  for (size_t i = 0; running(); ++i) {
+    reading = true;
+    const auto memory = rtc::read();
+    const auto model = rtc::get<&rtc::Memory::thermalModel>();
+    const auto task = rtc::wakeTask(0);
+    reading = false;
+    tornReads += consistent(memory.thermalModel) && consistent(memory.wakeTasks[0])
+        && consistent(model) && consistent(task)
+      ? 0
+      : 1;
+
+    if (i % 64 == 0) {
+      rtc::commit();
+      committed.emplace_back();
+      std::copy(
+        std::begin(shim::rtcUserMemory),
+        std::end(shim::rtcUserMemory),
+        committed.back().begin());
+    }
+  }
+  shim::stopInterrupts();
+
+  TEST_ASSERT_GREATER_OR_EQUAL(targetInterruptedReads, interruptedReads);
+  TEST_ASSERT_EQUAL(0, tornReads);
+
+  // every committed image has a valid crc and consistent values
+  for (const auto& image : committed) {
+    std::copy(image.begin(), image.end(), std::begin(shim::rtcUserMemory));
+    shim::reboot();
+    TEST_ASSERT_TRUE(rtc::isValid());
+    TEST_ASSERT_TRUE(consistent(rtc::get<&rtc::Memory::thermalModel>()));
+    TEST_ASSERT_TRUE(consistent(rtc::wakeTask(0)));
+  }
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_uninitialized_memory_is_invalid);
+  RUN_TEST(test_committed_memory_survives_a_reboot);
+  RUN_TEST(test_uncommitted_changes_are_lost);
+  RUN_TEST(test_crc_detects_a_flipped_bit);
+  RUN_TEST(test_changed_layout_is_invalid);
+  RUN_TEST(test_crc_covers_the_history);
+  RUN_TEST(test_changed_size_is_invalid);
+  RUN_TEST(test_init_restores_the_config_after_invalid_memory);
+  RUN_TEST(test_random_content_after_power_loss_is_invalid);
+  RUN_TEST(test_commit_writes_only_modified_blocks);
+  RUN_TEST(test_fields_do_not_overlap);
+  RUN_TEST(test_history_keeps_the_newest_samples);
+  RUN_TEST(test_reset_flag_is_not_part_of_the_image);
+  RUN_TEST(test_offset_millis_continues_across_deep_sleep);
+  RUN_TEST(test_get_returns_the_field_of_read);
+  RUN_TEST(test_get_does_not_access_the_rtc_memory);
+  RUN_TEST(test_readers_never_see_a_torn_write_of_an_isr);
+  return UNITY_END();
+}
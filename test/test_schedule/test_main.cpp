@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <NativeDevice.hpp>
+#include <RTCMemory.hpp>
+#include <heating/Schedule.hpp>
+#include <string>
+#include <unity.h>
+
+using open_heat::heating::Schedule;
+
+namespace {
+std::string stored()
+{
+  const auto file = shim::files.find("/schedule.dat");
+  return file == shim::files.end() ? std::string() : *file->second;
+}
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+  open_heat::Filesystem fs;
+  open_heat::rtc::init(fs);
+}
+
+void tearDown() {}
+
+void test_schedule_is_stored()
+{
+  open_heat::Filesystem fs;
+  Schedule schedule(fs);
+  TEST_ASSERT_TRUE(schedule.set("1320,17;390,21"));
+  TEST_ASSERT_FALSE(stored().empty());
+
+  // the retained payload arrives again on every connect
+  const auto writes = shim::fileWrites;
+  TEST_ASSERT_FALSE(schedule.set("390,21;1320,17"));
+  TEST_ASSERT_EQUAL(writes, shim::fileWrites);
+}
+
+void test_malformed_schedule_keeps_the_stored_one()
+{
+  open_heat::Filesystem fs;
+  Schedule schedule(fs);
+  schedule.set("390,21;1320,17");
+  const auto before = stored();
+
+  TEST_ASSERT_FALSE(schedule.set("abc"));
+  TEST_ASSERT_FALSE(schedule.set("420,21;garbage"));
+  TEST_ASSERT_FALSE(schedule.set("420,21x"));
+  TEST_ASSERT_FALSE(schedule.set("420;21"));
+  TEST_ASSERT_FALSE(schedule.set("20000,21"));
+  TEST_ASSERT_TRUE(before == stored());
+}
+
+void test_off_or_empty_clears_the_schedule()
+{
+  open_heat::Filesystem fs;
+  Schedule schedule(fs);
+  schedule.set("390,21");
+  TEST_ASSERT_TRUE(schedule.set("off"));
+
+  schedule.set("390,21");
+  const auto before = stored();
+  TEST_ASSERT_TRUE(schedule.set(""));
+  TEST_ASSERT_FALSE(before == stored());
+  TEST_ASSERT_FALSE(schedule.set("off"));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_schedule_is_stored);
+  RUN_TEST(test_malformed_schedule_keeps_the_stored_one);
+  RUN_TEST(test_off_or_empty_clears_the_schedule);
+  return UNITY_END();
+}
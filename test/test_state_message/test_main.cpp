@@ -0,0 +1,118 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <network/StateMessage.hpp>
+#include <cstring>
+#include <string>
+#include <unity.h>
+
+using open_heat::network::StateMessage;
+
+namespace {
+// mqtt 3.1.1 publish packet with qos 0
+size_t packetSize(const size_t topicLength, const size_t payloadLength)
+{
+  const auto remaining = 2 + topicLength + payloadLength;
+  return 1 + (remaining < 128 ? 1 : 2) + remaining;
+}
+
+constexpr const char* BASE_TOPIC = "home/livingroom/";
+
+StateMessage exampleState(const StateFormat format)
+{
+  StateMessage message(format);
+  message.add("temp", 2137);
+  message.add("humidity", 4520);
+  message.add("target", 2100);
+  message.add("mode", "heat");
+  message.add("valve", 40);
+  message.add("battery", 87);
+  message.add("voltage", 4050);
+  message.add("sleep", 900000);
+  message.add("check", 300000);
+  message.finish();
+  return message;
+}
+
+std::string content(const StateMessage& message)
+{
+  return {message.data(), message.size()};
+}
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_json()
+{
+  TEST_ASSERT_EQUAL_STRING(
+    R"({"temp":2137,"humidity":4520,"target":2100,"mode":"heat","valve":40,)"
+    R"("battery":87,"voltage":4050,"sleep":900000,"check":300000})",
+    content(exampleState(STATE_JSON)).c_str());
+}
+
+void test_json_negative()
+{
+  StateMessage message(STATE_JSON);
+  message.add("t", -500);
+  message.add("min", INT32_MIN);
+  message.finish();
+  TEST_ASSERT_EQUAL_STRING(R"({"t":-500,"min":-2147483648})", content(message).c_str());
+}
+
+void test_cbor_negative()
+{
+  // {"t": -500}
+  StateMessage message(STATE_CBOR);
+  message.add("t", -500);
+  message.finish();
+  TEST_ASSERT_TRUE(content(message) == "\xBF\x61t\x39\x01\xF3\xFF");
+}
+
+void test_cbor_integer_sizes()
+{
+  StateMessage message(STATE_CBOR);
+  message.add("a", 23);
+  message.add("b", 24);
+  message.add("c", 300000);
+  message.finish();
+  // 23 fits into the header, 24 needs a byte and 300000 four
+  const std::string expected("\xBF\x61"
+                             "a\x17\x61"
+                             "b\x18\x18\x61"
+                             "c\x1A\x00\x04\x93\xE0\xFF",
+    16);
+  TEST_ASSERT_TRUE(content(message) == expected);
+}
+
+void test_overflow()
+{
+  StateMessage message(STATE_JSON);
+  for (int i = 0; i < 32 && !message.overflow(); ++i) {
+    message.add("value", i);
+  }
+  TEST_ASSERT_TRUE(message.overflow());
+  TEST_ASSERT_EQUAL(StateMessage::MAX_SIZE, message.size());
+}
+
+void test_packet_size()
+{
+  const auto topic = std::strlen(BASE_TOPIC) + std::strlen("state");
+  TEST_ASSERT_EQUAL(152, packetSize(topic, exampleState(STATE_JSON).size()));
+  TEST_ASSERT_EQUAL(118, packetSize(topic, exampleState(STATE_CBOR).size()));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_json);
+  RUN_TEST(test_json_negative);
+  RUN_TEST(test_cbor_negative);
+  RUN_TEST(test_cbor_integer_sizes);
+  RUN_TEST(test_overflow);
+  RUN_TEST(test_packet_size);
+  return UNITY_END();
+}
@@ -0,0 +1,178 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <network/TelemetryFilter.hpp>
+#include <unity.h>
+#include <algorithm>
+
+using Filter = open_heat::network::TelemetryFilter;
+using open_heat::rtc::PublishedState;
+
+namespace {
+constexpr TelemetrySettings SETTINGS{};
+constexpr PublishedState LAST{2100, 4500, 2100, 4000, 0, 40, 80, true, 900000, 300000, 0};
+
+PublishedState withTemp(const int16_t temp)
+{
+  auto state = LAST;
+  state.temp = temp;
+  return state;
+}
+
+// Publishes during a day with a wake every 15 minutes,
+// the temperature jitters by 0.05 degree around a constant value
+uint32_t publishesPerDay(const TelemetrySettings& settings)
+{
+  constexpr uint32_t interval = 15 * 60;
+  PublishedState last{};
+  uint32_t publishes = 0;
+  for (uint32_t seconds = interval; seconds <= 24 * 60 * 60; seconds += interval) {
+    const auto current = withTemp(static_cast<int16_t>(2100 + (seconds / interval) % 6));
+    const auto metrics = Filter::due(last, current, settings, seconds);
+    if (metrics != 0) {
+      ++publishes;
+      last = Filter::published(last, current, metrics, seconds);
+    }
+  }
+  return publishes;
+}
+
+// Messages of a day with a radio wake every 15 minutes and a valve check every
+// 5 minutes, the temperature stays constant
+uint32_t messagesPerDay(const TelemetrySettings& settings, size_t& maxSamples)
+{
+  constexpr uint32_t interval = 15 * 60;
+  // control, sleep, wake profile, wifi, radio and access point statistics
+  constexpr uint32_t statsMessages = 6;
+  PublishedState last{};
+  size_t samples = 0;
+  uint32_t messages = 0;
+  maxSamples = 0;
+  for (uint32_t seconds = interval; seconds <= 24 * 60 * 60; seconds += interval) {
+    samples += 3;
+    maxSamples = std::max(maxSamples, samples);
+    if (Filter::historyDue(last, settings, seconds, false, samples)) {
+      ++messages;
+      samples = 0;
+    }
+    if (Filter::statsDue(last, settings, seconds, false)) {
+      messages += statsMessages;
+    }
+    const auto metrics = Filter::due(last, LAST, settings, seconds);
+    if (metrics != 0) {
+      ++messages;
+      last = Filter::published(last, LAST, metrics, seconds);
+    }
+  }
+  return messages;
+}
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_everything_is_due_on_the_first_publish()
+{
+  TEST_ASSERT_EQUAL(Filter::ALL, Filter::due({}, LAST, SETTINGS, 0));
+}
+
+void test_nothing_is_due_without_change()
+{
+  TEST_ASSERT_EQUAL(0, Filter::due(LAST, LAST, SETTINGS, 60));
+}
+
+void test_heartbeat_publishes_everything()
+{
+  TEST_ASSERT_EQUAL(Filter::ALL, Filter::due(LAST, LAST, SETTINGS, 60 * 60));
+  TEST_ASSERT_EQUAL(Filter::ALL, Filter::due(LAST, LAST, {10, 100, 50, 0}, 60));
+}
+
+void test_noise_below_the_deadband_is_dropped()
+{
+  TEST_ASSERT_EQUAL(0, Filter::due(LAST, withTemp(2109), SETTINGS, 60));
+  TEST_ASSERT_EQUAL(Filter::TEMP, Filter::due(LAST, withTemp(2090), SETTINGS, 60));
+}
+
+void test_zero_deadband_publishes_every_change()
+{
+  TEST_ASSERT_EQUAL(
+    Filter::TEMP, Filter::due(LAST, withTemp(2101), {0, 100, 50, 60}, 60));
+}
+
+void test_settings_are_published_on_any_change()
+{
+  auto current = LAST;
+  current.mode = 1;
+  current.checkIntervalMillis = 600000;
+  TEST_ASSERT_EQUAL(
+    Filter::MODE | Filter::CHECK_INTERVAL, Filter::due(LAST, current, SETTINGS, 60));
+}
+
+void test_slow_drift_is_published_once_it_adds_up()
+{
+  const auto drifted = Filter::published(LAST, withTemp(2105), 0, 60);
+  TEST_ASSERT_EQUAL(2100, drifted.temp);
+  TEST_ASSERT_EQUAL(Filter::TEMP, Filter::due(drifted, withTemp(2110), SETTINGS, 120));
+}
+
+void test_heartbeat_restarts_after_publishing_everything()
+{
+  const auto published = Filter::published(LAST, withTemp(2200), Filter::ALL, 3600);
+  TEST_ASSERT_EQUAL(2200, published.temp);
+  TEST_ASSERT_EQUAL_UINT32(3600, published.heartbeatSeconds);
+  TEST_ASSERT_EQUAL(0, Filter::due(published, withTemp(2200), SETTINGS, 3600 + 60));
+}
+
+void test_publishes_per_day()
+{
+  TEST_ASSERT_EQUAL_UINT32(96, publishesPerDay({10, 100, 50, 0}));
+  TEST_ASSERT_EQUAL_UINT32(24, publishesPerDay(SETTINGS));
+}
+
+void test_stats_are_published_with_the_heartbeat()
+{
+  TEST_ASSERT_FALSE(Filter::statsDue(LAST, SETTINGS, 60, false));
+  TEST_ASSERT_TRUE(Filter::statsDue(LAST, SETTINGS, 60 * 60, false));
+  TEST_ASSERT_TRUE(Filter::statsDue(LAST, SETTINGS, 60, true));
+}
+
+void test_history_is_published_before_it_is_overwritten()
+{
+  TEST_ASSERT_FALSE(Filter::historyDue(LAST, SETTINGS, 60 * 60, false, 0));
+  TEST_ASSERT_FALSE(Filter::historyDue(LAST, SETTINGS, 60, false, 11));
+  TEST_ASSERT_TRUE(Filter::historyDue(LAST, SETTINGS, 60, false, 12));
+  TEST_ASSERT_TRUE(Filter::historyDue(LAST, SETTINGS, 60 * 60, false, 1));
+}
+
+void test_messages_per_day()
+{
+  size_t maxSamples = 0;
+  // state, history and statistics once per hour instead of 8 messages on each wake
+  TEST_ASSERT_EQUAL_UINT32(24 * 8, messagesPerDay(SETTINGS, maxSamples));
+  TEST_ASSERT_LESS_OR_EQUAL(open_heat::rtc::HISTORY_MIN_SAMPLES, maxSamples);
+
+  // a long heartbeat does not lose samples
+  TEST_ASSERT_EQUAL_UINT32(4 * 7 + 24, messagesPerDay({10, 100, 50, 6 * 60}, maxSamples));
+  TEST_ASSERT_LESS_OR_EQUAL(open_heat::rtc::HISTORY_MIN_SAMPLES, maxSamples);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_everything_is_due_on_the_first_publish);
+  RUN_TEST(test_nothing_is_due_without_change);
+  RUN_TEST(test_heartbeat_publishes_everything);
+  RUN_TEST(test_noise_below_the_deadband_is_dropped);
+  RUN_TEST(test_zero_deadband_publishes_every_change);
+  RUN_TEST(test_settings_are_published_on_any_change);
+  RUN_TEST(test_slow_drift_is_published_once_it_adds_up);
+  RUN_TEST(test_heartbeat_restarts_after_publishing_everything);
+  RUN_TEST(test_publishes_per_day);
+  RUN_TEST(test_stats_are_published_with_the_heartbeat);
+  RUN_TEST(test_history_is_published_before_it_is_overwritten);
+  RUN_TEST(test_messages_per_day);
+  return UNITY_END();
+}
@@ -0,0 +1,215 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <NativeDevice.hpp>
+#include <heating/ThermalModel.hpp>
+#include <algorithm>
+#include <cmath>
+#include <unity.h>
+
+using open_heat::heating::ThermalModel;
+
+namespace {
+constexpr unsigned long CHECK_MILLIS = 5 * 60 * 1000;
+
+// room the model has to learn, rates in degree per hour
+constexpr float GAIN = 3;
+constexpr float LOSS = 0.5F;
+constexpr float OFFSET = 0.2F;
+constexpr float VALVE_LAG_HOURS = 0.3F;
+
+struct Room {
+  float temperature{18};
+  float effectiveOpening{0};
+
+  // integrates the room over a check interval in one minute steps
+  void run(const float opening)
+  {
+    constexpr float hours = 1.0F / 60;
+    for (unsigned long minute = 0; minute < CHECK_MILLIS / 60'000; ++minute) {
+      effectiveOpening
+        += (opening - effectiveOpening) * (1 - std::exp(-hours / VALVE_LAG_HOURS));
+      temperature
+        += (GAIN * effectiveOpening - LOSS * (temperature - 20) + OFFSET) * hours;
+    }
+    shim::advanceMillis(CHECK_MILLIS);
+  }
+};
+
+// valve opening which changes every two hours
+float opening(const int check)
+{
+  constexpr float openings[] = {1, 0, 0.5F, 0.2F, 0.8F, 0};
+  return openings[check / 24 % 6];
+}
+
+float coefficient(const size_t index)
+{
+  return open_heat::rtc::read().thermalModel.coefficients[index];
+}
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+  open_heat::Filesystem fs;
+  open_heat::rtc::init(fs);
+}
+
+void tearDown() {}
+
+void test_untrained_model_uses_defaults()
+{
+  open_heat::Filesystem fs;
+  ThermalModel model(fs);
+  model.setup();
+
+  TEST_ASSERT_FALSE(ThermalModel::isTrained());
+  TEST_ASSERT_EQUAL_FLOAT(2, coefficient(0));
+}
+
+void test_learns_the_room()
+{
+  open_heat::Filesystem fs;
+  ThermalModel model(fs);
+  model.setup();
+
+  Room room;
+  for (int check = 0; check < 3 * 24 * 12; ++check) {
+    room.run(opening(check));
+    model.update(room.temperature, opening(check));
+  }
+
+  TEST_ASSERT_TRUE(ThermalModel::isTrained());
+  TEST_ASSERT_FLOAT_WITHIN(0.3F, GAIN, coefficient(0));
+  TEST_ASSERT_FLOAT_WITHIN(0.1F, LOSS, coefficient(1));
+  // loss and offset are hardly distinguishable close to the operating point
+  // of the room, only their sum there is checked
+  TEST_ASSERT_FLOAT_WITHIN(
+    0.1F, OFFSET - LOSS * 2, coefficient(2) - coefficient(1) * 2);
+
+  // one hour ahead with the valve closed
+  const auto predicted = ThermalModel::predict(room.temperature, 0, 60 * 60 * 1000);
+  Room closed = room;
+  for (int check = 0; check < 12; ++check) {
+    closed.run(0);
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.3F, closed.temperature, predicted);
+}
+
+void test_required_opening_reaches_the_target()
+{
+  open_heat::Filesystem fs;
+  ThermalModel model(fs);
+  model.setup();
+
+  // with the default model 20 degree are held closed, one degree per hour needs 50 %
+  TEST_ASSERT_FLOAT_WITHIN(0.01F, 0.5F, ThermalModel::requiredOpening(20, 21, 3600000));
+  TEST_ASSERT_EQUAL_FLOAT(0, ThermalModel::requiredOpening(22, 21, 3600000));
+  TEST_ASSERT_EQUAL_FLOAT(1, ThermalModel::requiredOpening(15, 21, 3600000));
+}
+
+void test_open_window_does_not_update_the_model()
+{
+  open_heat::Filesystem fs;
+  ThermalModel model(fs);
+  model.setup();
+
+  shim::advanceMillis(CHECK_MILLIS);
+  model.update(20, 0);
+  shim::advanceMillis(CHECK_MILLIS);
+  // 5 degree in 5 minutes
+  model.update(15, 0);
+
+  TEST_ASSERT_EQUAL(0, open_heat::rtc::read().thermalModel.updates);
+}
+
+void test_rate_uses_the_temperature_of_the_last_update()
+{
+  open_heat::Filesystem fs;
+  ThermalModel model(fs);
+  model.setup();
+
+  shim::advanceMillis(CHECK_MILLIS);
+  model.update(20, 0);
+  shim::advanceMillis(CHECK_MILLIS);
+  // a measurement between two updates, e.g. for a state publish
+  open_heat::rtc::setLastMeasuredTemp(15);
+  model.update(20, 0);
+
+  TEST_ASSERT_EQUAL(1, open_heat::rtc::read().thermalModel.updates);
+  TEST_ASSERT_EQUAL_FLOAT(20, open_heat::rtc::read().thermalModel.lastUpdateTemp);
+}
+
+void test_covariance_is_not_forgotten_above_the_trace_limit()
+{
+  open_heat::Filesystem fs;
+  ThermalModel model(fs);
+  model.setup();
+
+  // wound up covariance, trace 1500
+  auto state = open_heat::rtc::read().thermalModel;
+  std::fill(std::begin(state.coefficients), std::end(state.coefficients), 0.0F);
+  const float covariance[6] = {500, 0, 0, 500, 0, 500};
+  std::copy(std::begin(covariance), std::end(covariance), state.covariance);
+  shim::advanceMillis(CHECK_MILLIS);
+  state.lastUpdateMillis = open_heat::rtc::offsetMillis();
+  state.lastUpdateTemp = 21;
+  state.effectiveOpening = 0.5F;
+  open_heat::rtc::setThermalModel(state);
+
+  shim::advanceMillis(CHECK_MILLIS);
+  model.update(21, 0.5F);
+
+  // Without forgetting P' x = P x / (1 + x' P x) for the regressors x.
+  // A gain computed with another forgetting factor than P' breaks this.
+  const float regressors[3] = {0.5F, -1, 1};
+  const auto updated = open_heat::rtc::read().thermalModel;
+  TEST_ASSERT_EQUAL(1, updated.updates);
+  const auto scale = 500 / (1 + 500 * 2.25F);
+  const int packed[3][3] = {{0, 1, 2}, {1, 3, 4}, {2, 4, 5}};
+  for (int row = 0; row < 3; ++row) {
+    float product = 0;
+    for (int column = 0; column < 3; ++column) {
+      product += updated.covariance[packed[row][column]] * regressors[column];
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-4F, scale * regressors[row], product);
+  }
+}
+
+void test_coefficients_survive_a_power_loss()
+{
+  open_heat::Filesystem fs;
+  ThermalModel model(fs);
+  model.setup();
+
+  Room room;
+  for (int check = 0; check < 2 * 24 * 12; ++check) {
+    room.run(opening(check));
+    model.update(room.temperature, opening(check));
+  }
+  const auto gain = coefficient(0);
+
+  shim::powerOn();
+  open_heat::Filesystem restartedFs;
+  open_heat::rtc::init(restartedFs);
+  ThermalModel restarted(restartedFs);
+  restarted.setup();
+  TEST_ASSERT_FLOAT_WITHIN(0.5F, gain, coefficient(0));
+  TEST_ASSERT_TRUE(ThermalModel::isTrained());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_untrained_model_uses_defaults);
+  RUN_TEST(test_learns_the_room);
+  RUN_TEST(test_required_opening_reaches_the_target);
+  RUN_TEST(test_open_window_does_not_update_the_model);
+  RUN_TEST(test_rate_uses_the_temperature_of_the_last_update);
+  RUN_TEST(test_covariance_is_not_forgotten_above_the_trace_limit);
+  RUN_TEST(test_coefficients_survive_a_power_loss);
+  return UNITY_END();
+}
@@ -0,0 +1,134 @@
+//
+// Copyright (c) 2021 Alexander Mohr
+// Licensed under the terms of the GNU General Public License v3.0
+//
+
+#include <NativeDevice.hpp>
+#include <WakeScheduler.hpp>
+#include <unity.h>
+
+using open_heat::WakeScheduler;
+using Task = WakeScheduler::Task;
+
+namespace {
+constexpr uint64_t MINUTE = 60 * 1000;
+} // namespace
+
+void setUp()
+{
+  shim::factoryReset();
+  open_heat::Filesystem fs;
+  open_heat::rtc::init(fs);
+  for (size_t task = 0; task < static_cast<size_t>(Task::COUNT); ++task) {
+    WakeScheduler::cancel(static_cast<Task>(task));
+  }
+}
+
+void tearDown() {}
+
+void test_short_gap_without_radio_is_cheaper_in_light_sleep()
+{
+  TEST_ASSERT_TRUE(WakeScheduler::isLightSleepCheaper(10'000, 400, false, false));
+  TEST_ASSERT_FALSE(WakeScheduler::isLightSleepCheaper(60'000, 400, false, false));
+}
+
+void test_radio_boot_makes_light_sleep_worth_longer()
+{
+  TEST_ASSERT_FALSE(WakeScheduler::isLightSleepCheaper(30'000, 400, false, false));
+  TEST_ASSERT_TRUE(WakeScheduler::isLightSleepCheaper(30'000, 2500, true, true));
+  TEST_ASSERT_FALSE(WakeScheduler::isLightSleepCheaper(300'000, 10'000, true, true));
+}
+
+void test_light_sleep_is_cheaper_up_to_break_even()
+{
+  // deep: (100 + 400) ms * 20 mA + gap * 20 uA, light: gap * 1 mA
+  const uint64_t breakEven = 500 * 20'000 / (1'000 - 20);
+  TEST_ASSERT_TRUE(WakeScheduler::isLightSleepCheaper(breakEven, 400, false, false));
+  TEST_ASSERT_FALSE(
+    WakeScheduler::isLightSleepCheaper(breakEven + 1, 400, false, false));
+}
+
+void test_next_wake_is_the_earliest_deadline()
+{
+  WakeScheduler::schedule(Task::VALVE, 5 * MINUTE);
+  WakeScheduler::schedule(Task::MQTT, 15 * MINUTE);
+
+  const auto wake = WakeScheduler::nextWake(false);
+  TEST_ASSERT_EQUAL_UINT64(5 * MINUTE, wake.millis);
+  TEST_ASSERT_FALSE(wake.enableRadio);
+  TEST_ASSERT_FALSE(wake.lightSleep);
+}
+
+void test_task_within_its_slack_joins_the_wake()
+{
+  WakeScheduler::schedule(Task::VALVE, 5 * MINUTE);
+  WakeScheduler::schedule(Task::MQTT, 7 * MINUTE, 3 * MINUTE);
+
+  const auto wake = WakeScheduler::nextWake(false);
+  TEST_ASSERT_EQUAL_UINT64(5 * MINUTE, wake.millis);
+  TEST_ASSERT_TRUE(wake.enableRadio);
+
+  shim::advanceMillis(5 * MINUTE);
+  TEST_ASSERT_TRUE(WakeScheduler::isDue(Task::VALVE));
+  TEST_ASSERT_TRUE(WakeScheduler::isDue(Task::MQTT));
+}
+
+void test_minimal_sleep()
+{
+  WakeScheduler::schedule(Task::VALVE, 0);
+
+  const auto wake = WakeScheduler::nextWake(false);
+  TEST_ASSERT_EQUAL_UINT64(10'000, wake.millis);
+  TEST_ASSERT_TRUE(wake.lightSleep);
+}
+
+void test_radio_task_is_not_due_without_radio()
+{
+  WakeScheduler::schedule(Task::MQTT, 0);
+  open_heat::rtc::setWakeRadio(false);
+  TEST_ASSERT_FALSE(WakeScheduler::isDue(Task::MQTT));
+
+  open_heat::rtc::setWakeRadio(true);
+  TEST_ASSERT_TRUE(WakeScheduler::isDue(Task::MQTT));
+}
+
+void test_radio_wake_after_radio_off_needs_a_deep_sleep()
+{
+  WakeScheduler::schedule(Task::MQTT, 20'000);
+  open_heat::rtc::setWakeRadio(false);
+
+  const auto wake = WakeScheduler::nextWake(false);
+  TEST_ASSERT_TRUE(wake.enableRadio);
+  TEST_ASSERT_FALSE(wake.lightSleep);
+}
+
+void test_light_sleep_without_wifi_switches_the_radio_off()
+{
+  open_heat::Filesystem fs;
+  open_heat::rtc::lightSleep(10'000, true, fs);
+  TEST_ASSERT_TRUE(open_heat::rtc::get<&open_heat::rtc::Memory::wakeRadio>());
+
+  open_heat::rtc::lightSleep(10'000, false, fs);
+  TEST_ASSERT_FALSE(open_heat::rtc::get<&open_heat::rtc::Memory::wakeRadio>());
+
+  // the next radio wake has to boot with the radio enabled
+  WakeScheduler::schedule(Task::MQTT, open_heat::rtc::offsetMillis() + 20'000);
+  const auto wake = WakeScheduler::nextWake(false);
+  TEST_ASSERT_TRUE(wake.enableRadio);
+  TEST_ASSERT_FALSE(wake.lightSleep);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_short_gap_without_radio_is_cheaper_in_light_sleep);
+  RUN_TEST(test_radio_boot_makes_light_sleep_worth_longer);
+  RUN_TEST(test_light_sleep_is_cheaper_up_to_break_even);
+  RUN_TEST(test_next_wake_is_the_earliest_deadline);
+  RUN_TEST(test_task_within_its_slack_joins_the_wake);
+  RUN_TEST(test_minimal_sleep);
+  RUN_TEST(test_radio_task_is_not_due_without_radio);
+  RUN_TEST(test_radio_wake_after_radio_off_needs_a_deep_sleep);
+  RUN_TEST(test_light_sleep_without_wifi_switches_the_radio_off);
+  return UNITY_END();
+}